@@ -0,0 +1,57 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "benchmark.hpp"
+
+#include "config.hpp"
+#include "fixtures.hpp"
+
+namespace digitalcurling3_server::bench {
+
+void RegisterConfigBenchmarks(BenchmarkRunner & runner)
+{
+    runner.Add("config/parse", [](BenchmarkContext & context) {
+        auto const text = GetSampleConfigText();
+        context.SetBytesPerOp(text.size());
+
+        context.Run([&](std::uint64_t iterations) {
+            for (std::uint64_t i = 0; i < iterations; ++i) {
+                auto const config = nlohmann::json::parse(text).get<Config>();
+                (void)config;
+            }
+        });
+    });
+
+    // ホスティングモードでは試合ごとに複製する
+    runner.Add("config/clone", [](BenchmarkContext & context) {
+        auto const config = CreateSampleConfig();
+
+        context.Run([&](std::uint64_t iterations) {
+            for (std::uint64_t i = 0; i < iterations; ++i) {
+                auto const clone = config.Clone();
+                (void)clone;
+            }
+        });
+    });
+}
+
+} // namespace digitalcurling3_server::bench
@@ -0,0 +1,120 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "benchmark.hpp"
+
+#include <string>
+#include "fixtures.hpp"
+#include "log.hpp"
+#include "trajectory_codec.hpp"
+
+namespace digitalcurling3_server::bench {
+
+namespace {
+
+/// \brief 軌跡を除いた更新メッセージ(試合ログに出力する形)
+nlohmann::json CreateUpdateJson(RecordedShot const& shot)
+{
+    return nlohmann::json{
+        { "cmd", "update" },
+        { "last_move", {
+            { "actual_move", shot.move },
+            { "free_guard_zone_foul", false },
+        }},
+        { "next_team", shot.state.GetNextTeam() },
+        { "state", shot.state },
+    };
+}
+
+} // unnamed namespace
+
+void RegisterLogBenchmarks(BenchmarkRunner & runner)
+{
+    runner.Add("log/game", [](BenchmarkContext & context) {
+        auto const config = CreateSampleConfig();
+        auto const shots = RecordShots(config);
+        std::vector<nlohmann::json> records;
+        for (auto const& shot : shots) {
+            records.push_back(CreateUpdateJson(shot));
+        }
+        context.SetBytesPerOp(records.back().dump().size());
+
+        GameLog game_log(GetNewGameLogDirectory("log_game"));
+        context.Run([&](std::uint64_t iterations) {
+            for (std::uint64_t i = 0; i < iterations; ++i) {
+                Log::Game(game_log, records[i % records.size()]);
+            }
+        });
+    });
+
+    runner.Add("log/game_serialized", [](BenchmarkContext & context) {
+        auto const config = CreateSampleConfig();
+        auto const shots = RecordShots(config);
+        std::vector<std::string> records;
+        for (auto const& shot : shots) {
+            records.push_back(CreateUpdateJson(shot).dump());
+        }
+        context.SetBytesPerOp(records.back().size());
+
+        GameLog game_log(GetNewGameLogDirectory("log_game_serialized"));
+        context.Run([&](std::uint64_t iterations) {
+            for (std::uint64_t i = 0; i < iterations; ++i) {
+                Log::GameSerialized(game_log, records[i % records.size()]);
+            }
+        });
+    });
+
+    // ショットログは形式が files の場合1ショット1ファイルになるため，同じ16ファイルを上書きし続ける
+    runner.Add("log/shot", [](BenchmarkContext & context) {
+        auto const config = CreateSampleConfig();
+        auto const shots = RecordShots(config);
+        auto const trajectories = RecordTrajectories(config, shots);
+        std::vector<std::string> records;
+        std::uint64_t total_size = 0;
+        for (size_t i = 0; i < shots.size(); ++i) {
+            nlohmann::json const json_shot{
+                { "end", shots[i].state.end },
+                { "shot", shots[i].state.shot },
+                { "selected_move", shots[i].move },
+                { "actual_move", shots[i].move },
+            };
+            std::string text = json_shot.dump();
+            text.pop_back();
+            text += R"(,"trajectory":)";
+            WriteTrajectoryJson(text, trajectories[i], config.server.trajectory_format);
+            text += '}';
+            total_size += text.size();
+            records.push_back(std::move(text));
+        }
+        context.SetBytesPerOp(total_size / records.size());
+
+        GameLog game_log(GetNewGameLogDirectory("log_shot"));
+        context.Run([&](std::uint64_t iterations) {
+            for (std::uint64_t i = 0; i < iterations; ++i) {
+                auto const index = i % records.size();
+                Log::ShotSerialized(game_log, records[index], shots[index].state.end, shots[index].state.shot);
+            }
+        });
+    });
+}
+
+} // namespace digitalcurling3_server::bench
@@ -0,0 +1,82 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "benchmark.hpp"
+
+#include <string>
+#include "fixtures.hpp"
+#include "trajectory_codec.hpp"
+
+namespace digitalcurling3_server::bench {
+
+namespace {
+
+/// \brief 記録した軌跡を指定した形式でシリアライズする(更新メッセージとショットログで使う)
+void SerializeTrajectories(BenchmarkContext & context, TrajectoryFormat format)
+{
+    auto const config = CreateSampleConfig();
+    auto const trajectories = RecordTrajectories(config, RecordShots(config));
+
+    std::string out;
+    std::uint64_t total_size = 0;
+    for (auto const& trajectory : trajectories) {
+        out.clear();
+        WriteTrajectoryJson(out, trajectory, format);
+        total_size += out.size();
+    }
+    context.SetBytesPerOp(total_size / trajectories.size());
+
+    context.Run([&](std::uint64_t iterations) {
+        for (std::uint64_t i = 0; i < iterations; ++i) {
+            out.clear();
+            WriteTrajectoryJson(out, trajectories[i % trajectories.size()], format);
+        }
+    });
+}
+
+} // unnamed namespace
+
+void RegisterMessageBenchmarks(BenchmarkRunner & runner)
+{
+    runner.Add("update_message/trajectory_json", [](BenchmarkContext & context) {
+        SerializeTrajectories(context, TrajectoryFormat::kJSON);
+    });
+
+    runner.Add("update_message/trajectory_binary", [](BenchmarkContext & context) {
+        SerializeTrajectories(context, TrajectoryFormat::kBinary);
+    });
+
+    runner.Add("update_message/game_state", [](BenchmarkContext & context) {
+        auto const config = CreateSampleConfig();
+        auto const shots = RecordShots(config);
+        context.SetBytesPerOp(nlohmann::json(shots.back().state).dump().size());
+
+        context.Run([&](std::uint64_t iterations) {
+            for (std::uint64_t i = 0; i < iterations; ++i) {
+                auto const text = nlohmann::json(shots[i % shots.size()].state).dump();
+                (void)text;
+            }
+        });
+    });
+}
+
+} // namespace digitalcurling3_server::bench
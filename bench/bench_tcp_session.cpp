@@ -0,0 +1,156 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "benchmark.hpp"
+
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+#include "fixtures.hpp"
+#include "message_template.hpp"
+#include "server.hpp"
+
+namespace digitalcurling3_server::bench {
+
+using boost::asio::ip::tcp;
+using namespace std::string_view_literals;
+
+namespace {
+
+// ホグラインに届かずに除外される弱いショット．シミュレーションの時間を小さくし，通信の時間を測る．
+// 得点が入らないため，試合はエキストラエンドが続き終了しない．
+constexpr auto kMoveLine = R"({"cmd":"move","move":{"type":"shot","velocity":{"x":0.0,"y":0.5},"rotation":"ccw"}})" "\n"sv;
+
+/// \brief 同期的に読み書きするクライアント
+class LoopbackClient {
+public:
+    explicit LoopbackClient(boost::asio::io_context & io_context)
+        : socket_(io_context)
+        , buffer_()
+    {}
+
+    tcp::socket & GetSocket() { return socket_; }
+
+    void WriteLine(std::string_view line)
+    {
+        boost::asio::write(socket_, boost::asio::buffer(line.data(), line.size()));
+    }
+
+    std::string ReadLine()
+    {
+        auto const n = boost::asio::read_until(socket_, boost::asio::dynamic_buffer(buffer_), '\n');
+        std::string line = buffer_.substr(0, n - 1);
+        buffer_.erase(0, n);
+        return line;
+    }
+
+    /// \brief 更新メッセージを受信し，次に投げるチームを返す
+    size_t ReadUpdate()
+    {
+        auto const line = ReadLine();
+        constexpr auto kNextTeamKey = R"("next_team":"team)"sv;
+        auto const pos = line.find(kNextTeamKey);
+        if (line.find(R"("cmd":"update")"sv) == std::string::npos || pos == std::string::npos
+            || pos + kNextTeamKey.size() >= line.size()) {
+            throw std::runtime_error("unexpected message: " + line);
+        }
+        return line[pos + kNextTeamKey.size()] == '1' ? 1 : 0;
+    }
+
+private:
+    tcp::socket socket_;
+    std::string buffer_;
+};
+
+} // unnamed namespace
+
+void RegisterTCPSessionBenchmarks(BenchmarkRunner & runner)
+{
+    // ループバック接続で，moveの送信から更新メッセージの受信までを測る．
+    // サーバー側では TCPSession の読み書き， Game のショットの処理，試合ログとショットログの出力が含まれる．
+    runner.Add("tcp_session/move_round_trip", [](BenchmarkContext & context) {
+        boost::asio::io_context io_context;
+        auto work = boost::asio::make_work_guard(io_context);
+        std::thread io_thread([&io_context] { io_context.run(); });
+
+        auto config = CreateSampleConfig();
+        auto const templates = GameMessageTemplates::Create(config);
+        auto server = std::make_shared<Server>(io_context, std::move(config), "", "bench",
+            GetNewGameLogDirectory("tcp_session"), templates, [] {});
+
+        // ホスティングモードと同じく，接続済みのソケットを割り当てる(dcは送信済みとして扱われる)
+        std::array<std::unique_ptr<LoopbackClient>, 2> clients;
+        {
+            tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+            for (size_t i = 0; i < clients.size(); ++i) {
+                clients[i] = std::make_unique<LoopbackClient>(io_context);
+                clients[i]->GetSocket().connect(acceptor.local_endpoint());
+                clients[i]->GetSocket().set_option(tcp::no_delay(true));
+                tcp::socket socket = acceptor.accept();
+                socket.set_option(tcp::no_delay(true));
+                boost::asio::post(server->GetStrand(),
+                    [server, i, socket = std::move(socket)]() mutable
+                    {
+                        server->Attach(i, std::move(socket), std::string());
+                    });
+            }
+        }
+
+        for (size_t i = 0; i < clients.size(); ++i) {
+            clients[i]->WriteLine(R"({"cmd":"dc_ok","name":"bench"})" "\n"sv);
+            clients[i]->ReadLine();  // is_ready
+            clients[i]->WriteLine(R"({"cmd":"ready_ok","player_order":[0,1,2,3]})" "\n"sv);
+        }
+        size_t next_team = 0;
+        for (auto & client : clients) {
+            client->ReadLine();  // new_game
+            next_team = client->ReadUpdate();
+        }
+
+        context.Run([&](std::uint64_t iterations) {
+            for (std::uint64_t i = 0; i < iterations; ++i) {
+                clients[next_team]->WriteLine(kMoveLine);
+                for (auto & client : clients) {
+                    next_team = client->ReadUpdate();
+                }
+            }
+        });
+
+        boost::asio::post(server->GetStrand(), [server] { server->Stop(); });
+        for (auto & client : clients) {
+            boost::system::error_code ignored_error;
+            client->GetSocket().close(ignored_error);
+        }
+        work.reset();
+        io_thread.join();
+    });
+}
+
+} // namespace digitalcurling3_server::bench
@@ -0,0 +1,181 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "benchmark.hpp"
+
+#include <random>
+#include <stdexcept>
+#include "fixtures.hpp"
+#include "trajectory_compressor.hpp"
+#include "trajectory_decoder.hpp"
+
+namespace digitalcurling3_server::bench {
+
+namespace dc = digitalcurling3;
+
+namespace {
+
+/// \brief RecordSimulations() で記録したストーンの状態を返すシミュレータ
+///
+/// TrajectoryCompressor が参照しないメンバ関数は元のシミュレータに委譲する．
+class PlaybackSimulator : public dc::ISimulator {
+public:
+    explicit PlaybackSimulator(dc::ISimulator & simulator)
+        : simulator_(simulator)
+        , stones_(nullptr)
+        , all_stones_stopped_(false)
+        , seconds_per_frame_(0.f)
+    {}
+
+    void SetStep(RecordedSimulation const& simulation, RecordedStep const& step)
+    {
+        stones_ = &step.stones;
+        all_stones_stopped_ = step.all_stones_stopped;
+        seconds_per_frame_ = simulation.seconds_per_frame;
+    }
+
+    void SetLast(RecordedSimulation const& simulation)
+    {
+        stones_ = &simulation.last_stones;
+        all_stones_stopped_ = true;
+        seconds_per_frame_ = simulation.seconds_per_frame;
+    }
+
+    void SetStones(AllStoneData const&) override { throw std::logic_error("PlaybackSimulator::SetStones"); }
+    void Step() override { throw std::logic_error("PlaybackSimulator::Step"); }
+    AllStoneData const& GetStones() const override { return *stones_; }
+    bool AreAllStonesStopped() const override { return all_stones_stopped_; }
+    float GetSecondsPerFrame() const override { return seconds_per_frame_; }
+    dc::ISimulatorFactory const& GetFactory() const override { return simulator_.GetFactory(); }
+    std::unique_ptr<dc::ISimulatorStorage> CreateStorage() const override { return simulator_.CreateStorage(); }
+    void Save(dc::ISimulatorStorage & storage) const override { simulator_.Save(storage); }
+    void Load(dc::ISimulatorStorage const&) override { throw std::logic_error("PlaybackSimulator::Load"); }
+
+private:
+    dc::ISimulator & simulator_;
+    AllStoneData const* stones_;
+    bool all_stones_stopped_;
+    float seconds_per_frame_;
+};
+
+/// \brief 記録したショットを順にシミュレーションする
+///
+/// TrajectoryCompressor を含まない，1ショットのシミュレーションの処理時間の目安．
+///
+/// \param context 計測器
+void SimulateShots(BenchmarkContext & context)
+{
+    auto const config = CreateSampleConfig();
+    auto const shots = RecordShots(config);
+    auto const simulator = config.game.simulator->CreateSimulator();
+    auto const player = config.game.players[0].front()->CreatePlayer();
+
+    context.Run([&](std::uint64_t iterations) {
+        for (std::uint64_t i = 0; i < iterations; ++i) {
+            auto const& shot = shots[i % shots.size()];
+            auto state = shot.state;
+            auto move = shot.move;
+            dc::ApplyMoveResult result;
+            dc::ApplyMove(config.game.setting, *simulator, *player, state, move, std::chrono::milliseconds(0), &result,
+                [](dc::ISimulator const&) {});
+        }
+    });
+}
+
+/// \brief 記録したストーンの状態を TrajectoryCompressor に渡して軌跡を圧縮する
+///
+/// シミュレーションは事前に1度だけ行うため， TrajectoryCompressor の処理時間だけを計測する．
+///
+/// \param context 計測器
+/// \param tolerance 非可逆圧縮の許容誤差
+void CompressShots(BenchmarkContext & context, TrajectoryCompressor::Tolerance const& tolerance)
+{
+    auto const config = CreateSampleConfig();
+    auto const simulations = RecordSimulations(config, RecordShots(config));
+    auto const simulator = config.game.simulator->CreateSimulator();
+    PlaybackSimulator playback(*simulator);
+    TrajectoryCompressor compressor;
+
+    context.Run([&](std::uint64_t iterations) {
+        for (std::uint64_t i = 0; i < iterations; ++i) {
+            auto const& simulation = simulations[i % simulations.size()];
+            compressor.Begin(config.server.steps_per_trajectory_frame, simulation.end, tolerance);
+            for (auto const& step : simulation.steps) {
+                playback.SetStep(simulation, step);
+                compressor.OnStep(playback);
+            }
+            playback.SetLast(simulation);
+            compressor.End(playback);
+        }
+    });
+}
+
+/// \brief 記録した軌跡のランダムなフレームへのシークを繰り返す
+///
+/// \param context 計測器
+/// \param full_keyframe_interval フルキーフレームの間隔
+void SeekFrames(BenchmarkContext & context, size_t full_keyframe_interval)
+{
+    auto const config = CreateSampleConfig();
+    auto const trajectories = RecordTrajectories(config, RecordShots(config));
+    std::vector<TrajectoryDecoder> decoders;
+    decoders.reserve(trajectories.size());
+    for (auto const& trajectory : trajectories) {
+        decoders.emplace_back(trajectory, full_keyframe_interval);
+    }
+    std::mt19937 random(0);
+
+    context.Run([&](std::uint64_t iterations) {
+        for (std::uint64_t i = 0; i < iterations; ++i) {
+            auto & decoder = decoders[i % decoders.size()];
+            auto const frame = static_cast<std::ptrdiff_t>(random() % (decoder.GetFrameCount() + 1)) - 1;
+            decoder.SeekFrame(frame);
+        }
+    });
+}
+
+} // unnamed namespace
+
+void RegisterTrajectoryBenchmarks(BenchmarkRunner & runner)
+{
+    runner.Add("apply_move/baseline", [](BenchmarkContext & context) {
+        SimulateShots(context);
+    });
+
+    runner.Add("trajectory_compressor/lossless", [](BenchmarkContext & context) {
+        CompressShots(context, TrajectoryCompressor::Tolerance{ 0.f, 0.f });
+    });
+
+    runner.Add("trajectory_compressor/lossy", [](BenchmarkContext & context) {
+        CompressShots(context, TrajectoryCompressor::Tolerance{ 0.001f, 0.001f });
+    });
+
+    runner.Add("trajectory_decoder/seek", [](BenchmarkContext & context) {
+        SeekFrames(context, TrajectoryDecoder::kDefaultFullKeyframeInterval);
+    });
+
+    runner.Add("trajectory_decoder/seek_without_keyframes", [](BenchmarkContext & context) {
+        SeekFrames(context, 0);
+    });
+}
+
+} // namespace digitalcurling3_server::bench
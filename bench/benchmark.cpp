@@ -0,0 +1,165 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace digitalcurling3_server::bench {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::uint64_t kMaxIterations = 1000000000;
+
+std::chrono::nanoseconds Measure(std::function<void(std::uint64_t)> const& body, std::uint64_t iterations)
+{
+    auto const start = Clock::now();
+    body(iterations);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+}
+
+} // unnamed namespace
+
+double BenchmarkResult::GetMedian() const
+{
+    assert(!ns_per_op.empty());
+    auto sorted = ns_per_op;
+    std::sort(sorted.begin(), sorted.end());
+    auto const n = sorted.size();
+    return n % 2 == 1 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+}
+
+double BenchmarkResult::GetMin() const
+{
+    return *std::min_element(ns_per_op.begin(), ns_per_op.end());
+}
+
+double BenchmarkResult::GetMax() const
+{
+    return *std::max_element(ns_per_op.begin(), ns_per_op.end());
+}
+
+void to_json(nlohmann::json & j, BenchmarkResult const& result)
+{
+    j = nlohmann::json{
+        { "name", result.name },
+        { "iterations", result.iterations },
+        { "ns_per_op", {
+            { "median", result.GetMedian() },
+            { "min", result.GetMin() },
+            { "max", result.GetMax() },
+            { "samples", result.ns_per_op },
+        }},
+    };
+    if (result.bytes_per_op > 0) {
+        j["bytes_per_op"] = result.bytes_per_op;
+        j["bytes_per_second"] = static_cast<double>(result.bytes_per_op) * 1e9 / result.GetMedian();
+    }
+}
+
+
+BenchmarkContext::BenchmarkContext(std::string const& name, std::chrono::nanoseconds min_time, size_t repetitions)
+    : min_time_(min_time)
+    , repetitions_(repetitions)
+    , result_{ name, 0, {}, 0 }
+    , ran_(false)
+{}
+
+void BenchmarkContext::Run(std::function<void(std::uint64_t iterations)> const& body)
+{
+    if (ran_) {
+        throw std::logic_error("BenchmarkContext::Run() must be called only once");
+    }
+    ran_ = true;
+
+    // 繰り返し回数を決める(初回の呼び出しはウォームアップを兼ねる)
+    std::uint64_t iterations = 1;
+    while (true) {
+        auto const elapsed = Measure(body, iterations);
+        if (elapsed >= min_time_ || iterations >= kMaxIterations) {
+            break;
+        }
+        if (elapsed * 10 >= min_time_) {
+            // 目標の時間に比例させ，少し多めにする
+            auto const scale = static_cast<double>(min_time_.count()) / static_cast<double>(std::max<std::int64_t>(elapsed.count(), 1));
+            iterations = std::min(kMaxIterations,
+                static_cast<std::uint64_t>(static_cast<double>(iterations) * scale * 1.2) + 1);
+            break;
+        }
+        iterations *= 10;
+    }
+
+    result_.iterations = iterations;
+    for (size_t i = 0; i < repetitions_; ++i) {
+        auto const elapsed = Measure(body, iterations);
+        result_.ns_per_op.push_back(static_cast<double>(elapsed.count()) / static_cast<double>(iterations));
+    }
+}
+
+
+BenchmarkRunner::BenchmarkRunner(std::chrono::nanoseconds min_time, size_t repetitions)
+    : min_time_(min_time)
+    , repetitions_(repetitions)
+    , entries_()
+{
+    if (repetitions_ == 0) {
+        throw std::invalid_argument("repetitions must be 1 or more");
+    }
+}
+
+void BenchmarkRunner::Add(std::string const& name, Function && function)
+{
+    entries_.push_back({ name, std::move(function) });
+}
+
+std::vector<std::string> BenchmarkRunner::GetNames() const
+{
+    std::vector<std::string> names;
+    for (auto const& entry : entries_) {
+        names.push_back(entry.name);
+    }
+    return names;
+}
+
+std::vector<BenchmarkResult> BenchmarkRunner::Run(std::string const& filter) const
+{
+    std::vector<BenchmarkResult> results;
+    for (auto const& entry : entries_) {
+        if (!filter.empty() && entry.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        BenchmarkContext context(entry.name, min_time_, repetitions_);
+        entry.function(context);
+        if (!context.ran_) {
+            throw std::logic_error("benchmark \"" + entry.name + "\" did not call BenchmarkContext::Run()");
+        }
+        results.push_back(std::move(context.result_));
+    }
+    return results;
+}
+
+} // namespace digitalcurling3_server::bench
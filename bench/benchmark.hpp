@@ -0,0 +1,126 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_BENCH_BENCHMARK_HPP
+#define DIGITALCURLING3_SERVER_BENCH_BENCHMARK_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "nlohmann/json.hpp"
+
+namespace digitalcurling3_server::bench {
+
+/// \brief 1つのベンチマークの計測結果
+struct BenchmarkResult {
+    std::string name;
+    std::uint64_t iterations;        ///< 1回の計測での繰り返し回数
+    std::vector<double> ns_per_op;   ///< 計測ごとの1回あたりの時間[ns]
+    std::uint64_t bytes_per_op;      ///< 1回あたりに処理したバイト数(0の場合は出力しない)
+
+    double GetMedian() const;
+    double GetMin() const;
+    double GetMax() const;
+};
+
+void to_json(nlohmann::json & j, BenchmarkResult const& result);
+
+
+/// \brief ベンチマークの関数に渡される計測器
+///
+/// ベンチマークの関数は準備を済ませた後に Run() を1度だけ呼び出す．
+/// Run() の外で行った処理は計測に含まれない．
+class BenchmarkContext {
+public:
+    /// \brief 1回あたりに処理するバイト数を設定する(スループットの表示用)
+    void SetBytesPerOp(std::uint64_t bytes) { result_.bytes_per_op = bytes; }
+
+    /// \brief 計測する
+    ///
+    /// 1回の計測が min_time 以上になるよう繰り返し回数を決めてから， repetitions 回計測する．
+    ///
+    /// \param body 指定された回数だけ処理を繰り返す関数
+    void Run(std::function<void(std::uint64_t iterations)> const& body);
+
+private:
+    friend class BenchmarkRunner;
+    BenchmarkContext(std::string const& name, std::chrono::nanoseconds min_time, size_t repetitions);
+
+    std::chrono::nanoseconds const min_time_;
+    size_t const repetitions_;
+    BenchmarkResult result_;
+    bool ran_;
+};
+
+
+/// \brief ベンチマークを登録し，実行する
+class BenchmarkRunner {
+public:
+    using Function = std::function<void(BenchmarkContext &)>;
+
+    /// \param min_time 1回の計測の最小時間
+    /// \param repetitions 計測の回数
+    BenchmarkRunner(std::chrono::nanoseconds min_time, size_t repetitions);
+
+    /// \brief ベンチマークを登録する
+    ///
+    /// \param name 名前(<対象>/<条件> の形式)
+    /// \param function ベンチマークの関数
+    void Add(std::string const& name, Function && function);
+
+    /// \brief 名前に filter を含むベンチマークを登録順に実行する
+    ///
+    /// \param filter 実行するベンチマークの名前に含まれる文字列(空文字列の場合は全て)
+    /// \return 計測結果
+    std::vector<BenchmarkResult> Run(std::string const& filter) const;
+
+    /// \brief 登録されたベンチマークの名前を登録順に得る
+    std::vector<std::string> GetNames() const;
+
+    std::chrono::nanoseconds GetMinTime() const { return min_time_; }
+    size_t GetRepetitions() const { return repetitions_; }
+
+private:
+    struct Entry {
+        std::string name;
+        Function function;
+    };
+
+    std::chrono::nanoseconds const min_time_;
+    size_t const repetitions_;
+    std::vector<Entry> entries_;
+};
+
+
+// 各ベンチマークの登録
+
+void RegisterTrajectoryBenchmarks(BenchmarkRunner & runner);
+void RegisterMessageBenchmarks(BenchmarkRunner & runner);
+void RegisterConfigBenchmarks(BenchmarkRunner & runner);
+void RegisterLogBenchmarks(BenchmarkRunner & runner);
+void RegisterTCPSessionBenchmarks(BenchmarkRunner & runner);
+
+} // namespace digitalcurling3_server::bench
+
+#endif // DIGITALCURLING3_SERVER_BENCH_BENCHMARK_HPP
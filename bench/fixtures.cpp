@@ -0,0 +1,177 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "fixtures.hpp"
+
+#include <array>
+#include <sstream>
+#include <string>
+
+namespace digitalcurling3_server::bench {
+
+namespace dc = digitalcurling3;
+
+namespace {
+
+using namespace std::string_view_literals;
+
+constexpr auto kSampleConfigText = R"({
+    "server": {
+        "port": { "team0": 10000, "team1": 10001 },
+        "timeout_dc_ok": 10.0,
+        "update_interval": 0.0,
+        "send_trajectory": true,
+        "steps_per_trajectory_frame": 10
+    },
+    "game": {
+        "rule": "normal",
+        "setting": {
+            "max_end": 10,
+            "sheet_width": 4.75,
+            "five_rock_rule": true,
+            "thinking_time": { "team0": 2700.0, "team1": 2700.0 },
+            "extra_end_thinking_time": { "team0": 270.0, "team1": 270.0 }
+        },
+        "simulator": { "type": "fcv1", "seconds_per_frame": 0.001 },
+        "players": {
+            "team0": [ { "type": "identical" }, { "type": "identical" }, { "type": "identical" }, { "type": "identical" } ],
+            "team1": [ { "type": "identical" }, { "type": "identical" }, { "type": "identical" }, { "type": "identical" } ]
+        }
+    }
+})"sv;
+
+// ドロー，ガード，テイクアウトを混ぜた1エンド分のショット
+struct ShotParameter {
+    float vx;
+    float vy;
+    dc::moves::Shot::Rotation rotation;
+};
+
+constexpr std::array<ShotParameter, 16> kShotParameters{{
+    {  0.132f, 2.39f, dc::moves::Shot::Rotation::kCW },
+    { -0.132f, 2.39f, dc::moves::Shot::Rotation::kCCW },
+    {  0.100f, 2.25f, dc::moves::Shot::Rotation::kCW },
+    { -0.050f, 2.42f, dc::moves::Shot::Rotation::kCCW },
+    {  0.120f, 3.20f, dc::moves::Shot::Rotation::kCW },
+    { -0.140f, 2.36f, dc::moves::Shot::Rotation::kCCW },
+    {  0.080f, 2.30f, dc::moves::Shot::Rotation::kCW },
+    { -0.110f, 3.50f, dc::moves::Shot::Rotation::kCCW },
+    {  0.150f, 2.41f, dc::moves::Shot::Rotation::kCW },
+    { -0.090f, 2.28f, dc::moves::Shot::Rotation::kCCW },
+    {  0.132f, 3.00f, dc::moves::Shot::Rotation::kCW },
+    { -0.132f, 2.38f, dc::moves::Shot::Rotation::kCCW },
+    {  0.060f, 2.44f, dc::moves::Shot::Rotation::kCW },
+    { -0.070f, 3.80f, dc::moves::Shot::Rotation::kCCW },
+    {  0.110f, 2.37f, dc::moves::Shot::Rotation::kCW },
+    { -0.120f, 2.40f, dc::moves::Shot::Rotation::kCCW },
+}};
+
+boost::filesystem::path g_output_directory;
+size_t g_game_log_count = 0;
+
+} // unnamed namespace
+
+std::string_view GetSampleConfigText()
+{
+    return kSampleConfigText;
+}
+
+Config CreateSampleConfig()
+{
+    return nlohmann::json::parse(kSampleConfigText).get<Config>();
+}
+
+std::vector<RecordedShot> RecordShots(Config const& config)
+{
+    auto const simulator = config.game.simulator->CreateSimulator();
+    auto const player = config.game.players[0].front()->CreatePlayer();
+    dc::GameState state(config.game.setting);
+
+    std::vector<RecordedShot> shots;
+    for (auto const& parameter : kShotParameters) {
+        dc::moves::Shot shot;
+        shot.velocity = dc::Vector2(parameter.vx, parameter.vy);
+        shot.rotation = parameter.rotation;
+        shots.push_back({ state, shot });
+
+        dc::Move move = shot;
+        dc::ApplyMoveResult result;
+        dc::ApplyMove(config.game.setting, *simulator, *player, state, move, std::chrono::milliseconds(0), &result,
+            [](dc::ISimulator const&) {});
+    }
+    return shots;
+}
+
+std::vector<RecordedSimulation> RecordSimulations(Config const& config, std::vector<RecordedShot> const& shots)
+{
+    auto const simulator = config.game.simulator->CreateSimulator();
+    auto const player = config.game.players[0].front()->CreatePlayer();
+
+    std::vector<RecordedSimulation> simulations;
+    for (auto const& shot : shots) {
+        auto state = shot.state;
+        auto move = shot.move;
+        RecordedSimulation simulation;
+        simulation.end = state.end;
+        simulation.seconds_per_frame = simulator->GetSecondsPerFrame();
+        dc::ApplyMoveResult result;
+        dc::ApplyMove(config.game.setting, *simulator, *player, state, move, std::chrono::milliseconds(0), &result,
+            [&simulation](dc::ISimulator const& s) { simulation.steps.push_back({ s.GetStones(), s.AreAllStonesStopped() }); });
+        simulation.last_stones = simulator->GetStones();
+        simulations.push_back(std::move(simulation));
+    }
+    return simulations;
+}
+
+std::vector<TrajectoryCompressor::Result> RecordTrajectories(Config const& config, std::vector<RecordedShot> const& shots)
+{
+    auto const simulator = config.game.simulator->CreateSimulator();
+    auto const player = config.game.players[0].front()->CreatePlayer();
+    TrajectoryCompressor compressor;
+
+    std::vector<TrajectoryCompressor::Result> trajectories;
+    for (auto const& shot : shots) {
+        auto state = shot.state;
+        auto move = shot.move;
+        compressor.Begin(config.server.steps_per_trajectory_frame, state.end, config.server.trajectory_tolerance);
+        dc::ApplyMoveResult result;
+        dc::ApplyMove(config.game.setting, *simulator, *player, state, move, std::chrono::milliseconds(0), &result,
+            [&compressor](dc::ISimulator const& s) { compressor.OnStep(s); });
+        compressor.End(*simulator);
+        trajectories.push_back(compressor.GetResult());
+    }
+    return trajectories;
+}
+
+void SetOutputDirectory(boost::filesystem::path const& directory)
+{
+    g_output_directory = directory;
+}
+
+boost::filesystem::path GetNewGameLogDirectory(std::string_view name)
+{
+    std::ostringstream buf;
+    buf << name << '_' << g_game_log_count++;
+    return g_output_directory / buf.str();
+}
+
+} // namespace digitalcurling3_server::bench
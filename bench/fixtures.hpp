@@ -0,0 +1,97 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_BENCH_FIXTURES_HPP
+#define DIGITALCURLING3_SERVER_BENCH_FIXTURES_HPP
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "config.hpp"
+#include "trajectory_compressor.hpp"
+
+namespace digitalcurling3_server::bench {
+
+/// \brief ベンチマークで使うコンフィグのJSON
+///
+/// 結果を再現できるよう，プレイヤーは乱数を使わない "identical" とする．
+std::string_view GetSampleConfigText();
+
+/// \brief GetSampleConfigText() をパースしたコンフィグ
+Config CreateSampleConfig();
+
+/// \brief 記録したショット
+struct RecordedShot {
+    digitalcurling3::GameState state;  ///< ショット直前の試合状態
+    digitalcurling3::Move move;        ///< 投げたショット
+};
+
+/// \brief 決まった手順で1エンド分(16ショット)を投げ，各ショットの直前の状態を記録する
+///
+/// \param config コンフィグ
+/// \return 記録したショット
+std::vector<RecordedShot> RecordShots(Config const& config);
+
+/// \brief ApplyMove() 中にシミュレータから取得したストーンの状態
+struct RecordedStep {
+    digitalcurling3::ISimulator::AllStoneData stones;  ///< ストーンの状態
+    bool all_stones_stopped;                            ///< すべてのストーンが停止しているか
+};
+
+/// \brief 1ショット分のシミュレーションの記録
+///
+/// シミュレーションを含まずに TrajectoryCompressor の処理時間を計測するために使う．
+struct RecordedSimulation {
+    std::uint8_t end;                                        ///< ショットのエンド
+    float seconds_per_frame;                                 ///< シミュレータの1ステップの秒数
+    std::vector<RecordedStep> steps;                         ///< ステップごとの状態
+    digitalcurling3::ISimulator::AllStoneData last_stones;   ///< ApplyMove() 終了後のストーンの状態
+};
+
+/// \brief 記録したショットを再生し，各ステップのストーンの状態を記録する
+///
+/// \param config コンフィグ
+/// \param shots 記録したショット
+/// \return ショットごとのシミュレーションの記録
+std::vector<RecordedSimulation> RecordSimulations(Config const& config, std::vector<RecordedShot> const& shots);
+
+/// \brief 記録したショットを再生し，軌跡を圧縮する
+///
+/// \param config コンフィグ( steps_per_trajectory_frame と trajectory_tolerance を使う)
+/// \param shots 記録したショット
+/// \return ショットごとの軌跡
+std::vector<TrajectoryCompressor::Result> RecordTrajectories(Config const& config, std::vector<RecordedShot> const& shots);
+
+/// \brief ベンチマークの出力先のディレクトリを設定する
+void SetOutputDirectory(boost::filesystem::path const& directory);
+
+/// \brief 試合ログ用の新しいディレクトリのパスを得る(ディレクトリは作成しない)
+///
+/// \param name ディレクトリ名の接頭辞
+/// \return 出力先のディレクトリ以下の，まだ使われていないパス
+boost::filesystem::path GetNewGameLogDirectory(std::string_view name);
+
+} // namespace digitalcurling3_server::bench
+
+#endif // DIGITALCURLING3_SERVER_BENCH_FIXTURES_HPP
@@ -0,0 +1,159 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+
+#include <boost/program_options.hpp>
+#include <boost/nowide/args.hpp>
+#include <boost/nowide/fstream.hpp>
+#include <boost/nowide/filesystem.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "benchmark.hpp"
+#include "fixtures.hpp"
+#include "log.hpp"
+#include "util.hpp"
+#include "version.hpp"
+
+namespace dcs = digitalcurling3_server;
+namespace bench = digitalcurling3_server::bench;
+
+namespace {
+
+void PrintTable(std::ostream & os, std::vector<bench::BenchmarkResult> const& results)
+{
+    os << std::left << std::setw(40) << "benchmark"
+        << std::right << std::setw(14) << "median ns/op"
+        << std::setw(14) << "min ns/op"
+        << std::setw(14) << "max ns/op"
+        << std::setw(14) << "MB/s"
+        << std::setw(12) << "iterations" << '\n';
+    for (auto const& result : results) {
+        os << std::left << std::setw(40) << result.name
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(14) << result.GetMedian()
+            << std::setw(14) << result.GetMin()
+            << std::setw(14) << result.GetMax();
+        if (result.bytes_per_op > 0) {
+            os << std::setw(14) << static_cast<double>(result.bytes_per_op) * 1e3 / result.GetMedian();
+        } else {
+            os << std::setw(14) << '-';
+        }
+        os << std::setw(12) << result.iterations << '\n';
+    }
+}
+
+} // unnamed namespace
+
+int main(int argc, char* argv[])
+{
+    boost::nowide::args nowide_args(argc, argv);
+    boost::nowide::nowide_filesystem();
+
+    std::optional<dcs::Log> log_instance;
+
+    try {
+        boost::program_options::options_description opt_desc("Allowed options");
+        opt_desc.add_options()
+            ("help,h", "produce help message")
+            ("filter", boost::program_options::value<std::string>()->default_value(""), "run only the benchmarks whose names contain the specified string")
+            ("list", "list the benchmarks and exit")
+            ("min-time", boost::program_options::value<unsigned int>()->default_value(200), "minimum time of a measurement in milliseconds")
+            ("repetitions", boost::program_options::value<size_t>()->default_value(5), "number of measurements of each benchmark")
+            ("json", boost::program_options::value<std::string>(), "write the results in json to the specified file")
+            ("out-dir", boost::program_options::value<std::string>(), "directory for the logs written by the benchmarks (default: a new temporary directory)")
+            ("log-async", "write logs on a dedicated writer thread")
+            ;
+
+        boost::program_options::variables_map vm;
+        boost::program_options::store(boost::program_options::parse_command_line(argc, argv, opt_desc), vm);
+        boost::program_options::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << opt_desc << std::endl;
+            return 0;
+        }
+
+        bench::BenchmarkRunner runner(
+            std::chrono::milliseconds(vm["min-time"].as<unsigned int>()),
+            vm["repetitions"].as<size_t>());
+        bench::RegisterTrajectoryBenchmarks(runner);
+        bench::RegisterMessageBenchmarks(runner);
+        bench::RegisterConfigBenchmarks(runner);
+        bench::RegisterLogBenchmarks(runner);
+        bench::RegisterTCPSessionBenchmarks(runner);
+
+        if (vm.count("list")) {
+            for (auto const& name : runner.GetNames()) {
+                std::cout << name << '\n';
+            }
+            return 0;
+        }
+
+        boost::filesystem::path const out_directory = vm.count("out-dir")
+            ? boost::filesystem::absolute(vm["out-dir"].as<std::string>())
+            : boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("digitalcurling3_server_bench_%%%%-%%%%-%%%%");
+        boost::filesystem::create_directories(out_directory);
+        bench::SetOutputDirectory(out_directory);
+
+        // 試合ログとショットログの出力に必要．試合の進行状況は標準出力に出るため，結果は最後にまとめて出力する．
+        dcs::Log::Options log_options;
+        log_options.async = vm.count("log-async");
+        log_instance.emplace(out_directory / "server.log", false, false, log_options);
+
+        auto const launch_time = boost::posix_time::second_clock::local_time();
+        auto const results = runner.Run(vm["filter"].as<std::string>());
+
+        std::cout << "\n";
+        PrintTable(std::cout, results);
+        std::cout << "\nlogs: \"" << out_directory.string() << "\"" << std::endl;
+
+        if (vm.count("json")) {
+            nlohmann::json const j{
+                { "context", {
+                    { "server_version", dcs::GetVersion() },
+                    { "date_time", dcs::GetISO8601ExtendedString(launch_time) },
+                    { "min_time_ms", vm["min-time"].as<unsigned int>() },
+                    { "repetitions", runner.GetRepetitions() },
+                    { "log_async", log_options.async },
+                }},
+                { "benchmarks", results },
+            };
+
+            boost::nowide::ofstream file(boost::filesystem::path(vm["json"].as<std::string>()));
+            if (!file) {
+                throw std::runtime_error("could not open the json output file");
+            }
+            file << j.dump(2) << std::endl;
+        }
+
+    } catch (std::exception & e) {
+        std::cerr << "exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
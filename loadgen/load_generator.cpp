@@ -0,0 +1,483 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "load_generator.hpp"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "server.hpp"
+#include "version.hpp"
+
+namespace digitalcurling3_server::loadgen {
+
+namespace dc = digitalcurling3;
+using boost::asio::ip::tcp;
+using nlohmann::json;
+
+namespace {
+
+using Strand = boost::asio::strand<boost::asio::io_context::executor_type>;
+using Clock = std::chrono::steady_clock;
+
+/// \brief 全ての組で共有する状態
+struct Shared {
+    LoadOptions const& options;
+    std::array<tcp::endpoint, 2> endpoints;
+
+    std::mutex mutex;
+    LoadReport report;  // 組ごとの結果を組の終了時に加える
+
+    // 途中経過の表示用
+    std::atomic<std::uint64_t> shots{ 0 };
+    std::atomic<std::uint64_t> games_finished{ 0 };
+    std::atomic<std::uint64_t> games_failed{ 0 };
+    std::atomic<size_t> running_pairs{ 0 };
+
+    std::function<void()> on_all_finished;
+
+    explicit Shared(LoadOptions const& options) : options(options) {}
+};
+
+
+/// \brief 対戦するクライアントの組
+///
+/// 2つの接続の処理は組ごとのストランド上で行う．
+/// 試合ごとに接続し直し，試合が終わるか失敗すると接続を閉じて次の試合を始める．
+class Pair : public std::enable_shared_from_this<Pair> {
+public:
+    Pair(boost::asio::io_context & io_context, Shared & shared, size_t index)
+        : shared_(shared)
+        , index_(index)
+        , strand_(boost::asio::make_strand(io_context))
+        , start_timer_(strand_)
+        , clients_()
+        , random_(shared.options.seed + index)
+        , game_count_(0)
+        , shots_in_game_(0)
+        , generation_(0)
+        , match_id_()
+        , report_()
+    {}
+
+    void Start(std::chrono::milliseconds delay)
+    {
+        start_timer_.expires_after(delay);
+        start_timer_.async_wait([self = shared_from_this()](boost::system::error_code const& error)
+        {
+            if (error) return;
+            self->StartGame();
+        });
+    }
+
+private:
+    struct Client {
+        tcp::socket socket;
+        std::string input_buffer;
+        std::deque<std::string> output_queue;
+        boost::asio::steady_timer think_timer;
+        std::optional<Clock::time_point> move_sent_time;  // 更新メッセージの待ち中のみ値を持つ
+        bool game_over;
+
+        explicit Client(Strand const& strand)
+            : socket(strand), input_buffer(), output_queue(), think_timer(strand), move_sent_time(), game_over(false) {}
+    };
+
+    Shared & shared_;
+    size_t const index_;
+    Strand strand_;
+    boost::asio::steady_timer start_timer_;
+    // ハンドラは shared_ptr で Client を保持するため，試合の終了後に破棄しても問題ない
+    std::array<std::shared_ptr<Client>, 2> clients_;
+    std::mt19937_64 random_;
+    size_t game_count_;
+    size_t shots_in_game_;
+    size_t generation_;  // 試合ごとに増やし，終わった試合のハンドラを無視する
+    std::string match_id_;
+    LoadReport report_;
+
+    void StartGame()
+    {
+        ++game_count_;
+        ++generation_;
+        shots_in_game_ = 0;
+        {
+            std::ostringstream buf;
+            buf << "loadgen-" << index_ << '-' << game_count_ << '-' << boost::uuids::random_generator()();
+            match_id_ = buf.str();
+        }
+
+        for (size_t team = 0; team < clients_.size(); ++team) {
+            auto client = std::make_shared<Client>(strand_);
+            clients_[team] = client;
+            client->socket.async_connect(shared_.endpoints[team],
+                boost::asio::bind_executor(strand_,
+                    [self = shared_from_this(), client, team, generation = generation_](boost::system::error_code const& error)
+                    {
+                        if (generation != self->generation_) return;
+                        if (error) {
+                            ++self->report_.connect_failures;
+                            self->EndGame(false);
+                            return;
+                        }
+                        boost::system::error_code ignored_error;
+                        client->socket.set_option(tcp::no_delay(true), ignored_error);
+                        self->ReadLine(team);
+                    }));
+        }
+    }
+
+    void ReadLine(size_t team)
+    {
+        auto const& client = clients_[team];
+        boost::asio::async_read_until(client->socket,
+            boost::asio::dynamic_buffer(client->input_buffer, shared_.options.max_line_length + 1), '\n',
+            boost::asio::bind_executor(strand_,
+                [self = shared_from_this(), client, team, generation = generation_](boost::system::error_code const& error, std::size_t n)
+                {
+                    if (generation != self->generation_) return;
+                    if (error) {
+                        if (error == boost::asio::error::not_found) {
+                            ++self->report_.protocol_errors;
+                        } else {
+                            ++self->report_.disconnects;
+                        }
+                        self->EndGame(false);
+                        return;
+                    }
+
+                    std::string const line = client->input_buffer.substr(0, n - 1);
+                    client->input_buffer.erase(0, n);
+                    try {
+                        self->HandleMessage(team, line);
+                    } catch (std::exception &) {
+                        ++self->report_.protocol_errors;
+                        self->EndGame(false);
+                        return;
+                    }
+
+                    if (generation == self->generation_ && !client->game_over) {
+                        self->ReadLine(team);
+                    }
+                }));
+    }
+
+    void HandleMessage(size_t team, std::string const& line)
+    {
+        auto & client = *clients_[team];
+        auto const jin = json::parse(line);
+        auto const cmd = jin.at("cmd").get<std::string>();
+
+        if (cmd == "dc") {
+            if (jin.at("version").at("major").get<std::uint32_t>() != GetProtocolVersionMajor()) {
+                throw std::runtime_error("protocol version mismatch");
+            }
+            json const jout{
+                { "cmd", "dc_ok" },
+                { "match_id", match_id_ },
+                { "name", "loadgen" },
+            };
+            Send(team, jout.dump());
+        } else if (cmd == "is_ready") {
+            auto const player_count = jin.at("game").at("players").at(dc::ToString(static_cast<dc::Team>(team))).size();
+            json jout{
+                { "cmd", "ready_ok" },
+                { "player_order", json::array() },
+            };
+            for (size_t i = 0; i < player_count; ++i) {
+                jout["player_order"].push_back(i);
+            }
+            Send(team, jout.dump());
+        } else if (cmd == "update") {
+            if (client.move_sent_time) {
+                auto const round_trip = Clock::now() - *client.move_sent_time;
+                client.move_sent_time.reset();
+                report_.round_trip.Record(round_trip);
+                ++report_.shots;
+                shared_.shots.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            auto const& next_team = jin.at("next_team");
+            if (next_team.is_string() && next_team.get<std::string>() == dc::ToString(static_cast<dc::Team>(team))) {
+                ScheduleMove(team);
+            }
+        } else if (cmd == "game_over") {
+            client.game_over = true;
+            if (clients_[0]->game_over && clients_[1]->game_over) {
+                EndGame(true);
+            }
+        }
+        // new_game と未知のコマンドは無視する
+    }
+
+    void ScheduleMove(size_t team)
+    {
+        auto const& client = clients_[team];
+        client->think_timer.expires_after(SampleThinkTime());
+        client->think_timer.async_wait(
+            [self = shared_from_this(), team, generation = generation_](boost::system::error_code const& error)
+            {
+                if (error || generation != self->generation_) return;
+                self->SendMove(team);
+            });
+    }
+
+    void SendMove(size_t team)
+    {
+        dc::Move move;
+        if (shared_.options.shots_per_game > 0 && shots_in_game_ >= shared_.options.shots_per_game) {
+            move = dc::moves::Concede();
+        } else {
+            move = SampleShot();
+        }
+        ++shots_in_game_;
+
+        json const jout{
+            { "cmd", "move" },
+            { "move", move },
+        };
+        clients_[team]->move_sent_time = Clock::now();
+        Send(team, jout.dump());
+    }
+
+    void Send(size_t team, std::string && text)
+    {
+        auto const& client = clients_[team];
+        text += '\n';
+        client->output_queue.emplace_back(std::move(text));
+        if (client->output_queue.size() == 1) {
+            Write(team);
+        }
+    }
+
+    void Write(size_t team)
+    {
+        auto const& client = clients_[team];
+        boost::asio::async_write(client->socket,
+            boost::asio::buffer(client->output_queue.front()),
+            boost::asio::bind_executor(strand_,
+                [self = shared_from_this(), client, team, generation = generation_](boost::system::error_code const& error, std::size_t /* n */)
+                {
+                    if (generation != self->generation_) return;
+                    if (error) {
+                        ++self->report_.disconnects;
+                        self->EndGame(false);
+                        return;
+                    }
+                    client->output_queue.pop_front();
+                    if (!client->output_queue.empty()) {
+                        self->Write(team);
+                    }
+                }));
+    }
+
+    void EndGame(bool finished)
+    {
+        ++generation_;
+        for (auto & client : clients_) {
+            boost::system::error_code ignored_error;
+            client->socket.close(ignored_error);
+            client->think_timer.cancel();
+            client.reset();
+        }
+
+        if (finished) {
+            ++report_.games_finished;
+            shared_.games_finished.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            ++report_.games_failed;
+            shared_.games_failed.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (game_count_ < shared_.options.games_per_pair) {
+            boost::asio::post(strand_, [self = shared_from_this()] { self->StartGame(); });
+            return;
+        }
+
+        {
+            std::lock_guard g(shared_.mutex);
+            shared_.report.Merge(report_);
+        }
+        if (shared_.running_pairs.fetch_sub(1) == 1) {
+            shared_.on_all_finished();
+        }
+    }
+
+    std::chrono::milliseconds SampleThinkTime()
+    {
+        auto const mean = static_cast<double>(shared_.options.think_time.count());
+        double value = mean;
+        switch (shared_.options.think_time_distribution) {
+            case ThinkTimeDistribution::kFixed:
+                break;
+            case ThinkTimeDistribution::kUniform:
+                value = std::uniform_real_distribution<double>(0.0, 2.0 * mean)(random_);
+                break;
+            case ThinkTimeDistribution::kExponential:
+                value = mean > 0.0 ? std::exponential_distribution<double>(1.0 / mean)(random_) : 0.0;
+                break;
+        }
+        return std::chrono::milliseconds(static_cast<std::int64_t>(value));
+    }
+
+    dc::moves::Shot SampleShot()
+    {
+        dc::moves::Shot shot;
+        switch (shared_.options.move_distribution) {
+            case MoveDistribution::kDraw: {
+                // 左右どちらかから曲げてティーに止める
+                bool const from_right = std::bernoulli_distribution(0.5)(random_);
+                std::normal_distribution<float> noise_x(0.f, 0.01f);
+                std::normal_distribution<float> noise_y(0.f, 0.02f);
+                shot.velocity = dc::Vector2((from_right ? 0.132f : -0.132f) + noise_x(random_), 2.39f + noise_y(random_));
+                shot.rotation = from_right ? dc::moves::Shot::Rotation::kCW : dc::moves::Shot::Rotation::kCCW;
+                break;
+            }
+            case MoveDistribution::kRandom: {
+                shot.velocity = dc::Vector2(
+                    std::uniform_real_distribution<float>(-0.25f, 0.25f)(random_),
+                    std::uniform_real_distribution<float>(2.2f, 4.0f)(random_));
+                shot.rotation = std::bernoulli_distribution(0.5)(random_) ? dc::moves::Shot::Rotation::kCW : dc::moves::Shot::Rotation::kCCW;
+                break;
+            }
+            case MoveDistribution::kWeak:
+                shot.velocity = dc::Vector2(0.f, 0.5f);
+                shot.rotation = dc::moves::Shot::Rotation::kCCW;
+                break;
+        }
+        return shot;
+    }
+};
+
+} // unnamed namespace
+
+
+void LoadReport::Merge(LoadReport const& other)
+{
+    round_trip.Merge(other.round_trip);
+    shots += other.shots;
+    games_finished += other.games_finished;
+    games_failed += other.games_failed;
+    connect_failures += other.connect_failures;
+    disconnects += other.disconnects;
+    protocol_errors += other.protocol_errors;
+}
+
+void to_json(nlohmann::json & j, LoadReport const& report)
+{
+    auto const elapsed_seconds = std::chrono::duration<double>(report.elapsed).count();
+    j = nlohmann::json{
+        { "elapsed_seconds", elapsed_seconds },
+        { "shots", report.shots },
+        { "shots_per_second", elapsed_seconds > 0.0 ? static_cast<double>(report.shots) / elapsed_seconds : 0.0 },
+        { "round_trip", report.round_trip },  // マイクロ秒
+        { "games_finished", report.games_finished },
+        { "games_failed", report.games_failed },
+        { "failures", {
+            { "connect", report.connect_failures },
+            { "disconnect", report.disconnects },
+            { "protocol", report.protocol_errors },
+        }},
+    };
+}
+
+LoadReport RunLoad(LoadOptions const& options, size_t thread_count)
+{
+    boost::asio::io_context io_context(static_cast<int>(thread_count));
+
+    Shared shared(options);
+    {
+        tcp::resolver resolver(io_context);
+        for (size_t i = 0; i < 2; ++i) {
+            auto const results = resolver.resolve(options.address, std::to_string(options.port[i]));
+            shared.endpoints[i] = results.begin()->endpoint();
+        }
+    }
+
+    // 途中経過の表示
+    Strand report_strand = boost::asio::make_strand(io_context);
+    boost::asio::steady_timer report_timer(report_strand);
+    bool report_finished = false;  // report_strand 上でのみアクセスする
+    auto const start_time = Clock::now();
+    std::function<void()> schedule_report = [&] {
+        report_timer.expires_after(options.report_interval);
+        report_timer.async_wait([&](boost::system::error_code const& error)
+        {
+            // cancel() の前に完了したハンドラはエラー無しで呼ばれるため，フラグでも終了を判定する
+            if (error || report_finished) return;
+            auto const elapsed = std::chrono::duration<double>(Clock::now() - start_time).count();
+            auto const shots = shared.shots.load(std::memory_order_relaxed);
+            std::ostringstream buf;
+            buf << '[' << static_cast<std::uint64_t>(elapsed) << "s] shots: " << shots
+                << " (" << static_cast<std::uint64_t>(static_cast<double>(shots) / elapsed) << "/s)"
+                << ", games finished: " << shared.games_finished.load(std::memory_order_relaxed)
+                << ", failed: " << shared.games_failed.load(std::memory_order_relaxed)
+                << ", running pairs: " << shared.running_pairs.load() << '\n';
+            std::cout << buf.str() << std::flush;
+            schedule_report();
+        });
+    };
+
+    shared.on_all_finished = [&] {
+        boost::asio::post(report_strand, [&] {
+            report_finished = true;
+            report_timer.cancel();
+        });
+    };
+
+    shared.running_pairs = options.pairs;
+    for (size_t i = 0; i < options.pairs; ++i) {
+        auto const delay = options.ramp_up * static_cast<std::int64_t>(i) / static_cast<std::int64_t>(options.pairs);
+        std::make_shared<Pair>(io_context, shared, i)->Start(delay);
+    }
+
+    if (options.report_interval.count() > 0 && options.pairs > 0) {
+        boost::asio::post(report_strand, schedule_report);
+    }
+
+    RunIOContext(io_context, thread_count);
+
+    shared.report.elapsed = Clock::now() - start_time;
+    return std::move(shared.report);
+}
+
+} // namespace digitalcurling3_server::loadgen
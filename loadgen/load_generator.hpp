@@ -0,0 +1,106 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_LOADGEN_LOAD_GENERATOR_HPP
+#define DIGITALCURLING3_SERVER_LOADGEN_LOAD_GENERATOR_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "nlohmann/json.hpp"
+#include "timing.hpp"
+
+namespace digitalcurling3_server::loadgen {
+
+/// \brief 思考時間の分布
+enum class ThinkTimeDistribution {
+    kFixed,        ///< 常に LoadOptions::think_time
+    kUniform,      ///< [0, 2 * think_time] の一様分布
+    kExponential,  ///< 平均 think_time の指数分布
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(ThinkTimeDistribution, {
+    {ThinkTimeDistribution::kFixed, "fixed"},
+    {ThinkTimeDistribution::kUniform, "uniform"},
+    {ThinkTimeDistribution::kExponential, "exponential"},
+})
+
+/// \brief 投げるショットの分布
+enum class MoveDistribution {
+    kDraw,    ///< ティー付近へのドローに小さなばらつきを加えたもの
+    kRandom,  ///< ドローからテイクアウトまでの速度と向きを一様に選ぶ
+    kWeak,    ///< ホグラインに届かない弱いショット(シミュレーションの負荷が小さい)
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(MoveDistribution, {
+    {MoveDistribution::kDraw, "draw"},
+    {MoveDistribution::kRandom, "random"},
+    {MoveDistribution::kWeak, "weak"},
+})
+
+/// \brief 負荷の設定
+struct LoadOptions {
+    std::string address;                 ///< 接続先のアドレス
+    std::array<unsigned short, 2> port;  ///< チームごとの接続先のポート(サーバーのコンフィグの server.port)
+    size_t max_line_length;              ///< 受信する1行の最大バイト数
+    size_t pairs;                        ///< 同時に対戦するクライアントの組の数
+    size_t games_per_pair;               ///< 1組が続けて行う試合の数
+    size_t shots_per_game;               ///< この数のショットを投げたらコンシードする(0の場合は試合終了まで投げる)
+    ThinkTimeDistribution think_time_distribution;
+    std::chrono::milliseconds think_time;  ///< 思考時間の平均
+    MoveDistribution move_distribution;
+    std::chrono::milliseconds ramp_up;     ///< 全ての組の接続開始をこの期間に均等に分散させる
+    std::uint64_t seed;                    ///< 乱数のシード(組ごとに seed + 組の番号を使う)
+    std::chrono::seconds report_interval;  ///< 途中経過を表示する間隔(0の場合は表示しない)
+};
+
+/// \brief 負荷の結果
+struct LoadReport {
+    LatencyHistogram round_trip;  ///< moveの送信から更新メッセージの受信まで
+    std::uint64_t shots = 0;            ///< 更新メッセージを受信したショット
+    std::uint64_t games_finished = 0;   ///< game_overを受信した試合
+    std::uint64_t games_failed = 0;     ///< 失敗した試合
+    std::uint64_t connect_failures = 0; ///< 接続に失敗した回数
+    std::uint64_t disconnects = 0;      ///< game_over の前に切断された回数
+    std::uint64_t protocol_errors = 0;  ///< 不正なメッセージを受信した回数
+    std::chrono::nanoseconds elapsed{ 0 };
+
+    /// \brief 他の結果を加える( elapsed 以外)
+    void Merge(LoadReport const& other);
+};
+
+/// \brief {"shots", "shots_per_second", "round_trip", "games_finished", ...} に変換する
+void to_json(nlohmann::json & j, LoadReport const& report);
+
+/// \brief 負荷をかける
+///
+/// 全ての組が全ての試合を終えるまで戻らない．
+///
+/// \param options 負荷の設定
+/// \param thread_count 実行するスレッド数
+/// \return 結果
+LoadReport RunLoad(LoadOptions const& options, size_t thread_count);
+
+} // namespace digitalcurling3_server::loadgen
+
+#endif // DIGITALCURLING3_SERVER_LOADGEN_LOAD_GENERATOR_HPP
@@ -0,0 +1,190 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <boost/program_options.hpp>
+#include <boost/nowide/args.hpp>
+#include <boost/nowide/fstream.hpp>
+#include <boost/nowide/filesystem.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "config.hpp"
+#include "load_generator.hpp"
+#include "util.hpp"
+#include "version.hpp"
+
+namespace dcs = digitalcurling3_server;
+namespace loadgen = digitalcurling3_server::loadgen;
+
+namespace {
+
+void PrintReport(std::ostream & os, loadgen::LoadReport const& report)
+{
+    auto const elapsed = std::chrono::duration<double>(report.elapsed).count();
+    auto const to_ms = [](std::chrono::nanoseconds ns) { return std::chrono::duration<double, std::milli>(ns).count(); };
+    auto const& rtt = report.round_trip;
+
+    os << std::fixed << std::setprecision(3)
+        << "elapsed        : " << elapsed << " s\n"
+        << "shots          : " << report.shots << " (" << std::setprecision(1)
+        << (elapsed > 0.0 ? static_cast<double>(report.shots) / elapsed : 0.0) << " shots/s)\n"
+        << "games finished : " << report.games_finished << '\n'
+        << "games failed   : " << report.games_failed << '\n'
+        << "failures       : connect " << report.connect_failures
+        << ", disconnect " << report.disconnects
+        << ", protocol " << report.protocol_errors << '\n'
+        << std::setprecision(3)
+        << "round trip (ms): min " << to_ms(rtt.GetMin())
+        << ", p50 " << to_ms(rtt.GetPercentile(50.0))
+        << ", p90 " << to_ms(rtt.GetPercentile(90.0))
+        << ", p99 " << to_ms(rtt.GetPercentile(99.0))
+        << ", p99.9 " << to_ms(rtt.GetPercentile(99.9))
+        << ", max " << to_ms(rtt.GetMax()) << '\n';
+}
+
+} // unnamed namespace
+
+int main(int argc, char* argv[])
+{
+    boost::nowide::args nowide_args(argc, argv);
+    boost::nowide::nowide_filesystem();
+
+    try {
+        boost::program_options::options_description opt_desc("Allowed options");
+        opt_desc.add_options()
+            ("help,h", "produce help message")
+            ("config,C", boost::program_options::value<std::string>()->default_value("config.json"), "config json file of the server (used for the ports and the max line length)")
+            ("address", boost::program_options::value<std::string>()->default_value("127.0.0.1"), "address of the server")
+            ("pairs", boost::program_options::value<size_t>()->default_value(1), "number of client pairs playing at the same time")
+            ("games-per-pair", boost::program_options::value<size_t>()->default_value(1), "number of games played by each pair")
+            ("shots-per-game", boost::program_options::value<size_t>()->default_value(0), "concede after this number of shots (0: play until the game is over)")
+            ("think-time", boost::program_options::value<unsigned int>()->default_value(0), "mean think time in milliseconds")
+            ("think-time-dist", boost::program_options::value<std::string>()->default_value("fixed"), "think time distribution (fixed, uniform or exponential)")
+            ("move-dist", boost::program_options::value<std::string>()->default_value("draw"), "move distribution (draw, random or weak)")
+            ("ramp-up", boost::program_options::value<unsigned int>()->default_value(0), "spread the start of the pairs over this period in milliseconds")
+            ("seed", boost::program_options::value<std::uint64_t>()->default_value(0), "random seed")
+            ("threads", boost::program_options::value<size_t>()->default_value(1), "number of worker threads")
+            ("report-interval", boost::program_options::value<unsigned int>()->default_value(5), "print the progress every this number of seconds (0: disabled)")
+            ("json", boost::program_options::value<std::string>(), "write the results in json to the specified file")
+            ;
+
+        boost::program_options::variables_map vm;
+        boost::program_options::store(boost::program_options::parse_command_line(argc, argv, opt_desc), vm);
+        boost::program_options::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << opt_desc << std::endl;
+            return 0;
+        }
+
+        dcs::Config const config = [&] {
+            boost::nowide::ifstream config_file(boost::filesystem::path(vm["config"].as<std::string>()));
+            if (!config_file) {
+                throw std::runtime_error("could not open config file");
+            }
+            return nlohmann::json::parse(config_file, nullptr, true, true).get<dcs::Config>(); // ignore_comment: true
+        }();
+
+        loadgen::LoadOptions options;
+        options.address = vm["address"].as<std::string>();
+        options.port = config.server.port;
+        options.max_line_length = config.server.max_line_length;
+        options.pairs = vm["pairs"].as<size_t>();
+        options.games_per_pair = vm["games-per-pair"].as<size_t>();
+        options.shots_per_game = vm["shots-per-game"].as<size_t>();
+        options.think_time_distribution = nlohmann::json(vm["think-time-dist"].as<std::string>()).get<loadgen::ThinkTimeDistribution>();
+        options.think_time = std::chrono::milliseconds(vm["think-time"].as<unsigned int>());
+        options.move_distribution = nlohmann::json(vm["move-dist"].as<std::string>()).get<loadgen::MoveDistribution>();
+        options.ramp_up = std::chrono::milliseconds(vm["ramp-up"].as<unsigned int>());
+        options.seed = vm["seed"].as<std::uint64_t>();
+        options.report_interval = std::chrono::seconds(vm["report-interval"].as<unsigned int>());
+        size_t const thread_count = vm["threads"].as<size_t>();
+
+        // NLOHMANN_JSON_SERIALIZE_ENUM は未知の文字列を先頭の値に変換するため，書き戻して確かめる
+        if (nlohmann::json(options.think_time_distribution).get<std::string>() != vm["think-time-dist"].as<std::string>()) {
+            throw std::runtime_error("unknown --think-time-dist");
+        }
+        if (nlohmann::json(options.move_distribution).get<std::string>() != vm["move-dist"].as<std::string>()) {
+            throw std::runtime_error("unknown --move-dist");
+        }
+        if (options.pairs == 0) {
+            throw std::runtime_error("--pairs must be 1 or more");
+        }
+        if (thread_count == 0) {
+            throw std::runtime_error("--threads must be 1 or more");
+        }
+        if (options.move_distribution == loadgen::MoveDistribution::kWeak && options.shots_per_game == 0) {
+            // ホグラインに届かないショットでは得点が入らず，エキストラエンドが続く
+            throw std::runtime_error("--move-dist weak requires --shots-per-game");
+        }
+
+        auto const launch_time = boost::posix_time::second_clock::local_time();
+
+        std::cout << "server: " << options.address << " (ports " << options.port[0] << ", " << options.port[1] << ")\n"
+            << "pairs: " << options.pairs << ", games per pair: " << options.games_per_pair << std::endl;
+
+        auto const report = loadgen::RunLoad(options, thread_count);
+
+        std::cout << '\n';
+        PrintReport(std::cout, report);
+
+        if (vm.count("json")) {
+            nlohmann::json const j{
+                { "context", {
+                    { "server_version", dcs::GetVersion() },
+                    { "date_time", dcs::GetISO8601ExtendedString(launch_time) },
+                    { "address", options.address },
+                    { "pairs", options.pairs },
+                    { "games_per_pair", options.games_per_pair },
+                    { "shots_per_game", options.shots_per_game },
+                    { "think_time_ms", options.think_time.count() },
+                    { "think_time_dist", options.think_time_distribution },
+                    { "move_dist", options.move_distribution },
+                    { "ramp_up_ms", options.ramp_up.count() },
+                    { "seed", options.seed },
+                    { "threads", thread_count },
+                }},
+                { "result", report },
+            };
+
+            boost::nowide::ofstream file(boost::filesystem::path(vm["json"].as<std::string>()));
+            if (!file) {
+                throw std::runtime_error("could not open the json output file");
+            }
+            file << j.dump(2) << std::endl;
+        }
+
+        if (report.games_failed > 0) {
+            return 2;
+        }
+
+    } catch (std::exception & e) {
+        std::cerr << "exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,507 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "batch.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <iomanip>
+#include <boost/nowide/fstream.hpp>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+#include "game.hpp"
+#include "game_transport.hpp"
+#include "log.hpp"
+#include "server.hpp"
+#include "util.hpp"
+
+namespace digitalcurling3_server {
+
+namespace dc = digitalcurling3;
+
+/// \brief バッチモードの1試合
+///
+/// TCPSession の代わりに，メッセージを試合のストランドにポストしてエンジンに渡す．
+/// エンジンの応答は TCPSession が受信した場合と同様に Game に渡す．
+/// 応答を待つ間は次のメッセージを渡さず，クライアントごとのキューに溜める．
+class Batch::Match : public GameTransport, public std::enable_shared_from_this<Batch::Match> {
+public:
+    /// \param[in] strand 試合のストランド． engines はこのストランドで作成したもの
+    Match(Batch & batch, size_t index, Config && config, std::string const& date_time, std::string const& game_id,
+        boost::filesystem::path const& game_log_directory, Strand const& strand, std::array<std::unique_ptr<Engine>, 2> && engines)
+        : batch_(batch)
+        , index_(index)
+        , strand_(strand)
+        , engines_(std::move(engines))
+        , queues_()
+        , waiting_{ false, false }
+        , pending_{ 0, 0 }
+        , session_stopped_{ false, false }
+        , finished_(false)
+        , game_(*this, std::move(config), date_time, game_id, game_log_directory, batch.templates_)
+    {}
+
+    void Start()
+    {
+        boost::asio::post(strand_, [this, self = shared_from_this()]
+            {
+                try {
+                    for (size_t i = 0; i < engines_.size(); ++i) {
+                        game_.OnSessionStart(i);
+                    }
+                } catch (std::exception & e) {
+                    HandleError(e);
+                }
+            });
+    }
+
+    /// \brief 試合を停止する． GetStrand() 上で呼び出すこと．
+    ///
+    /// 応答を待っているエンジンは取り消すため，思考時間の終了を待たない．
+    void Stop()
+    {
+        game_.Stop();
+        Finish(false);
+    }
+
+    Strand const& GetStrand() const override
+    {
+        return strand_;
+    }
+
+    void DeliverMessage(size_t client_id, SharedMessage const& message,
+        std::optional<std::chrono::milliseconds> const& input_timeout) override
+    {
+        // Game の処理中にエンジンを呼び出さないよう，ポストして順に処理する
+        ++pending_[client_id];
+        queues_[client_id].push_back(QueuedMessage{ message, input_timeout });
+        boost::asio::post(strand_, [this, self = shared_from_this(), client_id]
+            {
+                SendNext(client_id);
+            });
+    }
+
+    void OnGameError(std::exception & e) override
+    {
+        HandleError(e);
+    }
+
+private:
+    struct QueuedMessage {
+        SharedMessage message;
+        std::optional<std::chrono::milliseconds> input_timeout;
+    };
+
+    Batch & batch_;
+    size_t const index_;
+    Strand const strand_;
+    std::array<std::unique_ptr<Engine>, 2> const engines_;
+    std::array<std::deque<QueuedMessage>, 2> queues_;  // エンジンに渡していないメッセージ
+    std::array<bool, 2> waiting_;  // エンジンの応答を待っているか
+    std::array<size_t, 2> pending_;  // 応答の処理を終えていないメッセージの数
+    std::array<bool, 2> session_stopped_;
+    bool finished_;
+    Game game_;
+
+    void SendNext(size_t client_id)
+    {
+        if (finished_ || waiting_[client_id] || queues_[client_id].empty()) {
+            return;
+        }
+
+        auto [message, input_timeout] = std::move(queues_[client_id].front());
+        queues_[client_id].pop_front();
+
+        Log::Trace(Log::kServer, Log::Client(client_id), message.GetLine());
+
+        waiting_[client_id] = true;
+        auto const start = std::chrono::steady_clock::now();
+        engines_[client_id]->AsyncOnMessage(message.GetLine(), input_timeout,
+            [this, self = shared_from_this(), client_id, start](std::string && hint)
+            {
+                if (finished_) return;
+                try {
+                    Log::Trace(Log::Client(client_id), Log::kServer, hint);
+                    game_.OnSessionRead(client_id, hint, std::chrono::steady_clock::now() - start);
+                } catch (std::exception & e) {
+                    HandleError(e);
+                }
+            },
+            [this, self = shared_from_this(), client_id, start, input_timeout = input_timeout](
+                std::exception_ptr error, std::optional<std::string> && response)
+            {
+                waiting_[client_id] = false;
+                --pending_[client_id];
+                if (finished_) return;
+                std::chrono::nanoseconds const elapsed = std::chrono::steady_clock::now() - start;
+                try {
+                    if (error) {
+                        std::rethrow_exception(error);
+                    }
+                    Receive(client_id, input_timeout, response, elapsed);
+                } catch (std::exception & e) {
+                    HandleError(e);
+                    return;
+                }
+                SendNext(client_id);
+            });
+    }
+
+    void Receive(size_t client_id, std::optional<std::chrono::milliseconds> const& input_timeout,
+        std::optional<std::string> const& response, std::chrono::nanoseconds const& elapsed)
+    {
+        if (input_timeout && (!response || elapsed > *input_timeout)) {
+            // TCPの場合は応答を受信する前にタイムアウトが発生する
+            game_.OnSessionTimeout(client_id);
+        } else if (response) {
+            {
+                Log::Trace(Log::Client(client_id), Log::kServer, *response);
+                std::ostringstream buf;
+                buf << "client " << client_id << ": elapsed_from_output=" << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << "ms, msg_length=" << response->size();
+                Log::Debug(buf.str());
+            }
+            // 共有ライブラリのエンジンは1メッセージに1行で応答するため，hint だけを返した場合は応答が無かったものとみなす
+            if (!game_.OnSessionRead(client_id, *response, elapsed) && input_timeout) {
+                game_.OnSessionTimeout(client_id);
+            }
+        }
+
+        // 試合終了後，最後のメッセージを渡したら接続を閉じたものとみなす
+        if (game_.IsGameOver()) {
+            for (size_t i = 0; i < session_stopped_.size(); ++i) {
+                if (!session_stopped_[i] && pending_[i] == 0) {
+                    session_stopped_[i] = true;
+                    game_.OnSessionStop(i);
+                }
+            }
+            if (session_stopped_[0] && session_stopped_[1]) {
+                Finish(false);
+            }
+        }
+    }
+
+    void HandleError(std::exception & e)
+    {
+        if (finished_) return;
+        Log::Error(game_.GetGameLog(), e.what());
+        game_.Stop();
+        Finish(true);
+    }
+
+    void Finish(bool error)
+    {
+        if (finished_) return;
+        finished_ = true;
+
+        // 応答を待っているエンジンの応答ハンドラは，取り消されて呼び出される
+        for (auto const& engine : engines_) {
+            engine->Cancel();
+        }
+
+        boost::asio::post(batch_.strand_,
+            [&batch = batch_, index = index_, error, game_result = game_.GetGameState().game_result]
+            {
+                batch.OnMatchFinished(index, error, game_result);
+            });
+    }
+};
+
+
+Batch::Batch(boost::asio::io_context & io_context, Config && config, BatchOptions && options,
+    boost::filesystem::path const& log_directory)
+    : io_context_(io_context)
+    , strand_(boost::asio::make_strand(io_context))
+    , config_(std::move(config))
+    , options_(std::move(options))
+    , log_directory_(log_directory)
+    , templates_(GameMessageTemplates::Create(config_))
+    , signals_(io_context, SIGINT, SIGTERM)
+    , matches_()
+    , records_()
+    , standings_(options_.engines.size())
+    , finished_(0)
+    , stopped_(false)
+    , summarized_(false)
+{
+    assert(options_.engines.size() >= 2);
+    assert(options_.schedule);
+    assert(options_.parallel >= 1);
+
+    signals_.async_wait(
+        boost::asio::bind_executor(strand_, [this](boost::system::error_code const& error, int /* signal_number */)
+        {
+            if (error) return;
+            Log::Info("signal received. stopping all games.");
+            Stop();
+        }));
+
+    boost::asio::post(strand_, [this] { StartMatches(); });
+}
+
+void Batch::Stop()
+{
+    if (stopped_) return;
+    stopped_ = true;
+
+    boost::system::error_code ignored_error;
+    signals_.cancel(ignored_error);
+
+    // 試合の停止は試合のストランド上で行う
+    for (auto & [index, match] : matches_) {
+        boost::asio::post(match->GetStrand(), [match = match] { match->Stop(); });
+    }
+
+    Log::Debug("batch stopped");
+
+    if (matches_.empty()) {
+        Summarize();
+    }
+}
+
+void Batch::StartMatches()
+{
+    while (!stopped_ && matches_.size() < options_.parallel) {
+        auto const scheduled = options_.schedule->Next();
+        if (!scheduled) break;
+
+        size_t const index = records_.size();
+
+        auto const now = boost::posix_time::second_clock::local_time();
+        auto const game_id = boost::uuids::to_string(boost::uuids::random_generator()());
+        boost::filesystem::path const game_log_directory = [&] {
+            std::ostringstream buf;
+            buf << GetISO8601String(now) << '_' << game_id;
+            return log_directory_ / buf.str();
+        }();
+
+        records_.push_back(GameRecord{ *scheduled, game_id, false, std::nullopt });
+
+        try {
+            auto const strand = boost::asio::make_strand(io_context_);
+            std::array<std::unique_ptr<Engine>, 2> engines;
+            for (size_t team = 0; team < 2; ++team) {
+                engines[team] = options_.engines.at(scheduled->engines[team]).factory->CreateEngine(strand);
+            }
+
+            auto match = std::make_shared<Match>(*this, index, config_.Clone(), GetISO8601ExtendedString(now), game_id,
+                game_log_directory, strand, std::move(engines));
+            matches_.emplace(index, match);
+            match->Start();
+        } catch (std::exception & e) {
+            std::ostringstream buf;
+            buf << "could not create game " << index << ": " << e.what();
+            Log::Error(buf.str());
+            RecordResult(index, true, std::nullopt);
+            continue;
+        }
+
+        std::ostringstream buf;
+        buf << "game " << index << " (round " << scheduled->round << ") started\n"
+            << "game id     : " << game_id << '\n'
+            << "game log dir: \"" << game_log_directory.string() << "\"\n"
+            << "team 0      : " << options_.engines[scheduled->engines[0]].name << '\n'
+            << "team 1      : " << options_.engines[scheduled->engines[1]].name;
+        Log::Info(buf.str());
+    }
+
+    if (matches_.empty() && (stopped_ || options_.schedule->IsFinished())) {
+        Summarize();
+    }
+}
+
+void Batch::OnMatchFinished(size_t index, bool error, std::optional<digitalcurling3::GameResult> const& game_result)
+{
+    matches_.erase(index);
+    RecordResult(index, error, game_result);
+    StartMatches();
+}
+
+void Batch::RecordResult(size_t index, bool error, std::optional<digitalcurling3::GameResult> const& game_result)
+{
+    ++finished_;
+
+    auto & record = records_.at(index);
+    record.error = error;
+    record.game_result = game_result;
+
+    std::optional<dc::Team> winner;
+    if (!error && game_result) {
+        winner = game_result->winner;
+    }
+    options_.schedule->OnResult(record.game, winner);
+
+    std::ostringstream buf;
+    buf << "game " << index << " finished (" << finished_ << "/" << options_.schedule->GetTotalGames() << "): ";
+    for (size_t team = 0; team < 2; ++team) {
+        auto & standing = standings_[record.game.engines[team]];
+        ++standing.games;
+        if (!winner) {
+            ++standing.errors;
+        } else if (*winner == dc::Team::kInvalid) {
+            ++standing.draws;
+        } else if (static_cast<size_t>(*winner) == team) {
+            ++standing.wins;
+        } else {
+            ++standing.losses;
+        }
+    }
+    if (error) {
+        buf << "error";
+    } else if (!winner) {
+        buf << "stopped";
+    } else if (*winner == dc::Team::kInvalid) {
+        buf << "draw";
+    } else {
+        buf << options_.engines[record.game.engines[static_cast<size_t>(*winner)]].name << " won as " << dc::ToString(*winner);
+    }
+    Log::Info(buf.str());
+}
+
+void Batch::Summarize()
+{
+    if (summarized_) return;
+    summarized_ = true;
+
+    // io_context の処理を無くして終了させる
+    boost::system::error_code ignored_error;
+    signals_.cancel(ignored_error);
+
+    // 不戦勝は組み合わせの勝ち点に含まれるため，成績表にも加える
+    auto const byes = options_.schedule->GetByes();
+    for (auto const& bye : byes) {
+        ++standings_[bye.engine].byes;
+        standings_[bye.engine].bye_wins += bye.wins;
+    }
+
+    // 勝ち点(勝ち1，引き分け0.5)の順に並べた表
+    std::vector<size_t> order(standings_.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    auto const half_points = [this](size_t i) { return (standings_[i].wins + standings_[i].bye_wins) * 2 + standings_[i].draws; };
+    std::stable_sort(order.begin(), order.end(),
+        [&half_points](size_t a, size_t b) { return half_points(a) > half_points(b); });
+
+    size_t name_width = 6;
+    for (auto const& engine : options_.engines) {
+        name_width = std::max(name_width, engine.name.size());
+    }
+
+    std::ostringstream buf;
+    buf << "results (" << finished_ << "/" << options_.schedule->GetTotalGames() << " games)\n"
+        << std::left << "rank  " << std::setw(static_cast<int>(name_width)) << "engine" << std::right
+        << std::setw(7) << "games" << std::setw(7) << "wins" << std::setw(7) << "draws"
+        << std::setw(7) << "losses" << std::setw(7) << "errors" << std::setw(7) << "byes" << std::setw(8) << "points";
+    for (size_t rank = 0; rank < order.size(); ++rank) {
+        auto const& standing = standings_[order[rank]];
+        buf << '\n' << std::right << std::setw(4) << rank + 1 << "  "
+            << std::left << std::setw(static_cast<int>(name_width)) << options_.engines[order[rank]].name << std::right
+            << std::setw(7) << standing.games << std::setw(7) << standing.wins << std::setw(7) << standing.draws
+            << std::setw(7) << standing.losses << std::setw(7) << standing.errors << std::setw(7) << standing.byes
+            << std::setw(8) << std::fixed << std::setprecision(1) << half_points(order[rank]) * 0.5;
+    }
+    Log::Info(buf.str());
+
+    if (options_.results_file) {
+        nlohmann::json j_results;
+        auto & j_engines = j_results["engines"];
+        j_engines = nlohmann::json::array();
+        for (size_t i = 0; i < options_.engines.size(); ++i) {
+            auto const& standing = standings_[i];
+            j_engines.push_back({
+                { "name", options_.engines[i].name },
+                { "description", options_.engines[i].factory->GetDescription() },
+                { "games", standing.games },
+                { "wins", standing.wins },
+                { "draws", standing.draws },
+                { "losses", standing.losses },
+                { "errors", standing.errors },
+                { "byes", standing.byes },
+                { "points", half_points(i) * 0.5 },
+            });
+        }
+        auto & j_games = j_results["games"];
+        j_games = nlohmann::json::array();
+        for (size_t i = 0; i < records_.size(); ++i) {
+            auto const& record = records_[i];
+            nlohmann::json j_game{
+                { "index", i },
+                { "round", record.game.round },
+                { "game_id", record.game_id },
+                { "engines", record.game.engines },
+                { "error", record.error },
+            };
+            if (record.game_result) {
+                j_game["winner"] = record.game_result->winner;
+            } else {
+                j_game["winner"] = nullptr;
+            }
+            j_games.push_back(std::move(j_game));
+        }
+        auto & j_byes = j_results["byes"];
+        j_byes = nlohmann::json::array();
+        for (auto const& bye : byes) {
+            j_byes.push_back({
+                { "round", bye.round },
+                { "engine", bye.engine },
+                { "wins", bye.wins },
+            });
+        }
+
+        boost::nowide::ofstream file(*options_.results_file);
+        file << j_results.dump(2) << std::endl;
+        if (!file) {
+            std::ostringstream buf_error;
+            buf_error << "could not write results file \"" << options_.results_file->string() << "\"";
+            Log::Warning(buf_error.str());
+        } else {
+            std::ostringstream buf_file;
+            buf_file << "results file: \"" << options_.results_file->string() << "\"";
+            Log::Info(buf_file.str());
+        }
+    }
+}
+
+
+void StartBatch(Config && config, BatchOptions && options, boost::filesystem::path const& log_directory, size_t thread_count)
+{
+    {
+        std::ostringstream buf;
+        buf << "batch mode: " << options.schedule->GetTotalGames() << " games, "
+            << options.parallel << " in parallel, " << thread_count << " threads";
+        Log::Info(buf.str());
+    }
+
+    for (auto const& engine : options.engines) {
+        std::ostringstream buf;
+        buf << engine.name << ": " << engine.factory->GetDescription();
+        Log::Info(buf.str());
+    }
+
+    boost::asio::io_context io_context(static_cast<int>(thread_count));
+    Batch batch(io_context, std::move(config), std::move(options), log_directory);
+
+    RunIOContext(io_context, thread_count);
+}
+
+} // namespace digitalcurling3_server
@@ -0,0 +1,142 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_BATCH_HPP
+#define DIGITALCURLING3_SERVER_BATCH_HPP
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/filesystem.hpp>
+#include "config.hpp"
+#include "engine.hpp"
+#include "message_template.hpp"
+#include "tournament.hpp"
+
+namespace digitalcurling3_server {
+
+/// \brief バッチモード，トーナメントモードの設定
+struct BatchOptions {
+    /// \brief 対戦させるエンジン
+    struct Engine {
+        std::string name;  ///< 結果の表に表示する名前
+        std::shared_ptr<EngineFactory const> factory;
+    };
+
+    /// \brief 対戦させるエンジン( ScheduledGame::engines はこの添字)
+    std::vector<Engine> engines;
+
+    /// \brief 試合の予定
+    std::shared_ptr<Schedule> schedule;
+
+    /// \brief 同時に進行させる試合数の上限
+    size_t parallel = 1;
+
+    /// \brief 全ての試合の結果をJSONで出力するファイル(省略時は出力しない)
+    std::optional<boost::filesystem::path> results_file;
+};
+
+/// \brief プロセス内のエンジン同士を，TCPを介さずに対戦させる(バッチモード，トーナメントモード)
+///
+/// 各試合は Server の代わりにメモリ上でメッセージを受け渡す試合を作り， Game をそのまま動かす．
+/// このため，試合ログ，ショットログの内容はTCPで対戦した場合と同じになる．
+/// 試合ごとのハンドラ(エンジンの呼び出しを含む)は試合ごとのストランド上で実行されるため，
+/// io_context を複数のスレッドで実行すれば複数の試合が並列に進行する．
+/// 組み合わせは BatchOptions::schedule に従い，最大 BatchOptions::parallel 試合を同時に進行させる．
+///
+/// エンジンの思考時間は Engine::AsyncOnMessage() でメッセージを渡してから応答を受け取るまでの時間で計測する．
+/// 制限時間付きのメッセージ(dc，手番のチームへのupdate)に応答しなかった場合はタイムアウトとして扱う．
+/// 応答より前にエンジンが出力した hint は，出力された時点で試合に渡す．
+/// プロセスのエンジンの応答は非同期に待つため，思考中のエンジンが io_context のスレッドを占有することは無い．
+class Batch {
+public:
+    Batch(boost::asio::io_context & io_context, Config && config, BatchOptions && options,
+        boost::filesystem::path const& log_directory);
+    Batch(Batch const&) = delete;
+    Batch & operator = (Batch const&) = delete;
+
+    /// \brief 新しい試合の開始を止め，進行中の全ての試合を停止する
+    ///
+    /// Batch のストランド上で呼び出すこと．
+    void Stop();
+
+private:
+    class Match;
+
+    /// \brief 1試合の記録
+    struct GameRecord {
+        ScheduledGame game;
+        std::string game_id;
+        bool error = false;  ///< エラーで停止した
+        std::optional<digitalcurling3::GameResult> game_result;  ///< 試合の結果(終了していない場合は \c std::nullopt )
+    };
+
+    /// \brief エンジンごとの成績
+    struct Standing {
+        size_t games = 0;
+        size_t wins = 0;
+        size_t draws = 0;
+        size_t losses = 0;
+        size_t errors = 0;  ///< エラーなどで結果が出なかった試合
+        size_t byes = 0;  ///< 不戦勝の回数
+        size_t bye_wins = 0;  ///< 不戦勝で勝ちとして数える試合数(勝ち点にのみ加える)
+    };
+
+    boost::asio::io_context & io_context_;
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    Config const config_;
+    BatchOptions const options_;
+    boost::filesystem::path const log_directory_;
+    std::shared_ptr<GameMessageTemplates const> const templates_;
+    boost::asio::signal_set signals_;
+    std::unordered_map<size_t, std::shared_ptr<Match>> matches_;  // 進行中の試合(試合の番号 -> 試合)
+    std::vector<GameRecord> records_;  // 試合の番号順
+    std::vector<Standing> standings_;
+    size_t finished_;
+    bool stopped_;
+    bool summarized_;
+
+    void StartMatches();
+    void OnMatchFinished(size_t index, bool error, std::optional<digitalcurling3::GameResult> const& game_result);
+    void RecordResult(size_t index, bool error, std::optional<digitalcurling3::GameResult> const& game_result);
+    void Summarize();
+};
+
+/// \brief バッチモード，トーナメントモードを実行する
+///
+/// 全ての試合が終了するまで戻らない．
+///
+/// \param config コンフィグ(試合ごとに複製する)
+/// \param options バッチモードの設定
+/// \param log_directory ログの出力先．この下に試合ごとのディレクトリを作成する．
+/// \param thread_count 実行するスレッド数(>= 1)
+void StartBatch(Config && config, BatchOptions && options, boost::filesystem::path const& log_directory, size_t thread_count);
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_BATCH_HPP
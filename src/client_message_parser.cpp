@@ -0,0 +1,371 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "client_message_parser.hpp"
+
+#include <charconv>
+#include <optional>
+
+namespace digitalcurling3_server {
+
+namespace dc = digitalcurling3;
+using namespace std::string_view_literals;
+
+namespace {
+
+constexpr int kSkipDepthMax = 32;  // 読み飛ばす値の入れ子の深さの上限
+
+/// 入力を先頭から読む．失敗した場合は常に false を返し，その後の状態は不定．
+class Reader {
+public:
+    explicit Reader(std::string_view input)
+        : p_(input.data())
+        , end_(input.data() + input.size())
+    {}
+
+    void SkipWhitespace()
+    {
+        while (p_ != end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+            ++p_;
+        }
+    }
+
+    bool Consume(char c)
+    {
+        SkipWhitespace();
+        if (p_ == end_ || *p_ != c) return false;
+        ++p_;
+        return true;
+    }
+
+    bool IsEnd()
+    {
+        SkipWhitespace();
+        return p_ == end_;
+    }
+
+    /// エスケープと非ASCII文字を含まない文字列のみ読む
+    bool ReadString(std::string_view & out)
+    {
+        if (!Consume('"')) return false;
+        char const* const begin = p_;
+        for (; p_ != end_; ++p_) {
+            auto const c = static_cast<unsigned char>(*p_);
+            if (c == '"') {
+                out = std::string_view(begin, static_cast<size_t>(p_ - begin));
+                ++p_;
+                return true;
+            }
+            if (c == '\\' || c < 0x20 || c >= 0x80) return false;
+        }
+        return false;
+    }
+
+    /// JSONの数値の文法に従う字句を読む
+    bool ReadNumber(std::string_view & out, bool & is_integer)
+    {
+        SkipWhitespace();
+        char const* const begin = p_;
+        is_integer = true;
+
+        if (p_ != end_ && *p_ == '-') ++p_;
+        if (p_ == end_) return false;
+        if (*p_ == '0') {
+            ++p_;
+        } else if (IsDigit(*p_)) {
+            SkipDigits();
+        } else {
+            return false;
+        }
+        if (p_ != end_ && *p_ == '.') {
+            is_integer = false;
+            ++p_;
+            if (p_ == end_ || !IsDigit(*p_)) return false;
+            SkipDigits();
+        }
+        if (p_ != end_ && (*p_ == 'e' || *p_ == 'E')) {
+            is_integer = false;
+            ++p_;
+            if (p_ != end_ && (*p_ == '+' || *p_ == '-')) ++p_;
+            if (p_ == end_ || !IsDigit(*p_)) return false;
+            SkipDigits();
+        }
+
+        out = std::string_view(begin, static_cast<size_t>(p_ - begin));
+        return true;
+    }
+
+    bool ReadFloat(float & out)
+    {
+        std::string_view token;
+        bool is_integer;
+        if (!ReadNumber(token, is_integer)) return false;
+
+        // 大きな整数は nlohmann::json では整数として保持されてから float に変換されるため，
+        // double を経由すると丸めが変わりうる．そのような入力は通常の処理に任せる．
+        if (is_integer && token.size() > 15) return false;
+
+        double value;
+        auto const [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (ec != std::errc() || ptr != token.data() + token.size()) return false;
+        // 整数の -0 は nlohmann::json では整数 0 として保持されるため +0 になる
+        if (is_integer && value == 0.0) {
+            value = 0.0;
+        }
+        out = static_cast<float>(value);
+        return true;
+    }
+
+    bool ReadUnsigned(size_t & out)
+    {
+        std::string_view token;
+        bool is_integer;
+        if (!ReadNumber(token, is_integer)) return false;
+        if (!is_integer || token.front() == '-') return false;
+
+        auto const [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), out);
+        return ec == std::errc() && ptr == token.data() + token.size();
+    }
+
+    /// オブジェクトを読む．メンバーごとに on_member(key) を呼び，その中で値を読む．
+    template <class OnMember>
+    bool ReadObject(OnMember && on_member)
+    {
+        if (!Consume('{')) return false;
+        if (Consume('}')) return true;
+        do {
+            std::string_view key;
+            if (!ReadString(key)) return false;
+            if (!Consume(':')) return false;
+            if (!on_member(key)) return false;
+        } while (Consume(','));
+        return Consume('}');
+    }
+
+    /// 配列を読む．要素ごとに on_element() を呼び，その中で値を読む．
+    template <class OnElement>
+    bool ReadArray(OnElement && on_element)
+    {
+        if (!Consume('[')) return false;
+        if (Consume(']')) return true;
+        do {
+            if (!on_element()) return false;
+        } while (Consume(','));
+        return Consume(']');
+    }
+
+    /// 任意の値を読み飛ばす
+    bool SkipValue(int depth = 0)
+    {
+        if (depth > kSkipDepthMax) return false;
+
+        SkipWhitespace();
+        if (p_ == end_) return false;
+
+        switch (*p_) {
+            case '{':
+                return ReadObject([this, depth](std::string_view) { return SkipValue(depth + 1); });
+            case '[':
+                return ReadArray([this, depth] { return SkipValue(depth + 1); });
+            case '"': {
+                std::string_view ignored;
+                return ReadString(ignored);
+            }
+            case 't':
+                return ConsumeLiteral("true"sv);
+            case 'f':
+                return ConsumeLiteral("false"sv);
+            case 'n':
+                return ConsumeLiteral("null"sv);
+            default: {
+                std::string_view ignored;
+                bool is_integer;
+                return ReadNumber(ignored, is_integer);
+            }
+        }
+    }
+
+private:
+    char const* p_;
+    char const* const end_;
+
+    static bool IsDigit(char c)
+    {
+        return '0' <= c && c <= '9';
+    }
+
+    void SkipDigits()
+    {
+        while (p_ != end_ && IsDigit(*p_)) ++p_;
+    }
+
+    bool ConsumeLiteral(std::string_view literal)
+    {
+        if (static_cast<size_t>(end_ - p_) < literal.size()
+            || std::string_view(p_, literal.size()) != literal) {
+            return false;
+        }
+        p_ += literal.size();
+        return true;
+    }
+};
+
+/// "cmd" が expected_command であるトップレベルのオブジェクトを読む．
+/// "cmd" 以外のメンバーは on_member(key) で読む．
+template <class OnMember>
+bool ReadCommand(std::string_view input, std::string_view expected_command, OnMember && on_member)
+{
+    Reader reader(input);
+    bool cmd_matched = false;
+
+    bool const ok = reader.ReadObject([&](std::string_view key) {
+        if (key == "cmd"sv) {
+            std::string_view cmd;
+            if (!reader.ReadString(cmd)) return false;
+            cmd_matched = cmd == expected_command;
+            return true;
+        }
+        return on_member(reader, key);
+    });
+
+    return ok && cmd_matched && reader.IsEnd();
+}
+
+bool ReadVector2(Reader & reader, dc::Vector2 & out)
+{
+    bool has_x = false;
+    bool has_y = false;
+
+    bool const ok = reader.ReadObject([&](std::string_view key) {
+        if (key == "x"sv) {
+            has_x = true;
+            return reader.ReadFloat(out.x);
+        } else if (key == "y"sv) {
+            has_y = true;
+            return reader.ReadFloat(out.y);
+        }
+        return reader.SkipValue();
+    });
+
+    return ok && has_x && has_y;
+}
+
+bool ReadMove(Reader & reader, dc::Move & out)
+{
+    std::string_view type;
+    std::optional<dc::Vector2> velocity;
+    std::optional<dc::moves::Shot::Rotation> rotation;
+    bool has_type = false;
+
+    bool const ok = reader.ReadObject([&](std::string_view key) {
+        if (key == "type"sv) {
+            has_type = true;
+            return reader.ReadString(type);
+        } else if (key == "velocity"sv) {
+            dc::Vector2 v;
+            if (!ReadVector2(reader, v)) return false;
+            velocity = v;
+            return true;
+        } else if (key == "rotation"sv) {
+            std::string_view r;
+            if (!reader.ReadString(r)) return false;
+            if (r == "ccw"sv) {
+                rotation = dc::moves::Shot::Rotation::kCCW;
+            } else if (r == "cw"sv) {
+                rotation = dc::moves::Shot::Rotation::kCW;
+            } else {
+                return false;
+            }
+            return true;
+        }
+        return reader.SkipValue();
+    });
+
+    if (!ok || !has_type) return false;
+
+    if (type == "shot"sv) {
+        if (!velocity || !rotation) return false;
+        dc::moves::Shot shot;
+        shot.velocity = *velocity;
+        shot.rotation = *rotation;
+        out = shot;
+        return true;
+    } else if (type == "concede"sv) {
+        out = dc::moves::Concede();
+        return true;
+    }
+
+    return false;
+}
+
+} // unnamed namespace
+
+bool TryParseDCOk(std::string_view input, DCOkMessage & message)
+{
+    bool has_name = false;
+
+    bool const ok = ReadCommand(input, "dc_ok"sv, [&](Reader & reader, std::string_view key) {
+        if (key == "name"sv) {
+            has_name = true;
+            return reader.ReadString(message.name);
+        }
+        return reader.SkipValue();
+    });
+
+    return ok && has_name;
+}
+
+bool TryParseReadyOk(std::string_view input, ReadyOkMessage & message)
+{
+    bool has_player_order = false;
+
+    bool const ok = ReadCommand(input, "ready_ok"sv, [&](Reader & reader, std::string_view key) {
+        if (key == "player_order"sv) {
+            has_player_order = true;
+            message.player_order_size = 0;
+            return reader.ReadArray([&] {
+                if (message.player_order_size >= ReadyOkMessage::kPlayerOrderMax) return false;
+                return reader.ReadUnsigned(message.player_order[message.player_order_size++]);
+            });
+        }
+        return reader.SkipValue();
+    });
+
+    return ok && has_player_order;
+}
+
+bool TryParseMove(std::string_view input, MoveMessage & message)
+{
+    bool has_move = false;
+
+    bool const ok = ReadCommand(input, "move"sv, [&](Reader & reader, std::string_view key) {
+        if (key == "move"sv) {
+            has_move = true;
+            return ReadMove(reader, message.move);
+        }
+        return reader.SkipValue();
+    });
+
+    return ok && has_move;
+}
+
+} // namespace digitalcurling3_server
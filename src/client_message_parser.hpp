@@ -0,0 +1,86 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_CLIENT_MESSAGE_PARSER_HPP
+#define DIGITALCURLING3_SERVER_CLIENT_MESSAGE_PARSER_HPP
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include "digitalcurling3/digitalcurling3.hpp"
+
+namespace digitalcurling3_server {
+
+// クライアントから届くメッセージの高速パーサー
+//
+// 試合中に頻繁に届く dc_ok, ready_ok, move を，JSONの木を作らず(ヒープを確保せず)に
+// 入力を先頭から1度だけ読んで構造体に格納する．
+// 以下の場合は \c false を返すので，呼び出し側は nlohmann::json::parse() による通常の処理で読み直す．
+// (エラーメッセージは通常の処理で出すため，このパーサーは理由を区別しない．)
+// - JSONとして不正
+// - "cmd" が期待するコマンドでない，必要なキーが無い，値の型が違う
+// - エスケープシーケンスや非ASCII文字を含む文字列など，このパーサーが扱わない形
+// 未知のキーは通常の処理と同様に無視する．
+
+/// \brief dc_ok の内容
+struct DCOkMessage {
+    std::string_view name;  ///< 入力の文字列を指す
+};
+
+/// \brief ready_ok の内容
+struct ReadyOkMessage {
+    /// \brief このパーサーで扱うプレイヤー数の上限(これより多い場合は通常の処理で読む)
+    static constexpr size_t kPlayerOrderMax = 8;
+
+    std::array<size_t, kPlayerOrderMax> player_order;
+    size_t player_order_size = 0;
+};
+
+/// \brief move の内容
+struct MoveMessage {
+    digitalcurling3::Move move;
+};
+
+/// \brief dc_ok を読む
+///
+/// \param input 入力(1行分，改行を含まない)
+/// \param message 結果の格納先
+/// \return 読めた場合 \c true
+bool TryParseDCOk(std::string_view input, DCOkMessage & message);
+
+/// \brief ready_ok を読む
+///
+/// \param input 入力(1行分，改行を含まない)
+/// \param message 結果の格納先
+/// \return 読めた場合 \c true
+bool TryParseReadyOk(std::string_view input, ReadyOkMessage & message);
+
+/// \brief move を読む
+///
+/// \param input 入力(1行分，改行を含まない)
+/// \param message 結果の格納先
+/// \return 読めた場合 \c true
+bool TryParseMove(std::string_view input, MoveMessage & message);
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_CLIENT_MESSAGE_PARSER_HPP
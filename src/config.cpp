@@ -33,6 +33,22 @@ NLOHMANN_JSON_SERIALIZE_ENUM(Config::Game::Rule, {
 
 // --- Config ---
 
+Config Config::Clone() const
+{
+    Config config;
+    config.server = server;
+    config.game.rule = game.rule;
+    config.game.setting = game.setting;
+    config.game.simulator = game.simulator->Clone();
+    for (size_t i = 0; i < 2; ++i) {
+        for (auto const& player : game.players[i]) {
+            config.game.players[i].emplace_back(player->Clone());
+        }
+    }
+    config.game_is_ready = game_is_ready;
+    return config;
+}
+
 void to_json(nlohmann::json& j, Config const& config)
 {
     namespace dc = digitalcurling3;
@@ -46,9 +62,16 @@ void to_json(nlohmann::json& j, Config const& config)
             }
         }
         j_server["timeout_dc_ok"] = config.server.timeout_dc_ok;
+        j_server["timeout_join"] = config.server.timeout_join;
         j_server["update_interval"] = config.server.update_interval;
         j_server["send_trajectory"] = config.server.send_trajectory;
         j_server["steps_per_trajectory_frame"] = config.server.steps_per_trajectory_frame;
+        j_server["trajectory_format"] = config.server.trajectory_format;
+        j_server["trajectory_position_tolerance"] = config.server.trajectory_tolerance.position;
+        j_server["trajectory_angle_tolerance"] = config.server.trajectory_tolerance.angle;
+        j_server["max_line_length"] = config.server.max_line_length;
+        j_server["timing"] = config.server.timing;
+        j_server["speculative_moves"] = config.server.speculative_moves;
     }
 
     {
@@ -85,6 +108,11 @@ void from_json(nlohmann::json const& j, Config & config)
             }
         }
         j_server.at("timeout_dc_ok").get_to(config.server.timeout_dc_ok);
+        if (auto it = j_server.find("timeout_join"); it != j_server.end()) {
+            it.value().get_to(config.server.timeout_join);
+        } else {
+            config.server.timeout_join = Config::Server::kDefaultTimeoutJoin;
+        }
         if (auto it = j_server.find("update_interval"); it != j_server.end()) {
             it.value().get_to(config.server.update_interval);
         } else {
@@ -92,6 +120,22 @@ void from_json(nlohmann::json const& j, Config & config)
         }
         j_server.at("send_trajectory").get_to(config.server.send_trajectory);
         j_server.at("steps_per_trajectory_frame").get_to(config.server.steps_per_trajectory_frame);
+        if (auto it = j_server.find("trajectory_format"); it != j_server.end()) {
+            it.value().get_to(config.server.trajectory_format);
+        } else {
+            config.server.trajectory_format = TrajectoryFormat::kJSON;
+        }
+        config.server.trajectory_tolerance.position = j_server.value("trajectory_position_tolerance", 0.f);
+        config.server.trajectory_tolerance.angle = j_server.value("trajectory_angle_tolerance", 0.f);
+        if (config.server.trajectory_tolerance.position < 0.f || config.server.trajectory_tolerance.angle < 0.f) {
+            throw std::runtime_error("trajectory tolerance must not be negative");
+        }
+        config.server.max_line_length = j_server.value("max_line_length", Config::Server::kDefaultMaxLineLength);
+        if (config.server.max_line_length == 0) {
+            throw std::runtime_error("max_line_length must be positive");
+        }
+        config.server.timing = j_server.value("timing", false);
+        config.server.speculative_moves = j_server.value("speculative_moves", size_t(0));
     }
 
     {
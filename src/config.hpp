@@ -29,16 +29,26 @@
 #include <chrono>
 #include "nlohmann/json.hpp"
 #include "digitalcurling3/digitalcurling3.hpp"
+#include "trajectory_codec.hpp"
 
 namespace digitalcurling3_server {
 
 struct Config {
     struct Server {
+        static constexpr size_t kDefaultMaxLineLength = 1024 * 1024;
+        static constexpr std::chrono::milliseconds kDefaultTimeoutJoin = std::chrono::milliseconds(60000);
+
         std::array<unsigned short, 2> port;
         std::chrono::milliseconds timeout_dc_ok;
+        std::chrono::milliseconds timeout_join;  // ホスティングモードで一方のチームの接続後，もう一方を待つ時間．省略時は kDefaultTimeoutJoin
         std::chrono::milliseconds update_interval;
         bool send_trajectory;
         size_t steps_per_trajectory_frame;
+        TrajectoryFormat trajectory_format;  // 省略時は TrajectoryFormat::kJSON
+        TrajectoryCompressor::Tolerance trajectory_tolerance;  // 省略時は0(可逆圧縮)
+        size_t max_line_length;  // クライアントから受信する1行の最大バイト数．省略時は kDefaultMaxLineLength
+        bool timing;  // 処理時間を計測し，試合終了時に試合ログへ出力するか(メトリクスにも含める)．省略時は false
+        size_t speculative_moves;  // hint で予告された手を1手番あたり何手まで事前にシミュレーションするか．省略時は0(無効)
     } server;
 
     struct Game {
@@ -54,6 +64,14 @@ struct Config {
 
     // is_ready 時に"game"として送信するjson
     nlohmann::json game_is_ready;
+
+    /// \brief 複製を作成する
+    ///
+    /// シミュレータとプレイヤーはファクトリを複製する．
+    /// 1プロセスで複数の試合をホストする際，試合ごとのコンフィグを作るのに用いる．
+    ///
+    /// \return 複製したコンフィグ
+    Config Clone() const;
 };
 
 
@@ -0,0 +1,70 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/* プロセス内で対戦させる思考エンジンの C ABI
+ *
+ * バッチモード( --batch )で共有ライブラリとして読み込むエンジンは，以下の関数をエクスポートする．
+ * エンジンはTCPで接続するクライアントと同じプロトコルのメッセージを1行ずつ受け取り，応答を返す．
+ * 1つのエンジンのインスタンスの関数が複数のスレッドから同時に呼び出されることは無いが，
+ * 異なるインスタンスの関数は別々のスレッドから同時に呼び出されうる．
+ */
+
+#ifndef DIGITALCURLING3_SERVER_DCS_ENGINE_H
+#define DIGITALCURLING3_SERVER_DCS_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DCS_ENGINE_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct dcs_engine dcs_engine;
+
+/* エンジンがビルドされた DCS_ENGINE_ABI_VERSION を返す */
+typedef uint32_t (*dcs_engine_abi_version_fn)(void);
+
+/* エンジンのインスタンスを作成する．試合ごとに1つ作成される．
+ * args はコマンドラインで指定した文字列(指定されない場合は空文字列)．
+ * 失敗した場合は NULL を返す． */
+typedef dcs_engine * (*dcs_engine_create_fn)(char const * args);
+
+/* サーバーからのメッセージ(改行を含まない．NUL終端されているとは限らない)を受け取る．
+ * 応答する場合は応答(改行を含まないNUL終端文字列)を返す．応答しない場合は NULL を返す．
+ * 返した文字列は次にこのインスタンスの関数が呼ばれるまで有効である必要がある． */
+typedef char const * (*dcs_engine_on_message_fn)(dcs_engine * engine, char const * message, size_t length);
+
+/* エンジンのインスタンスを破棄する */
+typedef void (*dcs_engine_destroy_fn)(dcs_engine * engine);
+
+#define DCS_ENGINE_ABI_VERSION_SYMBOL "dcs_engine_abi_version"
+#define DCS_ENGINE_CREATE_SYMBOL "dcs_engine_create"
+#define DCS_ENGINE_ON_MESSAGE_SYMBOL "dcs_engine_on_message"
+#define DCS_ENGINE_DESTROY_SYMBOL "dcs_engine_destroy"
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* DIGITALCURLING3_SERVER_DCS_ENGINE_H */
@@ -0,0 +1,143 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "engine.hpp"
+
+#include <sstream>
+#include <stdexcept>
+#include <boost/asio/post.hpp>
+#include <boost/dll/shared_library.hpp>
+#include "dcs_engine.h"
+
+namespace digitalcurling3_server {
+
+namespace {
+
+/// 共有ライブラリの関数．ライブラリはエンジンが全て破棄されるまで開いておく．
+struct EngineLibrary {
+    boost::dll::shared_library library;
+    dcs_engine_create_fn create;
+    dcs_engine_on_message_fn on_message;
+    dcs_engine_destroy_fn destroy;
+};
+
+class SharedLibraryEngine : public Engine {
+public:
+    SharedLibraryEngine(std::shared_ptr<EngineLibrary const> const& library, std::string const& args, Strand const& strand)
+        : library_(library)
+        , strand_(strand)
+        , engine_(library_->create(args.c_str()))
+    {
+        if (engine_ == nullptr) {
+            throw std::runtime_error("dcs_engine_create failed");
+        }
+    }
+
+    ~SharedLibraryEngine()
+    {
+        library_->destroy(engine_);
+    }
+
+    void AsyncOnMessage(std::string_view message, std::optional<std::chrono::milliseconds> const& /* input_timeout */,
+        HintHandler /* on_hint */, ResponseHandler on_response) override
+    {
+        // ライブラリの関数は同期的に呼び出すしかない．返された文字列は次の呼び出しまでしか有効でないため複製する
+        std::optional<std::string> response;
+        if (char const* const result = library_->on_message(engine_, message.data(), message.size()); result != nullptr) {
+            response.emplace(result);
+        }
+        boost::asio::post(strand_, [on_response = std::move(on_response), response = std::move(response)]() mutable
+            {
+                on_response(nullptr, std::move(response));
+            });
+    }
+
+    void Cancel() override
+    {
+        // 応答は AsyncOnMessage() の中で得ているため，取り消すものは無い
+    }
+
+private:
+    std::shared_ptr<EngineLibrary const> const library_;
+    Strand const strand_;
+    dcs_engine * const engine_;
+};
+
+class SharedLibraryEngineFactory : public EngineFactory {
+public:
+    SharedLibraryEngineFactory(std::shared_ptr<EngineLibrary const> && library, std::string const& description, std::string const& args)
+        : library_(std::move(library))
+        , description_(description)
+        , args_(args)
+    {}
+
+    std::unique_ptr<Engine> CreateEngine(Engine::Strand const& strand) const override
+    {
+        return std::make_unique<SharedLibraryEngine>(library_, args_, strand);
+    }
+
+    std::string GetDescription() const override
+    {
+        return description_;
+    }
+
+private:
+    std::shared_ptr<EngineLibrary const> const library_;
+    std::string const description_;
+    std::string const args_;
+};
+
+} // unnamed namespace
+
+std::unique_ptr<EngineFactory> LoadEngineLibrary(boost::filesystem::path const& path, std::string const& args)
+{
+    auto library = std::make_shared<EngineLibrary>();
+
+    try {
+        library->library.load(path.string());
+
+        auto const abi_version = library->library.get<std::uint32_t()>(DCS_ENGINE_ABI_VERSION_SYMBOL)();
+        if (abi_version != DCS_ENGINE_ABI_VERSION) {
+            std::ostringstream buf;
+            buf << "unsupported engine ABI version " << abi_version << " (expected: " << DCS_ENGINE_ABI_VERSION << ")";
+            throw std::runtime_error(buf.str());
+        }
+
+        library->create = library->library.get<dcs_engine *(char const*)>(DCS_ENGINE_CREATE_SYMBOL);
+        library->on_message = library->library.get<char const*(dcs_engine *, char const*, size_t)>(DCS_ENGINE_ON_MESSAGE_SYMBOL);
+        library->destroy = library->library.get<void(dcs_engine *)>(DCS_ENGINE_DESTROY_SYMBOL);
+    } catch (std::exception & e) {
+        std::ostringstream buf;
+        buf << "could not load engine \"" << path.string() << "\": " << e.what();
+        throw std::runtime_error(buf.str());
+    }
+
+    std::ostringstream buf_description;
+    buf_description << '"' << path.string() << '"';
+    if (!args.empty()) {
+        buf_description << " (args: \"" << args << "\")";
+    }
+
+    return std::make_unique<SharedLibraryEngineFactory>(std::move(library), buf_description.str(), args);
+}
+
+} // namespace digitalcurling3_server
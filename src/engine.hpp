@@ -0,0 +1,126 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_ENGINE_HPP
+#define DIGITALCURLING3_SERVER_ENGINE_HPP
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/filesystem.hpp>
+
+namespace digitalcurling3_server {
+
+/// \brief プロセス内で対戦させる思考エンジン
+///
+/// TCPで接続するクライアントと同じプロトコルのメッセージを1行ずつ受け取り，応答を返す．
+/// 1つのインスタンスは1試合でのみ使われ，作成時に渡したストランド上でのみ呼び出される．
+/// ハンドラも同じストランドにポストして呼び出す(呼び出し元の関数の中では呼び出さない)．
+class Engine {
+public:
+    using Strand = boost::asio::strand<boost::asio::io_context::executor_type>;
+
+    /// \brief 応答より前にエンジンが出力した hint (改行を含まない)を受け取る関数
+    using HintHandler = std::function<void(std::string && hint)>;
+
+    /// \brief 応答を受け取る関数
+    ///
+    /// 第1引数はエラー(エラーが無い場合は \c nullptr )，
+    /// 第2引数は応答(改行を含まない)．応答しない場合，タイムアウトした場合，取り消された場合は \c std::nullopt
+    using ResponseHandler = std::function<void(std::exception_ptr error, std::optional<std::string> && response)>;
+
+    virtual ~Engine() = default;
+
+    /// \brief サーバーからのメッセージを渡し，応答を待つ
+    ///
+    /// \p on_response は必ず1回呼び出される．それまで次のメッセージを渡さないこと．
+    ///
+    /// \param message メッセージ(改行を含まない)
+    /// \param input_timeout 応答の制限時間．制限時間の無いメッセージでは \c std::nullopt
+    /// \param on_hint hint を受け取る関数
+    /// \param on_response 応答を受け取る関数
+    virtual void AsyncOnMessage(std::string_view message, std::optional<std::chrono::milliseconds> const& input_timeout,
+        HintHandler on_hint, ResponseHandler on_response) = 0;
+
+    /// \brief 応答の待機を取り消す
+    ///
+    /// 試合を停止する際に呼び出す．待機中の \p on_response は応答無しとして呼び出される．
+    virtual void Cancel() = 0;
+};
+
+/// \brief Engine を試合ごとに作成する
+///
+/// 複数のスレッドから同時に呼び出される．
+class EngineFactory {
+public:
+    virtual ~EngineFactory() = default;
+
+    /// \brief エンジンを作成する
+    ///
+    /// \param strand エンジンを呼び出す試合のストランド
+    /// \return 作成したエンジン
+    virtual std::unique_ptr<Engine> CreateEngine(Engine::Strand const& strand) const = 0;
+
+    /// \brief ログに表示する説明
+    virtual std::string GetDescription() const = 0;
+};
+
+/// \brief 共有ライブラリからエンジンを読み込む
+///
+/// ライブラリは dcs_engine.h の関数をエクスポートする必要がある．
+/// ライブラリの関数は Engine::AsyncOnMessage() の中で呼び出すため，思考中はそのスレッドを占有する．
+///
+/// \param path 共有ライブラリのパス
+/// \param args dcs_engine_create() に渡す文字列
+/// \return 読み込んだエンジンのファクトリ
+std::unique_ptr<EngineFactory> LoadEngineLibrary(boost::filesystem::path const& path, std::string const& args);
+
+/// \brief エンジンを子プロセスとして起動する
+///
+/// エンジンは標準入力からサーバーのメッセージを1行ずつ受け取り，応答を標準出力に1行ずつ書き出す．
+/// プロトコルはTCPで接続するクライアントと同じ．
+///
+/// 起動したプロセスは試合が終わっても終了させず，次の試合で再利用する．
+/// このため，エンジンはgame_overを受け取った後も終了せずに次の試合のdcを待つことが望ましい．
+/// game_over後に終了したプロセスや，試合が途中で停止したプロセスは再利用せず，次の試合で新たに起動する．
+///
+/// 標準出力は試合のストランド上で非同期に読み取るため，エンジンの思考中にスレッドを止めない．
+/// 制限時間付きのメッセージに対して hint を出力した場合は， hint を届いた順に Engine::HintHandler に渡して
+/// 制限時間まで続きの行を待ち，最初の hint 以外の行を応答とする．
+///
+/// is_ready には制限時間が無いが，応答しないエンジンの試合が終わらなくならないよう \p ready_timeout まで待つ．
+/// それまでに ready_ok が届かない場合は Engine::ResponseHandler にエラーを渡し，その試合はエラーとなる．
+///
+/// \param command 起動するコマンドライン
+/// \param ready_timeout is_ready への応答を待つ時間
+/// \return エンジンのファクトリ
+std::unique_ptr<EngineFactory> LaunchEngineProcess(std::string const& command, std::chrono::milliseconds ready_timeout);
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_ENGINE_HPP
@@ -22,10 +22,12 @@
 
 #include "game.hpp"
 
-#include <thread>
 #include <boost/asio/ip/host_name.hpp>
-#include "server.hpp"
+#include "client_message_parser.hpp"
+#include "shared_message.hpp"
+#include "trajectory_codec.hpp"
 #include "log.hpp"
+#include "metrics.hpp"
 #include "version.hpp"
 
 namespace digitalcurling3_server {
@@ -62,11 +64,14 @@ inline void LogInfoClient(size_t client_id, std::string_view message)
 
 } // unnamed namespace
 
-Game::Game(Server & server, Config && config, std::string const& date_time, std::string const& game_id)
-    : server_(server)
+Game::Game(GameTransport & transport, Config && config, std::string const& date_time, std::string const& game_id,
+    boost::filesystem::path const& game_log_directory, std::shared_ptr<GameMessageTemplates const> const& templates)
+    : transport_(transport)
     , config_(std::move(config))
     , date_time_(date_time)
     , game_id_(game_id)
+    , game_log_(game_log_directory)
+    , templates_(templates)
     , json_dc_{
         { "cmd", "dc" },
         { "version", {
@@ -75,18 +80,25 @@ Game::Game(Server & server, Config && config, std::string const& date_time, std:
         }},
         { "game_id", game_id_ },
         { "date_time", date_time_ } }
-    , json_is_ready_{
-        { "cmd", "is_ready" },
-        { "game", config_.game_is_ready } }
+    , dc_message_(templates_->dc.Render({ json(game_id_).dump(), json(date_time_).dump() }))
     , clients_{{}}
     , simulator_(config_.game.simulator->CreateSimulator())
     , game_state_(config_.game.setting)
     , compressor_()
     , last_move_has_value_(false)
     , last_move_free_guard_zone_foul_(false)
-    , json_last_move_actual_move_()
-    , json_last_move_trajectory_()
+    , last_move_actual_move_()
+    , last_move_trajectory_()
+    , update_head_()
+    , update_tail_()
     , last_update_message_derivery_()
+    , update_timer_(transport.GetStrand())
+    , speculation_(config_.server.speculative_moves > 0
+        ? std::make_unique<Speculation>(transport.GetStrand(), config_.server.speculative_moves) : nullptr)
+    , timing_(config_.server.timing ? std::make_unique<GameTiming>() : nullptr)
+    , timing_id_(0)
+    , timing_logged_(false)
+    , in_progress_(false)
 {
     // rule
 
@@ -101,6 +113,17 @@ Game::Game(Server & server, Config && config, std::string const& date_time, std:
             clients_[i].players.emplace_back(player_factory->CreatePlayer());
         }
     }
+
+    if (timing_) {
+        timing_id_ = TimingRegistry::Register(transport.GetStrand(), timing_.get());
+    }
+}
+
+Game::~Game()
+{
+    if (timing_) {
+        TimingRegistry::Unregister(timing_id_);
+    }
 }
 
 void Game::OnSessionStart(size_t client_id)
@@ -112,11 +135,20 @@ void Game::OnSessionStart(size_t client_id)
     LogInfoClient(client_id, "start connection");
 
     // send dc
-    server_.DeliverMessage(client_id, json_dc_.dump(), config_.server.timeout_dc_ok);
+    transport_.DeliverMessage(client_id, dc_message_, config_.server.timeout_dc_ok);
+}
+
+void Game::OnSessionAttach(size_t client_id)
+{
+    assert(clients_.at(client_id).state == Client::State::kBeforeSessionStart);
+
+    clients_.at(client_id).state = Client::State::kDC;
+
+    LogInfoClient(client_id, "attach connection");
 }
 
 
-void Game::OnSessionRead(size_t client_id, std::string_view input_message, std::chrono::milliseconds const& elapsed_from_output)
+bool Game::OnSessionRead(size_t client_id, std::string_view input_message, std::chrono::nanoseconds elapsed_from_output)
 {
     assert(client_id < clients_.size());
 
@@ -128,11 +160,16 @@ void Game::OnSessionRead(size_t client_id, std::string_view input_message, std::
 
         case Client::State::kDC: {
             // receive dc_ok message
-            auto const jin = json::parse(std::move(input_message));
-            CheckCommand(client_id, jin, "dc_ok"sv);
+            // 高速パーサーで読めない場合は，通常のJSONパーサーで読み直す(エラーはこちらで検出する)
+            if (DCOkMessage dc_ok; TryParseDCOk(input_message, dc_ok)) {
+                clients_[client_id].name = dc_ok.name;
+            } else {
+                auto const jin = json::parse(std::move(input_message));
+                CheckCommand(client_id, jin, "dc_ok"sv);
 
-            // input name
-            clients_[client_id].name = jin.at("name").get<std::string>();
+                // input name
+                clients_[client_id].name = jin.at("name").get<std::string>();
+            }
 
             // update state
             clients_[client_id].state = Client::State::kReady;
@@ -140,20 +177,24 @@ void Game::OnSessionRead(size_t client_id, std::string_view input_message, std::
             LogInfoClient(client_id, "dc_ok");
 
             // deliver is_ready
-            json_is_ready_["team"] = static_cast<dc::Team>(client_id);
-            server_.DeliverMessage(client_id, json_is_ready_.dump());
+            transport_.DeliverMessage(client_id, templates_->is_ready.Render({ json(static_cast<dc::Team>(client_id)).dump() }), std::nullopt);
             break;
         }
 
         case Client::State::kReady: {
             // receive ready_ok
-            json const jin = json::parse(std::move(input_message));
-            CheckCommand(client_id, jin, "ready_ok"sv);
-
-            // input player_order
             assert(clients_[client_id].player_order.empty());
-            for (auto const& j_player_idx : jin.at("player_order")) {
-                clients_[client_id].player_order.emplace_back(j_player_idx.get<size_t>());
+            if (ReadyOkMessage ready_ok; TryParseReadyOk(input_message, ready_ok)) {
+                clients_[client_id].player_order.assign(
+                    ready_ok.player_order.begin(), ready_ok.player_order.begin() + ready_ok.player_order_size);
+            } else {
+                json const jin = json::parse(std::move(input_message));
+                CheckCommand(client_id, jin, "ready_ok"sv);
+
+                // input player_order
+                for (auto const& j_player_idx : jin.at("player_order")) {
+                    clients_[client_id].player_order.emplace_back(j_player_idx.get<size_t>());
+                }
             }
             if (clients_[client_id].player_order.size() != clients_[client_id].players.size()) {
                 ThrowRuntimeError(client_id, "invalid player_order size");
@@ -185,7 +226,7 @@ void Game::OnSessionRead(size_t client_id, std::string_view input_message, std::
                 // Gameログへの記録を開始する(この時点でファイルが作成される)
 
                 // Gameログにdcコマンドを書き出す
-                Log::Game(json_dc_);
+                Log::Game(game_log_, json_dc_);
 
                 // meta spec (コンピュータの情報)
                 {
@@ -195,7 +236,7 @@ void Game::OnSessionRead(size_t client_id, std::string_view input_message, std::
                         { "host_name", boost::asio::ip::host_name() }
                     };
 
-                    Log::Game(json_meta_spec);
+                    Log::Game(game_log_, json_meta_spec);
                 }
 
                 // meta config (入力されたコンフィグの内容と再現用の完全な設定をGameログに書き出す)
@@ -222,7 +263,7 @@ void Game::OnSessionRead(size_t client_id, std::string_view input_message, std::
                     // config_allに書き出す
                     json_meta_config["config_all"] = config_;
 
-                    Log::Game(json_meta_config);
+                    Log::Game(game_log_, json_meta_config);
                 }
 
                 // Gameログ: dc_ok
@@ -233,14 +274,19 @@ void Game::OnSessionRead(size_t client_id, std::string_view input_message, std::
                     for (size_t i = 0; i < 2; ++i) {
                         json_dc_ok["name"] = clients_[i].name;
                         json_dc_ok["team"] = static_cast<dc::Team>(i);
-                        Log::Game(json_dc_ok);
+                        Log::Game(game_log_, json_dc_ok);
                     }
                 }
 
                 // Gameログにis_readyコマンドを書き出す
                 // ただし，"team"の内容はnullとしておく
-                json_is_ready_["team"] = nullptr;
-                Log::Game(json_is_ready_);
+                {
+                    json const json_is_ready{
+                        { "cmd", "is_ready" },
+                        { "game", config_.game_is_ready },
+                        { "team", nullptr } };
+                    Log::Game(game_log_, json_is_ready);
+                }
 
                 // ready_ok
                 {
@@ -250,7 +296,7 @@ void Game::OnSessionRead(size_t client_id, std::string_view input_message, std::
                     for (size_t i = 0; i < 2; ++i) {
                         json_ready_ok["team"] = static_cast<dc::Team>(i);
                         json_ready_ok["player_order"] = clients_[i].player_order;
-                        Log::Game(json_ready_ok);
+                        Log::Game(game_log_, json_ready_ok);
                     }
                 }
                 
@@ -263,7 +309,7 @@ void Game::OnSessionRead(size_t client_id, std::string_view input_message, std::
                     jout_new_game["name"][dc::ToString(static_cast<dc::Team>(i))] = clients_[i].name;
                 }
 
-                Log::Game(jout_new_game);
+                Log::Game(game_log_, jout_new_game);
                 
                 {
                     std::ostringstream buf;
@@ -273,8 +319,14 @@ void Game::OnSessionRead(size_t client_id, std::string_view input_message, std::
                     Log::Info(buf.str());
                 }
 
+                in_progress_ = true;
+                Metrics::Add(Metrics::Counter::kGamesStarted);
+                Metrics::Add(Metrics::Gauge::kRunningGames, 1);
+
+                SharedMessage const new_game_message = templates_->new_game.Render({
+                    json(clients_[0].name).dump(), json(clients_[1].name).dump() });
                 for (size_t i = 0; i < clients_.size(); ++i) {
-                    server_.DeliverMessage(i, jout_new_game.dump());
+                    transport_.DeliverMessage(i, new_game_message, std::nullopt);
                 }
 
                 DeliverUpdateMessage();
@@ -284,11 +336,23 @@ void Game::OnSessionRead(size_t client_id, std::string_view input_message, std::
         }
 
         case Client::State::kMyTurn: {
-            // receive move
-            json const jin = json::parse(std::move(input_message));
-            CheckCommand(client_id, jin, "move"sv);
+            // receive move (or hint)
+            MoveMessage move;
+            if (!TryParseMove(input_message, move)) {
+                json const jin = json::parse(std::move(input_message));
+                if (jin.at("cmd").get<std::string>() == "hint") {
+                    OnHint(client_id, jin);
+                    return false;  // moveを待ち続ける
+                }
+                CheckCommand(client_id, jin, "move"sv);
+                move.move = jin.at("move").get<dc::Move>();
+            }
 
-            DoApplyMove(client_id, jin.at("move").get<dc::Move>(), elapsed_from_output);
+            if (timing_) {
+                timing_->Record(TimingPhase::kThinkTime, elapsed_from_output);
+            }
+
+            DoApplyMove(client_id, std::move(move.move), std::chrono::duration_cast<std::chrono::milliseconds>(elapsed_from_output));
             DeliverUpdateMessage();
 
             break;
@@ -310,6 +374,37 @@ void Game::OnSessionRead(size_t client_id, std::string_view input_message, std::
         default:
             assert(false);
     }
+
+    return true;
+}
+
+void Game::OnHint(size_t client_id, nlohmann::json const& jin)
+{
+    // 事前シミュレーションが無効な場合は読み捨てる
+    if (!speculation_) {
+        return;
+    }
+
+    // hint は任意の助言なので，不正な hint で試合を止めずに読み捨てる
+    std::vector<dc::moves::Shot> shots;
+    try {
+        for (auto const& j_move : jin.at("moves")) {
+            auto const hinted_move = j_move.get<dc::Move>();
+            if (std::holds_alternative<dc::moves::Shot>(hinted_move)) {
+                shots.emplace_back(std::get<dc::moves::Shot>(hinted_move));
+            }
+        }
+    } catch (std::exception & e) {
+        std::ostringstream buf;
+        buf << "client " << client_id << ": invalid hint is ignored: " << e.what();
+        Log::Warning(buf.str());
+        return;
+    }
+
+    auto const& client = clients_[client_id];
+    auto const& player = client.players[client.player_order[game_state_.shot / 4]];
+    speculation_->Start(config_.game.setting, game_state_, *simulator_, *player, shots,
+        config_.server.steps_per_trajectory_frame, config_.server.trajectory_tolerance);
 }
 
 
@@ -318,6 +413,7 @@ void Game::OnSessionTimeout(size_t client_id)
     switch (clients_.at(client_id).state) {
         case Client::State::kMyTurn: {
             LogInfoClient(client_id, "time limit expired");
+            Metrics::Add(Metrics::Counter::kTimeouts);
 
             // 制限時間切れにより負け．
             DoApplyMove(client_id, dc::moves::Concede(), std::chrono::milliseconds::max());  // ここのコンシードはダミーです．
@@ -340,6 +436,49 @@ void Game::OnSessionStop(size_t client_id)
     // 正常なタイミングの終了の場合，特にすることは無い．
 }
 
+void Game::OnSessionWritten(size_t /* client_id */, std::chrono::nanoseconds elapsed)
+{
+    if (timing_) {
+        timing_->Record(TimingPhase::kSocketWrite, elapsed);
+    }
+}
+
+void Game::Stop()
+{
+    update_timer_.cancel();
+
+    if (in_progress_) {
+        in_progress_ = false;
+        Metrics::Add(Metrics::Counter::kGamesAborted);
+        Metrics::Add(Metrics::Gauge::kRunningGames, -1);
+    }
+
+    // 途中で停止した試合も，それまでの計測結果を残す
+    LogTiming();
+}
+
+void Game::LogTiming()
+{
+    // 最初の更新メッセージの前は試合ログを開始していない
+    if (!timing_ || timing_logged_ || !last_update_message_derivery_) {
+        return;
+    }
+    timing_logged_ = true;
+
+    json const json_meta_timing{
+        { "cmd", "meta" },
+        { "meta", "timing" },
+        { "timing", *timing_ },
+    };
+    Log::Game(game_log_, json_meta_timing);
+}
+
+bool Game::IsGameOver() const
+{
+    return clients_[0].state == Client::State::kGameOver
+        && clients_[1].state == Client::State::kGameOver;
+}
+
 void Game::DoApplyMove(size_t moved_client_id, digitalcurling3::Move && move, std::chrono::milliseconds const& elapsed)
 {
     dc::Team const moved_team = game_state_.GetNextTeam();
@@ -352,7 +491,7 @@ void Game::DoApplyMove(size_t moved_client_id, digitalcurling3::Move && move, st
             { "move", move },
             { "team", static_cast<dc::Team>(moved_client_id) }
         };
-        Log::Game(j_move);
+        Log::Game(game_log_, j_move);
     }
 
     // 現在のショット番号から投げるプレイヤーのインデックス(0: リード, 1: セカンド, 2: サード, 3: フォース を意味する)を得る
@@ -369,41 +508,111 @@ void Game::DoApplyMove(size_t moved_client_id, digitalcurling3::Move && move, st
     auto const player_storage = player->CreateStorage();
     auto const simulator_storage = simulator_->CreateStorage();
 
+    // hint により事前シミュレーション済みの手であれば，その結果を再生する．
+    // ApplyMove() に渡すストーンが事前シミュレーションと一致しない場合(プレイヤーによる手の変化が異なる場合など)は通常通りシミュレーションする．
+    std::shared_ptr<Speculation::Result const> speculation_result;
+    if (speculation_ && std::holds_alternative<dc::moves::Shot>(move)) {
+        speculation_result = speculation_->Find(game_state_, std::get<dc::moves::Shot>(move));
+    }
+    std::optional<SpeculativeSimulator> speculative_simulator;
+    if (speculation_result) {
+        speculative_simulator.emplace(*speculation_result, *simulator_);
+    }
+
     // trajectoryを送信しない場合でもログには軌跡を残すため，TrajectoryCompressorは必ず必要になる．
-    compressor_.Begin(config_.server.steps_per_trajectory_frame, game_state_.end);
+    compressor_.Begin(config_.server.steps_per_trajectory_frame, game_state_.end, config_.server.trajectory_tolerance);
 
     dc::ApplyMoveResult apply_move_result;
-    dc::ApplyMove(
-        config_.game.setting,
-        *simulator_,
-        *player,
-        game_state_,
-        move,
-        elapsed,
-        &apply_move_result,
-        [this](dc::ISimulator const& simulator) { compressor_.OnStep(simulator); });
-
-    compressor_.End(*simulator_);
+    std::chrono::steady_clock::duration compress_elapsed(0);  // 計測が有効な場合のみ使う
+    {
+        // シミュレーション時間はメトリクスにも使うため，計測の有効無効によらず測る
+        auto const start = std::chrono::steady_clock::now();
+        dc::ApplyMove(
+            config_.game.setting,
+            speculative_simulator ? static_cast<dc::ISimulator &>(*speculative_simulator) : *simulator_,
+            *player,
+            game_state_,
+            move,
+            elapsed,
+            &apply_move_result,
+            [this, &compress_elapsed, &speculative_simulator](dc::ISimulator const& simulator)
+            {
+                if (speculative_simulator && speculative_simulator->IsReplaying()) {
+                    return;  // 軌跡は事前シミュレーションで作成済み
+                }
+                if (timing_) {
+                    auto const start = std::chrono::steady_clock::now();
+                    compressor_.OnStep(simulator);
+                    compress_elapsed += std::chrono::steady_clock::now() - start;
+                } else {
+                    compressor_.OnStep(simulator);
+                }
+            });
+        auto const apply_move_elapsed = std::chrono::steady_clock::now() - start;
+        if (timing_) {
+            timing_->Record(TimingPhase::kApplyMove, apply_move_elapsed);
+        }
+        Metrics::Add(Metrics::Counter::kShots);
+        Metrics::Add(Metrics::Counter::kSimulationNanoseconds,
+            static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(apply_move_elapsed).count()));
+    }
+
+    TrajectoryCompressor::Result const* trajectory = nullptr;
+    if (speculative_simulator && speculative_simulator->IsReplaying()) {
+        // シミュレータを事前シミュレーション終了後の状態にする
+        simulator_->Load(*speculation_result->final_storage);
+        trajectory = &speculation_result->trajectory;
+        Metrics::Add(Metrics::Counter::kSpeculationHits);
+    } else {
+        if (timing_) {
+            auto const start = std::chrono::steady_clock::now();
+            compressor_.End(*simulator_);
+            compress_elapsed += std::chrono::steady_clock::now() - start;
+            timing_->Record(TimingPhase::kTrajectoryCompress, compress_elapsed);
+        } else {
+            compressor_.End(*simulator_);
+        }
+        trajectory = &compressor_.GetResult();
+    }
+
+    // 試合の状態が変わったため，事前シミュレーションの結果は使えなくなる
+    if (speculation_) {
+        speculation_->Clear();
+    }
 
     last_move_has_value_ = true;
     last_move_free_guard_zone_foul_ = apply_move_result.free_guard_zone_foul;
 
+    // 軌跡は更新メッセージとショットログで共有するため，1度だけシリアライズする
+    {
+        ScopedTiming const timing(timing_.get(), TimingPhase::kTrajectorySerialize);
+        last_move_trajectory_.clear();
+        WriteTrajectoryJson(last_move_trajectory_, *trajectory, config_.server.trajectory_format);
+    }
+    last_move_actual_move_ = json(move).dump();
+
     // ショットログの構築
+    // キーはソートされて出力され "trajectory" が最後になるので，軌跡は末尾に直接書き込む
     {
-        json json_shot = {
+        ScopedTiming const timing(timing_.get(), TimingPhase::kShotLog);
+        json const json_shot = {
             { "game_id", game_id_ },
             { "game_date_time", date_time_ },
             { "end", move_end },
             { "shot", move_shot },
             { "selected_move", selected_move },
             { "actual_move", move },
+            { "elapsed_ms", elapsed.count() },  // 思考時間．リプレイで ApplyMove() を再現するのに用いる
             { "player_storage",  *player_storage },
-            { "simulator_storage",  *simulator_storage },
-            { "trajectory", compressor_.GetResult() }
+            { "simulator_storage",  *simulator_storage }
         };
-        Log::Shot(json_shot, move_end, move_shot);
-        json_last_move_actual_move_.swap(json_shot.at("actual_move"));
-        json_last_move_trajectory_.swap(json_shot.at("trajectory"));
+        std::string shot_text = json_shot.dump();
+        assert(shot_text.back() == '}');
+        shot_text.pop_back();
+        shot_text += R"(,"trajectory":)";
+        shot_text += last_move_trajectory_;
+        shot_text += '}';
+        Log::ShotSerialized(game_log_, shot_text, move_end, move_shot);
     }
 
     // スコア表示
@@ -435,55 +644,120 @@ void Game::DoApplyMove(size_t moved_client_id, digitalcurling3::Move && move, st
 void Game::DeliverUpdateMessage()
 {
     // 高速に通信すると通信が切断されてしまうため、
-    // 前回の DeliverUpdateMessage から一定時間以上経つまでsleepをかける。
+    // 前回の更新メッセージの送信から一定時間以上経つまで送信を遅らせる。
+    // スレッドを止めないよう，待機にはタイマーを用いる。
     if (config_.server.update_interval.count() > 0 && last_update_message_derivery_.has_value()) {
-        auto const now = std::chrono::steady_clock::now();
-        auto const sleep_time = config_.server.update_interval
-            - std::chrono::duration_cast<std::chrono::milliseconds>(now - *last_update_message_derivery_);
+        auto const deliver_time = *last_update_message_derivery_ + config_.server.update_interval;
+
+        if (deliver_time > std::chrono::steady_clock::now()) {
+            // 送信するまではどちらのクライアントからの入力も受け付けない
+            for (auto & client : clients_) {
+                client.state = Client::State::kOpponentTurn;
+            }
+
+            update_timer_.expires_at(deliver_time);
+            update_timer_.async_wait(
+                [this](boost::system::error_code const& error)
+                {
+                    if (error) {  // キャンセルされた( Game は破棄されている可能性がある)
+                        return;
+                    }
 
-        if (sleep_time.count() > 0) {
-            std::this_thread::sleep_for(sleep_time);
+                    try {
+                        DoDeliverUpdateMessage();
+                    } catch (std::exception & e) {
+                        transport_.OnGameError(e);
+                    }
+                });
+            return;
         }
     }
+
+    DoDeliverUpdateMessage();
+}
+
+void Game::DoDeliverUpdateMessage()
+{
     last_update_message_derivery_ = std::chrono::steady_clock::now();
 
-    json json_update = {
-        { "cmd", "update" },
-        { "next_team", game_state_.GetNextTeam() },
-        { "state", game_state_ }
-    };
-    json & json_update_last_move = json_update["last_move"];
+    // ログへの出力は別に計測するため，構築が終わった時点で計測を止める
+    std::optional<ScopedTiming> serialize_timing(std::in_place, timing_.get(), TimingPhase::kUpdateSerialize);
 
+    // 更新メッセージを直接文字列として組み立てる．
+    // キーの順序は nlohmann::json で出力した場合と同じ(ソート順)にする．
+    //   {"cmd":"update","last_move":{"actual_move":...,"free_guard_zone_foul":...[,"trajectory":...]},"next_team":...,"state":...}
+    // ログには軌跡を含めないため， last_move の途中で head と tail に分けておく．
+    update_head_.assign(R"({"cmd":"update","last_move":)");
     if (last_move_has_value_) {
-        json_update_last_move["actual_move"].swap(json_last_move_actual_move_);
-        json_update_last_move["free_guard_zone_foul"] = last_move_free_guard_zone_foul_;
+        update_head_ += R"({"actual_move":)";
+        update_head_ += last_move_actual_move_;
+        update_head_ += R"(,"free_guard_zone_foul":)";
+        update_head_ += last_move_free_guard_zone_foul_ ? "true"sv : "false"sv;
+    } else {
+        update_head_ += "null"sv;
     }
 
-    Log::Game(json_update);
+    update_tail_.clear();
+    if (last_move_has_value_) {
+        update_tail_ += '}';
+    }
+    update_tail_ += R"(,"next_team":)";
+    update_tail_ += json(game_state_.GetNextTeam()).dump();
+    update_tail_ += R"(,"state":)";
+    update_tail_ += json(game_state_).dump();
+    update_tail_ += '}';
+
+    constexpr auto kTrajectoryKey = R"(,"trajectory":)"sv;
+    bool const with_trajectory = last_move_has_value_ && config_.server.send_trajectory;
+    std::string message_text;
+    message_text.reserve(update_head_.size() + update_tail_.size()
+        + (with_trajectory ? kTrajectoryKey.size() + last_move_trajectory_.size() : 0) + 1);
+    message_text += update_head_;
+    if (with_trajectory) {
+        message_text += kTrajectoryKey;
+        message_text += last_move_trajectory_;
+    }
+    message_text += update_tail_;
 
-    if (last_move_has_value_ && config_.server.send_trajectory) {
-        json_update_last_move["trajectory"].swap(json_last_move_trajectory_);
+    serialize_timing.reset();
+
+    // ログには軌跡を含めない
+    {
+        ScopedTiming const timing(timing_.get(), TimingPhase::kUpdateLog);
+        std::string log_text;
+        log_text.reserve(update_head_.size() + update_tail_.size());
+        log_text += update_head_;
+        log_text += update_tail_;
+        Log::GameSerialized(game_log_, log_text);
     }
 
-    auto update_message = json_update.dump();
+    SharedMessage const update_message(std::move(message_text));  // 両クライアントで共有する
 
     if (game_state_.game_result) {
         for (auto & client : clients_) {
             client.state = Client::State::kGameOver;
         }
-        server_.DeliverMessage(0, std::string(update_message));
-        server_.DeliverMessage(1, std::move(update_message));
+        transport_.DeliverMessage(0, update_message, std::nullopt);
+        transport_.DeliverMessage(1, update_message, std::nullopt);
 
         // deliver game_over message
         json const jout_game_over = {
             {"cmd", "game_over"}
         };
-        Log::Game(jout_game_over);
+        Log::Game(game_log_, jout_game_over);
+
+        LogTiming();
+
+        if (in_progress_) {
+            in_progress_ = false;
+            Metrics::Add(Metrics::Counter::kGamesFinished);
+            Metrics::Add(Metrics::Gauge::kRunningGames, -1);
+        }
 
-        auto game_over_message = jout_game_over.dump();
+        SharedMessage const game_over_message(jout_game_over.dump());
 
-        server_.DeliverMessage(0, std::string(game_over_message));
-        server_.DeliverMessage(1, std::move(game_over_message));
+        transport_.DeliverMessage(0, game_over_message, std::nullopt);
+        transport_.DeliverMessage(1, game_over_message, std::nullopt);
 
         std::ostringstream buf;
         buf << "game over\nwin: " << dc::ToString(game_state_.game_result->winner);
@@ -495,8 +769,8 @@ void Game::DeliverUpdateMessage()
         clients_[static_cast<size_t>(next_turn_client)].state = Client::State::kMyTurn;
         clients_[static_cast<size_t>(opponent_next_turn)].state = Client::State::kOpponentTurn;
 
-        server_.DeliverMessage(static_cast<size_t>(next_turn_client), std::string(update_message), game_state_.thinking_time_remaining[static_cast<size_t>(next_turn_client)]);
-        server_.DeliverMessage(static_cast<size_t>(opponent_next_turn), std::move(update_message));
+        transport_.DeliverMessage(static_cast<size_t>(next_turn_client), update_message, game_state_.thinking_time_remaining[static_cast<size_t>(next_turn_client)]);
+        transport_.DeliverMessage(static_cast<size_t>(opponent_next_turn), update_message, std::nullopt);
 
 
         // コマンドラインに出力
@@ -25,24 +25,67 @@
 
 #include <memory>
 #include <array>
+#include <boost/asio/steady_timer.hpp>
 #include "digitalcurling3/digitalcurling3.hpp"
 #include "config.hpp"
+#include "game_transport.hpp"
+#include "log.hpp"
+#include "message_template.hpp"
+#include "shared_message.hpp"
+#include "speculation.hpp"
+#include "timing.hpp"
 #include "trajectory_compressor.hpp"
 
 namespace digitalcurling3_server {
 
-class Server;
-
 class Game {
 public:
-    Game(Server & server, Config && config, std::string const& date_time, std::string const& game_id);
+    Game(GameTransport & transport, Config && config, std::string const& date_time, std::string const& game_id,
+        boost::filesystem::path const& game_log_directory, std::shared_ptr<GameMessageTemplates const> const& templates);
+    ~Game();
 
     void OnSessionStart(size_t client_id);
-    void OnSessionRead(size_t client_id, std::string_view input_message, std::chrono::milliseconds const& elapsed_from_output);
+
+    /// \brief dcの送信を済ませたセッションを開始する
+    ///
+    /// ホスティングモードでは試合が決まる前にdcを送信するため， OnSessionStart() の代わりにこちらを呼び出す．
+    /// 以降，クライアントはdc_okの受信待ちとなる．
+    void OnSessionAttach(size_t client_id);
+
+    /// \brief クライアントからのメッセージを処理する
+    ///
+    /// \param client_id クライアントID
+    /// \param input_message 受信したメッセージ
+    /// \param elapsed_from_output 最後にメッセージを送信してから受信するまでの時間(思考時間の計測に使うため丸めずに渡す)
+    /// \return 待っていた応答を受信した場合は \c true ．
+    ///         hint のように応答ではないメッセージの場合は \c false (入力タイムアウトは継続する)
+    bool OnSessionRead(size_t client_id, std::string_view input_message, std::chrono::nanoseconds elapsed_from_output);
     void OnSessionTimeout(size_t client_id);
     void OnSessionStop(size_t client_id);
 
+    /// \brief メッセージのソケットへの書き込みが完了した
+    ///
+    /// \param client_id クライアントID
+    /// \param elapsed 書き込みの開始から完了までの時間
+    void OnSessionWritten(size_t client_id, std::chrono::nanoseconds elapsed);
+
+    /// \brief 送信待ちの更新メッセージを取り消す
+    ///
+    /// サーバー停止時に呼び出す．
+    void Stop();
+
     Config const& GetConfig() const { return config_; }
+    GameLog & GetGameLog() { return game_log_; }
+    digitalcurling3::GameState const& GetGameState() const { return game_state_; }
+
+    /// \brief 試合が終了し，両方のクライアントに結果を送信済みか
+    bool IsGameOver() const;
+
+    /// \brief 処理時間の計測結果を試合ログに出力する
+    ///
+    /// 試合終了時と，試合の途中でサーバーが停止した場合に呼び出される．
+    /// 計測が無効な場合や，試合ログへの記録を開始する前は何もしない．
+    void LogTiming();
 
 private:
     struct Client {
@@ -61,13 +104,15 @@ private:
         std::vector<size_t> player_order;
     };
 
-    Server & server_;
+    GameTransport & transport_;
     Config config_;
     std::string const date_time_;
     std::string const game_id_;
+    GameLog game_log_;
 
-    nlohmann::json const json_dc_;
-    nlohmann::json json_is_ready_;
+    std::shared_ptr<GameMessageTemplates const> const templates_;
+    nlohmann::json const json_dc_;  // 試合ログ用
+    SharedMessage const dc_message_;
 
     std::array<Client, 2> clients_;
 
@@ -77,13 +122,24 @@ private:
     TrajectoryCompressor compressor_;
     bool last_move_has_value_;
     bool last_move_free_guard_zone_foul_;
-    nlohmann::json json_last_move_actual_move_;
-    nlohmann::json json_last_move_trajectory_;
+    std::string last_move_actual_move_;  // シリアライズ済み
+    std::string last_move_trajectory_;   // シリアライズ済み
+    std::string update_head_;  // 更新メッセージの構築用(ショットごとに再利用する)
+    std::string update_tail_;  // 同上
 
     std::optional<std::chrono::steady_clock::time_point> last_update_message_derivery_;
+    boost::asio::steady_timer update_timer_;  // update_interval による送信の待機用
+
+    std::unique_ptr<Speculation> speculation_;  // 事前シミュレーションが無効な場合は nullptr
+    std::unique_ptr<GameTiming> timing_;  // 計測が無効な場合は nullptr
+    std::uint64_t timing_id_;  // TimingRegistry に登録したID
+    bool timing_logged_;
+    bool in_progress_;  // new_gameの送信から試合終了(または中断)まで．メトリクス用
 
+    void OnHint(size_t client_id, nlohmann::json const& jin);
     void DoApplyMove(size_t moving_client_id, digitalcurling3::Move && move, std::chrono::milliseconds const& elapsed);
     void DeliverUpdateMessage();
+    void DoDeliverUpdateMessage();
 };
 
 
@@ -0,0 +1,64 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_GAME_TRANSPORT_HPP
+#define DIGITALCURLING3_SERVER_GAME_TRANSPORT_HPP
+
+#include <chrono>
+#include <exception>
+#include <optional>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
+#include "shared_message.hpp"
+
+namespace digitalcurling3_server {
+
+/// \brief Game からクライアントへの出力先
+///
+/// TCPで接続したクライアントと対戦する Server と，プロセス内のエンジン同士を対戦させる Batch の試合が実装する．
+/// Game の関数は全て GetStrand() 上で呼び出される．
+class GameTransport {
+public:
+    using Strand = boost::asio::strand<boost::asio::io_context::executor_type>;
+
+    virtual ~GameTransport() = default;
+
+    /// \brief この試合のストランド
+    virtual Strand const& GetStrand() const = 0;
+
+    /// \brief メッセージを送信する
+    ///
+    /// \param client_id 送信先クライアントID
+    /// \param message 送信するメッセージ．バッファは送信完了まで共有される．
+    /// \param input_timeout タイムアウトまでの時間( \c std::nullopt で制限時間無し)
+    virtual void DeliverMessage(size_t client_id, SharedMessage const& message,
+        std::optional<std::chrono::milliseconds> const& input_timeout) = 0;
+
+    /// \brief Game のタイマーのハンドラで発生したエラーを処理する
+    ///
+    /// \param e 発生した例外
+    virtual void OnGameError(std::exception & e) = 0;
+};
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_GAME_TRANSPORT_HPP
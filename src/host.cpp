@@ -0,0 +1,409 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "host.hpp"
+#include <vector>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+#include "log.hpp"
+#include "util.hpp"
+
+namespace digitalcurling3_server {
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+inline void LogWarningConnection(size_t client_id, std::string_view message)
+{
+    std::ostringstream buf;
+    buf << "connection (team " << client_id << "): " << message;
+    Log::Warning(buf.str());
+}
+
+} // unnamed namespace
+
+
+/// \brief 試合が決まるまでの接続
+///
+/// dcを送信し，dc_okの "match_id" を受信したら Host::OnConnectionReady() にソケットを引き渡す．
+/// ハンドラは Host のストランド上で実行される．
+class Host::Connection : public std::enable_shared_from_this<Host::Connection> {
+public:
+    Connection(Host & host, tcp::socket && socket, size_t client_id)
+        : host_(host)
+        , socket_(std::move(socket))
+        , client_id_(client_id)
+        , input_buffer_()
+        , deadline_(host.strand_)
+        , written_(false)
+        , match_id_()
+    {}
+
+    void Start()
+    {
+        host_.connections_.emplace(this, weak_from_this());
+
+        deadline_.expires_after(host_.config_.server.timeout_dc_ok);
+        deadline_.async_wait(
+            [this, self = shared_from_this()](boost::system::error_code const& error)
+            {
+                if (error || !socket_.is_open()) {  // キャンセルされたか，引き渡し済み
+                    return;
+                }
+                Close("dc_ok timed out");
+            });
+
+        {
+            Log::Trace(Log::kServer, Log::Client(client_id_), host_.dc_message_.GetLine());
+        }
+
+        boost::asio::async_write(socket_,
+            boost::asio::buffer(host_.dc_message_.GetData()),
+            boost::asio::bind_executor(host_.strand_, [this, self = shared_from_this()](boost::system::error_code const& error, std::size_t /* n */)
+            {
+                if (!socket_.is_open()) {
+                    return;
+                }
+
+                if (error) {
+                    std::ostringstream buf;
+                    buf << "write failed (error code: " << error.value() << ")";
+                    Close(buf.str());
+                    return;
+                }
+
+                written_ = true;
+                TryHandOff();
+            }));
+
+        // 改行を含めて max_line_length + 1 バイトまでに制限する
+        boost::asio::async_read_until(socket_,
+            boost::asio::dynamic_buffer(input_buffer_, host_.config_.server.max_line_length + 1), '\n',
+            boost::asio::bind_executor(host_.strand_, [this, self = shared_from_this()](boost::system::error_code const& error, std::size_t n)
+            {
+                if (!socket_.is_open()) {
+                    return;
+                }
+
+                if (error == boost::asio::error::not_found) {
+                    std::ostringstream buf;
+                    buf << "input line is too long (max: " << host_.config_.server.max_line_length << " bytes)";
+                    Close(buf.str());
+                    return;
+                }
+
+                if (error) {
+                    std::ostringstream buf;
+                    buf << "disconnected before dc_ok (error code: " << error.value() << ")";
+                    Close(buf.str());
+                    return;
+                }
+
+                // dc_okのみ解釈する．dc_ok自体はバッファに残しておき，試合側のセッションで改めて読み取る．
+                try {
+                    auto const jin = nlohmann::json::parse(std::string_view(input_buffer_.c_str(), n - 1));
+                    if (jin.at("cmd").get<std::string>() != "dc_ok") {
+                        throw std::runtime_error("unexpected command (expected: \"dc_ok\")");
+                    }
+                    match_id_ = jin.at("match_id").get<std::string>();
+                } catch (std::exception & e) {
+                    Close(e.what());
+                    return;
+                }
+
+                TryHandOff();
+            }));
+    }
+
+    /// \brief サーバーの停止により接続を閉じる
+    void Stop()
+    {
+        if (socket_.is_open()) {
+            Close("server stopped");
+        }
+    }
+
+private:
+    Host & host_;
+    tcp::socket socket_;
+    size_t const client_id_;
+    std::string input_buffer_;
+    boost::asio::steady_timer deadline_;
+    bool written_;
+    std::optional<std::string> match_id_;
+
+    void TryHandOff()
+    {
+        // dcの送信とdc_okの受信の両方が完了するまで待つ
+        if (!written_ || !match_id_) return;
+
+        deadline_.cancel();
+        host_.connections_.erase(this);
+        host_.OnConnectionReady(client_id_, *match_id_, std::move(socket_), std::move(input_buffer_));
+    }
+
+    void Close(std::string_view reason)
+    {
+        LogWarningConnection(client_id_, reason);
+        boost::system::error_code ignored_error;
+        socket_.close(ignored_error);
+        deadline_.cancel();
+        host_.connections_.erase(this);
+    }
+};
+
+
+Host::Host(boost::asio::io_context & io_context, Config && config, std::string const& launch_time,
+    boost::filesystem::path const& log_directory, std::optional<tcp::endpoint> const& metrics_endpoint)
+    : io_context_(io_context)
+    , strand_(boost::asio::make_strand(io_context))
+    , config_(std::move(config))
+    , log_directory_(log_directory)
+    , templates_(GameMessageTemplates::Create(config_))
+    // 試合はdc_okの受信後に決まるため，game_idは空文字列とする．
+    // 試合ログには試合ごとのgame_idを含むdcが記録される．
+    , dc_message_(templates_->dc.Render({ nlohmann::json("").dump(), nlohmann::json(launch_time).dump() }))
+    , acceptors_()
+    , signals_(io_context, SIGINT, SIGTERM)
+    , metrics_server_()
+    , games_()
+    , connections_()
+    , stopped_(false)
+{
+    if (metrics_endpoint) {
+        metrics_server_.emplace(io_context_, *metrics_endpoint);
+    }
+
+    for (size_t i = 0; i < 2; ++i) {
+        acceptors_[i].emplace(io_context_, tcp::endpoint(tcp::v4(), config_.server.port[i]));
+        Accept(i);
+    }
+
+    signals_.async_wait(
+        boost::asio::bind_executor(strand_, [this](boost::system::error_code const& error, int /* signal_number */)
+        {
+            if (error) return;
+            Log::Info("signal received. stopping all games.");
+            Stop();
+        }));
+}
+
+void Host::Stop()
+{
+    if (stopped_) return;
+    stopped_ = true;
+
+    for (auto & acceptor : acceptors_) {
+        acceptor->cancel();
+    }
+
+    boost::system::error_code ignored_error;
+    signals_.cancel(ignored_error);
+
+    if (metrics_server_) {
+        metrics_server_->Stop();
+    }
+
+    // 試合の決まっていない接続のタイマーと読み込みが io_context を止めないよう閉じる．
+    // 閉じると connections_ から削除されるため，複製してから走査する．
+    std::vector<std::shared_ptr<Connection>> connections;
+    for (auto const& [pointer, connection] : connections_) {
+        if (auto locked = connection.lock()) {
+            connections.emplace_back(std::move(locked));
+        }
+    }
+    for (auto const& connection : connections) {
+        connection->Stop();
+    }
+    connections_.clear();
+
+    // 試合の停止は試合のストランド上で行う
+    for (auto & [match_id, match] : games_) {
+        if (match.join_deadline) {
+            match.join_deadline->cancel();
+        }
+        boost::asio::post(match.server->GetStrand(), [server = match.server] { server->Stop(); });
+    }
+
+    Log::Debug("host stopped");
+}
+
+void Host::Accept(size_t client_id)
+{
+    acceptors_[client_id]->async_accept(
+        boost::asio::bind_executor(strand_, [this, client_id](boost::system::error_code const& error, tcp::socket && socket)
+        {
+            if (stopped_) {
+                return;
+            }
+
+            if (error) {
+                std::ostringstream buf;
+                buf << "accept failed (error code: " << error.value() << ")";
+                LogWarningConnection(client_id, buf.str());
+            } else {
+                std::make_shared<Connection>(*this, std::move(socket), client_id)->Start();
+            }
+
+            Accept(client_id);
+        }));
+}
+
+void Host::StartJoinDeadline(std::string const& match_id, Match & match)
+{
+    match.join_deadline = std::make_unique<boost::asio::steady_timer>(strand_);
+    match.join_deadline->expires_after(config_.server.timeout_join);
+    match.join_deadline->async_wait(
+        [this, match_id, timer = match.join_deadline.get()](boost::system::error_code const& error)
+        {
+            if (error || stopped_) {
+                return;
+            }
+
+            // 完了ハンドラが積まれた後に試合が削除され，同じ match id で作り直されている場合がある
+            auto const it = games_.find(match_id);
+            if (it == games_.end() || it->second.join_deadline.get() != timer
+                || (it->second.attached[0] && it->second.attached[1])) {
+                return;
+            }
+
+            {
+                std::ostringstream buf;
+                buf << "match \"" << match_id << "\": the other team did not join in time. stopping the match.";
+                Log::Warning(buf.str());
+            }
+
+            // 試合の停止は試合のストランド上で行う．停止後に on_finished から登録が削除される．
+            boost::asio::post(it->second.server->GetStrand(), [server = it->second.server] { server->Stop(); });
+        });
+}
+
+void Host::OnConnectionReady(size_t client_id, std::string const& match_id,
+    tcp::socket && socket, std::string && input_buffer)
+{
+    if (stopped_) {
+        return;  // socketはここで閉じられる
+    }
+
+    auto it = games_.find(match_id);
+    if (it == games_.end()) {
+        auto const now = boost::posix_time::second_clock::local_time();
+        auto const game_id = boost::uuids::to_string(boost::uuids::random_generator()());
+        boost::filesystem::path const game_log_directory = [&] {
+            std::ostringstream buf;
+            buf << GetISO8601String(now) << '_' << game_id;
+            return log_directory_ / buf.str();
+        }();
+
+        try {
+            auto server = std::make_shared<Server>(io_context_, config_.Clone(), GetISO8601ExtendedString(now), game_id, game_log_directory, templates_,
+                [this, match_id]
+                {
+                    // 試合のストランドから呼び出されるため，削除は Host のストランドで行う
+                    boost::asio::post(strand_,
+                        [this, match_id]
+                        {
+                            games_.erase(match_id);
+                            std::ostringstream buf;
+                            buf << "match \"" << match_id << "\" finished (running games: " << games_.size() << ")";
+                            Log::Info(buf.str());
+                        });
+                });
+            it = games_.emplace(match_id, Match{ std::move(server), { false, false }, nullptr }).first;
+        } catch (std::exception & e) {
+            std::ostringstream buf;
+            buf << "could not create match \"" << match_id << "\": " << e.what();
+            Log::Error(buf.str());
+            return;
+        }
+
+        std::ostringstream buf;
+        buf << "match \"" << match_id << "\" created\n"
+            << "game id     : " << game_id << '\n'
+            << "game log dir: \"" << game_log_directory.string() << "\"\n"
+            << "running games: " << games_.size();
+        Log::Info(buf.str());
+
+        StartJoinDeadline(match_id, it->second);
+    }
+
+    auto & match = it->second;
+    if (match.attached[client_id]) {
+        std::ostringstream buf;
+        buf << "team " << client_id << " of match \"" << match_id << "\" is already connected";
+        LogWarningConnection(client_id, buf.str());
+        return;
+    }
+    match.attached[client_id] = true;
+
+    if (match.attached[0] && match.attached[1] && match.join_deadline) {
+        match.join_deadline->cancel();
+    }
+
+    boost::asio::post(match.server->GetStrand(),
+        [server = match.server, client_id, socket = std::move(socket), input_buffer = std::move(input_buffer)]() mutable
+        {
+            server->Attach(client_id, std::move(socket), std::move(input_buffer));
+        });
+}
+
+
+void StartHost(Config && config, std::string const& launch_time, boost::filesystem::path const& log_directory, size_t thread_count,
+    std::optional<tcp::endpoint> const& metrics_endpoint)
+{
+    {
+        std::ostringstream buf;
+        buf << "launch time: " << launch_time;
+        Log::Info(buf.str());
+    }
+
+    for (size_t i = 0; i < config.server.port.size(); ++i) {
+        std::ostringstream buf;
+        buf << "team " << i << " port: " << config.server.port[i];
+        Log::Info(buf.str());
+    }
+    Log::Info("Note: Team 1 has the last stone in the first end.");
+    Log::Info("host mode: clients specify the match by \"match_id\" in dc_ok.");
+
+    {
+        std::ostringstream buf;
+        buf << "threads: " << thread_count;
+        Log::Info(buf.str());
+    }
+
+    boost::asio::io_context io_context(static_cast<int>(thread_count));
+    Host host(io_context, std::move(config), launch_time, log_directory, metrics_endpoint);
+
+    Log::Info("server started");
+
+    RunIOContext(io_context, thread_count);
+}
+
+} // namespace digitalcurling3_server
@@ -0,0 +1,100 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_HOST_HPP
+#define DIGITALCURLING3_SERVER_HOST_HPP
+
+#include <array>
+#include <optional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/filesystem.hpp>
+#include "config.hpp"
+#include "message_template.hpp"
+#include "metrics_server.hpp"
+#include "server.hpp"
+
+namespace digitalcurling3_server {
+
+/// \brief 1プロセスで複数の試合をホストする(ホスティングモード)
+///
+/// config.server.port の2つのポートで接続を受け付け続ける．
+/// ポート0に接続したクライアントはチーム0，ポート1に接続したクライアントはチーム1となる．
+/// クライアントはdc_okの "match_id" で試合を指定し，同じ "match_id" を指定した2つのクライアントが対戦する．
+/// 試合は最初のクライアントのdc_okを受信した時点で作成され，終了すると登録から削除される．
+/// config.server.timeout_join 以内にもう一方のクライアントが揃わない試合は停止して削除する．
+///
+/// 接続の受付と試合の登録は Host のストランド上で行い，試合の進行は試合ごとのストランド( Server::GetStrand() )上で行う．
+class Host {
+public:
+    /// \param io_context 使用する io_context
+    /// \param config コンフィグ(試合ごとに複製する)
+    /// \param launch_time 起動時刻
+    /// \param log_directory ログを出力するディレクトリ
+    /// \param metrics_endpoint メトリクスを公開するアドレスとポート( \c std::nullopt で公開しない)
+    Host(boost::asio::io_context & io_context, Config && config, std::string const& launch_time,
+        boost::filesystem::path const& log_directory, std::optional<boost::asio::ip::tcp::endpoint> const& metrics_endpoint);
+    Host(Host const&) = delete;
+    Host & operator = (Host const&) = delete;
+
+    /// \brief 接続の受付を止め，試合の決まっていない接続を閉じ，進行中の全ての試合を停止する
+    ///
+    /// Host のストランド上で呼び出すこと．
+    void Stop();
+
+private:
+    class Connection;
+
+    struct Match {
+        std::shared_ptr<Server> server;
+        std::array<bool, 2> attached;  // クライアントを割り当て済みか
+        std::unique_ptr<boost::asio::steady_timer> join_deadline;  // もう一方のチームの接続待ち．両チームが揃ったら取り消す
+    };
+
+    boost::asio::io_context & io_context_;
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    Config const config_;
+    boost::filesystem::path const log_directory_;
+    std::shared_ptr<GameMessageTemplates const> const templates_;
+    SharedMessage const dc_message_;
+    std::array<std::optional<boost::asio::ip::tcp::acceptor>, 2> acceptors_;
+    boost::asio::signal_set signals_;
+    std::optional<MetricsServer> metrics_server_;
+    std::unordered_map<std::string, Match> games_;  // match id -> 試合
+    std::unordered_map<Connection *, std::weak_ptr<Connection>> connections_;  // 試合の決まっていない接続
+    bool stopped_;
+
+    void Accept(size_t client_id);
+    void StartJoinDeadline(std::string const& match_id, Match & match);
+    void OnConnectionReady(size_t client_id, std::string const& match_id,
+        boost::asio::ip::tcp::socket && socket, std::string && input_buffer);
+};
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_HOST_HPP
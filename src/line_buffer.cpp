@@ -0,0 +1,100 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "line_buffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace digitalcurling3_server {
+
+LineBuffer::LineBuffer(size_t max_line_length, std::string_view initial_data)
+    : max_line_length_(max_line_length)
+    , data_(initial_data.begin(), initial_data.end())
+    , begin_(0)
+    , scan_(0)
+    , end_(initial_data.size())
+{}
+
+boost::asio::mutable_buffer LineBuffer::Prepare()
+{
+    assert(!IsOverflowed());
+
+    // 取り出し済みの領域を詰める．
+    // PopLine() で完全な行を全て取り出した後に呼ばれるため，移動するのは未完成の1行(max_line_length以下)だけ．
+    if (begin_ > 0) {
+        std::memmove(data_.data(), data_.data() + begin_, end_ - begin_);
+        scan_ -= begin_;
+        end_ -= begin_;
+        begin_ = 0;
+    }
+
+    if (data_.size() - end_ < kReadSize) {
+        data_.resize(end_ + kReadSize);
+    }
+
+    return boost::asio::buffer(data_.data() + end_, data_.size() - end_);
+}
+
+void LineBuffer::Commit(size_t n)
+{
+    assert(end_ + n <= data_.size());
+    end_ += n;
+}
+
+std::optional<std::string_view> LineBuffer::PopLine()
+{
+    if (scan_ == end_) {
+        return std::nullopt;
+    }
+
+    auto const found = static_cast<char const*>(std::memchr(data_.data() + scan_, '\n', end_ - scan_));
+    if (found == nullptr) {
+        scan_ = end_;
+        return std::nullopt;
+    }
+
+    size_t const newline = static_cast<size_t>(found - data_.data());
+    if (newline - begin_ > max_line_length_) {
+        // 上限を超えた行は取り出さない( IsOverflowed() で検出する)
+        scan_ = newline;
+        return std::nullopt;
+    }
+
+    std::string_view const line(data_.data() + begin_, newline - begin_);
+    begin_ = newline + 1;
+    scan_ = begin_;
+    return line;
+}
+
+bool LineBuffer::IsOverflowed() const
+{
+    return scan_ - begin_ > max_line_length_;
+}
+
+size_t LineBuffer::GetMaxLineLength() const
+{
+    return max_line_length_;
+}
+
+} // namespace digitalcurling3_server
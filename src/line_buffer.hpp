@@ -0,0 +1,88 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_LINE_BUFFER_HPP
+#define DIGITALCURLING3_SERVER_LINE_BUFFER_HPP
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+
+namespace digitalcurling3_server {
+
+/// \brief 改行区切りの受信バッファ
+///
+/// 受信したデータから1行ずつ取り出す．
+/// 取り出した行は先頭位置を進めるだけで削除せず，改行の探索も前回探索した位置から続けるため，
+/// 複数行をまとめて受信した場合や長い行を分割して受信した場合でも，各バイトのコピーと走査は高々定数回で済む．
+/// 未完成の行の長さは max_line_length までに制限され，バッファの大きさも
+/// max_line_length + kReadSize 程度で頭打ちになる．
+class LineBuffer {
+public:
+    /// \brief 1回の読み込みで確保する領域の大きさ
+    static constexpr size_t kReadSize = 4096;
+
+    /// \param max_line_length 1行の長さ(改行を含まない)の上限
+    /// \param initial_data 受信済みのデータ
+    explicit LineBuffer(size_t max_line_length, std::string_view initial_data = std::string_view());
+
+    /// \brief 受信データの書き込み先を得る
+    ///
+    /// PopLine() で得た行は無効になる．
+    ///
+    /// \return 書き込み先．書き込んだら Commit() を呼ぶ．
+    boost::asio::mutable_buffer Prepare();
+
+    /// \brief Prepare() で得た領域に書き込んだデータを確定する
+    ///
+    /// \param n 書き込んだバイト数
+    void Commit(size_t n);
+
+    /// \brief 次の1行を取り出す
+    ///
+    /// \return 改行を含まない1行． Prepare() を呼ぶまで有効．完全な行が無い場合は \c std::nullopt
+    std::optional<std::string_view> PopLine();
+
+    /// \brief 長さの上限を超えた行があるか
+    ///
+    /// PopLine() が \c std::nullopt を返した後に調べる．
+    /// \c true の場合，それ以上データを受信してはならない．
+    ///
+    /// \return 上限を超えた行があれば \c true
+    bool IsOverflowed() const;
+
+    size_t GetMaxLineLength() const;
+
+private:
+    size_t const max_line_length_;
+    std::vector<char> data_;
+    size_t begin_;  // 未取り出しのデータの先頭
+    size_t scan_;   // 改行を探索していない位置
+    size_t end_;    // 受信したデータの末尾
+};
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_LINE_BUFFER_HPP
@@ -21,12 +21,17 @@
 // SOFTWARE.
 
 #include "log.hpp"
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
 #include <exception>
 #include <thread>
 #include <string_view>
 #include <charconv>
+#include <vector>
 #include <boost/nowide/iostream.hpp>
+#include "metrics.hpp"
+#include "mpsc_queue.hpp"
 #include "util.hpp"
 #include "version.hpp"
 
@@ -37,6 +42,7 @@ namespace {
 using namespace std::string_view_literals;
 
 constexpr auto kGameLogFile = "game.dcl2"sv;
+constexpr auto kGameLogContainerFile = "game.dclc"sv;
 inline std::string GetShotLogFile(uint8_t end, uint8_t shot)
 {
     std::ostringstream buf;
@@ -53,9 +59,56 @@ constexpr auto kTagShot    = "sht"sv;
 constexpr auto kTagWarning = "wrn"sv;
 constexpr auto kTagError   = "err"sv;
 
+// game.dclc の形式( GameLogFormat::kContainer を参照)
+constexpr char kContainerMagic[4] = { 'D', 'C', 'L', 'C' };
+constexpr char kContainerIndexMagic[4] = { 'D', 'C', 'L', 'I' };
+constexpr std::uint8_t kContainerVersion = 1;
+enum class ChunkType : std::uint8_t {
+    kGame = 1,
+    kShot = 2,
+    kIndex = 3,
+};
+constexpr std::uint64_t kChunkHeaderSize = 8;
+constexpr std::uint64_t kIndexEntrySize = 12;
+
+void PutU8(std::ostream & o, std::uint8_t v)
+{
+    o.put(static_cast<char>(v));
+}
+
+void PutU32(std::ostream & o, std::uint32_t v)
+{
+    char bytes[4];
+    for (size_t i = 0; i < 4; ++i) {
+        bytes[i] = static_cast<char>(v >> (8 * i));
+    }
+    o.write(bytes, sizeof(bytes));
+}
+
+void PutU64(std::ostream & o, std::uint64_t v)
+{
+    char bytes[8];
+    for (size_t i = 0; i < 8; ++i) {
+        bytes[i] = static_cast<char>(v >> (8 * i));
+    }
+    o.write(bytes, sizeof(bytes));
+}
+
+std::uint32_t GetU32(char const* bytes)
+{
+    std::uint32_t v = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        v |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(bytes[i])) << (8 * i);
+    }
+    return v;
+}
+
 constexpr auto kTargetServer = "server"sv;
 constexpr auto kTargetClient = "client"sv;
 
+// 書き込みスレッドがキューを確認する最大の間隔
+constexpr auto kWriterMaxWait = std::chrono::milliseconds(100);
+
 
 // overloadedトリック用ヘルパークラス
 // 参考: https://dev.to/tmr232/that-overloaded-trick-overloading-lambdas-in-c17
@@ -97,50 +150,652 @@ void PutLineHeader(std::ostream & o, std::string_view header, std::string_view m
     }
 }
 
-void PutMessage(std::ostream & o, boost::posix_time::ptime time, std::string_view header, std::string_view message)
+/// \brief CUIに表示するメッセージを整形する(末尾の改行を含まない)
+std::string FormatMessage(boost::posix_time::ptime time, std::string_view header, std::string_view message)
 {
     std::ostringstream buf_header;
     buf_header << '[' << GetTimeOfDay(time) << "] " << header;
-    PutLineHeader(boost::nowide::cout, buf_header.str(), message);
-    boost::nowide::cout << std::endl;
+    std::ostringstream buf;
+    PutLineHeader(buf, buf_header.str(), message);
+    return buf.str();
 }
 
+/// \brief 1行のJSONをインデントして書き込む
+///
+/// nlohmann::json の dump(2) と同じ書式になる(空のオブジェクト，配列は {} ， [] のまま)．
+/// JSONの木を作らずに文字を1度だけ走査する．入力は改行や余分な空白を含まないこと．
+void AppendIndentedJson(std::string & out, std::string_view compact)
+{
+    constexpr size_t kIndent = 2;
+    size_t depth = 0;
+    auto const new_line = [&out, &depth] {
+        out += '\n';
+        out.append(depth * kIndent, ' ');
+    };
 
+    out.reserve(out.size() + compact.size() * 2);
+    for (size_t i = 0; i < compact.size(); ++i) {
+        char const c = compact[i];
+        switch (c) {
+            case '"': {
+                // 文字列はエスケープを考慮してそのまま写す
+                size_t j = i + 1;
+                while (j < compact.size() && compact[j] != '"') {
+                    j += compact[j] == '\\' ? 2 : 1;
+                }
+                out += compact.substr(i, j + 1 - i);
+                i = j;
+                break;
+            }
+            case '{':
+            case '[':
+                out += c;
+                if (i + 1 < compact.size() && (compact[i + 1] == '}' || compact[i + 1] == ']')) {
+                    out += compact[++i];
+                } else {
+                    ++depth;
+                    new_line();
+                }
+                break;
+            case '}':
+            case ']':
+                --depth;
+                new_line();
+                out += c;
+                break;
+            case ',':
+                out += c;
+                new_line();
+                break;
+            case ':':
+                out += ": ";
+                break;
+            default:
+                out += c;
+                break;
+        }
+    }
+}
 
 } // unnamed namespace
 
 
-Log::Log(boost::filesystem::path const& log_file, boost::filesystem::path const& game_log_directory, bool verbose, bool debug)
-    : game_log_directory_(game_log_directory)
-    , verbose_(verbose)
+// --- GameLog ---
+
+struct GameLog::Files {
+    boost::filesystem::path const directory;
+    GameLogFormat const format;
+    bool directory_created = false;
+    boost::nowide::ofstream file_game;  // game.dcl2 または game.dclc
+
+    // GameLogFormat::kContainer 用
+    struct IndexEntry {
+        std::uint64_t offset;
+        ChunkType type;
+        std::uint8_t end;
+        std::uint8_t shot;
+    };
+    std::uint64_t container_size = 0;
+    std::vector<IndexEntry> container_index;
+
+    // GameLogFormat::kFiles 用(ショットごとにメモリを確保し直さないよう，メンバとして持つ)
+    std::string indent_buffer;
+
+    Files(boost::filesystem::path const& directory, GameLogFormat format)
+        : directory(directory), format(format) {}
+
+    ~Files()
+    {
+        // 全てのレコードを書き込み終えた後に破棄されるので，ここでインデックスを書き込む
+        if (format == GameLogFormat::kContainer && file_game.is_open()) {
+            WriteContainerIndex();
+        }
+    }
+
+    Files(Files const&) = delete;
+    Files & operator = (Files const&) = delete;
+
+    bool IsOpen() const
+    {
+        return file_game.is_open();
+    }
+
+    void CheckFileOpen()
+    {
+        CheckDirectoryCreated();
+
+        if (!file_game.is_open()) {  // operator bool で判定すると初回にスキップされるため is_open() で判定する
+            switch (format) {
+                case GameLogFormat::kFiles:
+                    file_game.open(directory / kGameLogFile.data());
+                    break;
+
+                case GameLogFormat::kContainer:
+                    file_game.open(directory / kGameLogContainerFile.data(), std::ios_base::out | std::ios_base::binary);
+                    file_game.write(kContainerMagic, sizeof(kContainerMagic));
+                    PutU8(file_game, kContainerVersion);
+                    for (size_t i = 0; i < 3; ++i) {
+                        PutU8(file_game, 0);
+                    }
+                    container_size = sizeof(kContainerMagic) + 4;
+                    break;
+
+                default:
+                    assert(false);
+            }
+        }
+    }
+
+    void CheckDirectoryCreated()
+    {
+        if (directory_created) return;
+
+        boost::filesystem::create_directories(directory);
+
+        directory_created = true;
+    }
+
+    /// 試合ログを書き込む(ファイルは開かれていること)
+    void WriteGame(std::string_view text)
+    {
+        assert(file_game.is_open());
+        if (format == GameLogFormat::kContainer) {
+            WriteChunk(ChunkType::kGame, 0, 0, text);
+        } else {
+            file_game << text << '\n';
+        }
+    }
+
+    /// ショットログを書き込む
+    ///
+    /// \return ショットログを game.dclc に書き込んだ場合 \c true (フラッシュが必要)
+    bool WriteShot(std::uint8_t end, std::uint8_t shot, std::string_view text)
+    {
+        if (format == GameLogFormat::kContainer) {
+            CheckFileOpen();
+            WriteChunk(ChunkType::kShot, end, shot, text);
+            return true;
+        }
+
+        // ショットログは1ショットにつき1ファイルなので，すぐに閉じる
+        // 人が読みやすいようにインデントする(キーの順序は保つ)
+        CheckDirectoryCreated();
+        indent_buffer.clear();
+        AppendIndentedJson(indent_buffer, text);
+        boost::nowide::ofstream file(directory / GetShotLogFile(end, shot));
+        file << indent_buffer << std::endl;
+        return false;
+    }
+
+    void WriteChunk(ChunkType type, std::uint8_t end, std::uint8_t shot, std::string_view payload)
+    {
+        if (type != ChunkType::kIndex) {
+            container_index.push_back({ container_size, type, end, shot });
+        }
+        PutU32(file_game, static_cast<std::uint32_t>(payload.size()));
+        PutU8(file_game, static_cast<std::uint8_t>(type));
+        PutU8(file_game, end);
+        PutU8(file_game, shot);
+        PutU8(file_game, 0);
+        file_game.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        container_size += kChunkHeaderSize + payload.size();
+    }
+
+    void WriteContainerIndex()
+    {
+        std::uint64_t const index_offset = container_size;
+
+        std::ostringstream buf;
+        for (auto const& entry : container_index) {
+            PutU64(buf, entry.offset);
+            PutU8(buf, static_cast<std::uint8_t>(entry.type));
+            PutU8(buf, entry.end);
+            PutU8(buf, entry.shot);
+            PutU8(buf, 0);
+        }
+        auto const payload = buf.str();
+        assert(payload.size() == container_index.size() * kIndexEntrySize);
+        WriteChunk(ChunkType::kIndex, 0, 0, payload);
+
+        PutU64(file_game, index_offset);
+        file_game.write(kContainerIndexMagic, sizeof(kContainerIndexMagic));
+        file_game.flush();
+    }
+};
+
+GameLog::GameLog(boost::filesystem::path const& directory)
+    : files_()
+{
+    assert(Log::instance_);
+    // check game log directory
+    if (boost::filesystem::exists(directory)) {
+        throw std::runtime_error("log directory already exists");
+    }
+
+    files_ = std::make_shared<Files>(directory, Log::instance_->game_log_format_);
+}
+
+boost::filesystem::path const& GameLog::GetDirectory() const
+{
+    return files_->directory;
+}
+
+
+// --- 試合ログの読み込み ---
+
+bool IsGameLogDirectory(boost::filesystem::path const& directory)
+{
+    return boost::filesystem::is_regular_file(directory / kGameLogFile.data())
+        || boost::filesystem::is_regular_file(directory / kGameLogContainerFile.data());
+}
+
+GameLogRecords ReadGameLog(boost::filesystem::path const& directory)
+{
+    GameLogRecords records;
+
+    // game.dclc
+    auto const container_path = directory / kGameLogContainerFile.data();
+    if (boost::filesystem::exists(container_path)) {
+        boost::nowide::ifstream file(container_path, std::ios_base::in | std::ios_base::binary);
+        if (!file) {
+            throw std::runtime_error("could not open game.dclc");
+        }
+
+        char header[sizeof(kContainerMagic) + 4];
+        if (!file.read(header, sizeof(header)) || !std::equal(std::begin(kContainerMagic), std::end(kContainerMagic), header)) {
+            throw std::runtime_error("game.dclc: invalid file header");
+        }
+        if (static_cast<std::uint8_t>(header[sizeof(kContainerMagic)]) != kContainerVersion) {
+            throw std::runtime_error("game.dclc: unsupported version");
+        }
+
+        // インデックスは使わず，チャンクを先頭から順に読む
+        std::string payload;
+        while (true) {
+            char chunk_header[kChunkHeaderSize];
+            if (!file.read(chunk_header, sizeof(chunk_header))) {
+                break;  // ファイルの末尾，または書き込み途中のチャンク
+            }
+            auto const type = static_cast<ChunkType>(static_cast<std::uint8_t>(chunk_header[4]));
+            if (type == ChunkType::kIndex) {
+                break;  // インデックスより後にレコードは無い
+            }
+
+            payload.resize(GetU32(chunk_header));
+            if (!file.read(payload.data(), static_cast<std::streamsize>(payload.size()))) {
+                break;  // 書き込み途中のチャンク
+            }
+
+            switch (type) {
+                case ChunkType::kGame:
+                    records.game.push_back(nlohmann::json::parse(payload).at("log"));
+                    break;
+                case ChunkType::kShot:
+                    records.shots.push_back(nlohmann::json::parse(payload).at("log"));
+                    break;
+                default:
+                    throw std::runtime_error("game.dclc: unknown chunk type");
+            }
+        }
+
+        return records;
+    }
+
+    // game.dcl2
+    {
+        boost::nowide::ifstream file(directory / kGameLogFile.data());
+        if (!file) {
+            throw std::runtime_error("could not open game.dcl2");
+        }
+
+        std::string line;
+        while (std::getline(file, line)) {
+            if (file.eof()) {
+                // 改行で終わっていない最後の行は書き込み途中の可能性がある
+                auto json = nlohmann::json::parse(line, nullptr, false);
+                if (!json.is_discarded()) {
+                    records.game.push_back(std::move(json.at("log")));
+                }
+                break;
+            }
+            records.game.push_back(nlohmann::json::parse(line).at("log"));
+        }
+    }
+
+    // ショットログファイル
+    {
+        // ファイル名はエンド番号とショット番号を0埋めしたものなので，名前順が記録順になる
+        std::vector<boost::filesystem::path> shot_files;
+        for (auto const& entry : boost::filesystem::directory_iterator(directory)) {
+            auto const file_name = entry.path().filename().string();
+            if (file_name.rfind("shot_e", 0) == 0 && entry.path().extension() == ".json") {
+                shot_files.push_back(entry.path());
+            }
+        }
+        std::sort(shot_files.begin(), shot_files.end());
+
+        for (auto const& shot_file : shot_files) {
+            boost::nowide::ifstream file(shot_file);
+            if (!file) {
+                std::ostringstream buf;
+                buf << "could not open \"" << shot_file.filename().string() << "\"";
+                throw std::runtime_error(buf.str());
+            }
+            records.shots.push_back(nlohmann::json::parse(file).at("log"));
+        }
+    }
+
+    return records;
+}
+
+
+// --- Log::Record ---
+
+/// \brief 整形済みのログ1行分
+struct Log::Record {
+    enum class Sink : std::uint8_t {
+        kConsole,    ///< 標準出力
+        kAll,        ///< サーバーのログファイル
+        kGame,       ///< 試合ログファイル
+        kGameError,  ///< 試合ログファイル(開かれている場合のみ)
+        kShot,       ///< ショットログファイル
+        kGameClose,  ///< 試合ログの破棄(書き込むものは無い．破棄しない)
+    };
+
+    Sink sink = Sink::kAll;
+    bool important = false;  ///< 破棄せず，書き込み後に全てフラッシュする(エラー)
+    std::shared_ptr<GameLog::Files> game;  ///< kGame, kGameError, kShot
+    std::uint8_t end = 0;  ///< kShot
+    std::uint8_t shot = 0;  ///< kShot
+    std::string text;  ///< 末尾の改行を含まない
+
+    Record() = default;
+    Record(Sink sink, bool important, std::string && text)
+        : sink(sink), important(important), game(), text(std::move(text)) {}
+    Record(Sink sink, bool important, std::shared_ptr<GameLog::Files> const& game, std::string && text)
+        : sink(sink), important(important), game(game), text(std::move(text)) {}
+};
+
+// Record の定義が必要なため，ここで定義する
+GameLog::~GameLog()
+{
+    // 書き込み側がフラッシュ待ちの試合ログとして保持している参照を手放させる．
+    // 最後の参照が無くなった時点でファイルが閉じられる(コンテナ形式ではインデックスも書き込まれる)．
+    if (Log::instance_) {
+        Log::instance_->Submit(Log::Record(Log::Record::Sink::kGameClose, false, files_, std::string()));
+    }
+}
+
+
+// --- Log::Writer ---
+
+/// \brief レコードをファイルに書き込む
+///
+/// 同期モードでは Log::mutex_ を取得したスレッドから，非同期モードでは書き込みスレッドからのみ使われる．
+class Log::Writer {
+public:
+    Writer(boost::filesystem::path const& log_file, Options const& options)
+        : options_(options)
+        , file_all_()
+        , console_dirty_(false)
+        , all_dirty_(false)
+        , dirty_games_()
+        , last_flush_(std::chrono::steady_clock::now())
+        , queue_()
+        , stop_(false)
+        , sleeping_(false)
+        , wait_mutex_()
+        , wait_cv_()
+        , dropped_(0)
+        , thread_()
+    {
+        boost::filesystem::create_directories(log_file.parent_path());
+        file_all_.open(log_file, std::ios_base::out);
+
+        if (options_.async) {
+            queue_ = std::make_unique<MPSCQueue<Record>>(options_.queue_capacity);
+            thread_ = std::thread([this] { Run(); });
+        }
+    }
+
+    ~Writer()
+    {
+        if (thread_.joinable()) {
+            stop_.store(true);
+            Wake();
+            thread_.join();
+        }
+        FlushAll();
+    }
+
+    Writer(Writer const&) = delete;
+    Writer & operator = (Writer const&) = delete;
+
+    bool IsAsync() const { return static_cast<bool>(queue_); }
+    size_t GetQueueDepth() const { return queue_ ? queue_->GetSizeApprox() : 0; }
+    size_t GetQueueCapacity() const { return queue_ ? queue_->GetCapacity() : 0; }
+
+    /// \brief 非同期モードでレコードをキューに積む(任意のスレッドから呼び出せる)
+    void Push(Record && record)
+    {
+        assert(queue_);
+        while (!queue_->TryPush(std::move(record))) {
+            if (options_.overflow_policy == OverflowPolicy::kDrop && !record.important && record.sink != Record::Sink::kGameClose) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                Metrics::Add(Metrics::Counter::kLogRecordsDropped);
+                return;
+            }
+            // 書き込みスレッドが空きを作るのを待つ
+            Wake();
+            std::this_thread::yield();
+        }
+
+        if (sleeping_.load()) {
+            Wake();
+        }
+    }
+
+    /// \brief レコードを書き込む
+    void Write(Record && record)
+    {
+        switch (record.sink) {
+            case Record::Sink::kConsole:
+                boost::nowide::cout << record.text << '\n';
+                console_dirty_ = true;
+                if (options_.flush_policy == FlushPolicy::kEveryRecord) {
+                    boost::nowide::cout.flush();
+                }
+                break;
+
+            case Record::Sink::kAll:
+                file_all_ << record.text << '\n';
+                all_dirty_ = true;
+                if (options_.flush_policy == FlushPolicy::kEveryRecord) {
+                    file_all_.flush();
+                }
+                break;
+
+            case Record::Sink::kGame:
+                record.game->CheckFileOpen();
+                [[fallthrough]];
+
+            case Record::Sink::kGameError:
+                if (record.game->IsOpen()) {
+                    record.game->WriteGame(record.text);
+                    FlushGame(record.game);
+                }
+                break;
+
+            case Record::Sink::kShot:
+                if (record.game->WriteShot(record.end, record.shot, record.text)) {
+                    FlushGame(record.game);
+                }
+                break;
+
+            case Record::Sink::kGameClose:
+                CloseGame(record.game);
+                record.game.reset();  // 非同期モードでは record が次のレコードまで残るため，ここで参照を手放す
+                break;
+
+            default:
+                assert(false);
+        }
+
+        if (record.important) {
+            FlushAll();
+        } else if (options_.flush_policy == FlushPolicy::kInterval) {
+            CheckFlushInterval();
+        }
+    }
+
+private:
+    Options const options_;
+
+    // 書き込み側の状態
+    boost::nowide::ofstream file_all_;
+    bool console_dirty_;
+    bool all_dirty_;
+    std::vector<std::shared_ptr<GameLog::Files>> dirty_games_;  // 前回のフラッシュ以降に書き込んだ試合ログ
+    std::chrono::steady_clock::time_point last_flush_;
+
+    // 非同期モード用
+    std::unique_ptr<MPSCQueue<Record>> queue_;
+    std::atomic<bool> stop_;
+    std::atomic<bool> sleeping_;
+    std::mutex wait_mutex_;
+    std::condition_variable wait_cv_;
+    std::atomic<uint64_t> dropped_;
+    std::thread thread_;
+
+    void FlushGame(std::shared_ptr<GameLog::Files> const& game)
+    {
+        if (options_.flush_policy == FlushPolicy::kEveryRecord) {
+            game->file_game.flush();
+        } else {
+            MarkDirty(game);
+        }
+    }
+
+    void MarkDirty(std::shared_ptr<GameLog::Files> const& game)
+    {
+        for (auto const& dirty_game : dirty_games_) {
+            if (dirty_game == game) return;
+        }
+        dirty_games_.emplace_back(game);
+    }
+
+    /// 試合ログのフラッシュ待ちを解除する．レコードの破棄時に最後の参照が無くなればファイルが閉じられる
+    void CloseGame(std::shared_ptr<GameLog::Files> const& game)
+    {
+        auto const it = std::find(dirty_games_.begin(), dirty_games_.end(), game);
+        if (it != dirty_games_.end()) {
+            game->file_game.flush();
+            dirty_games_.erase(it);
+        }
+    }
+
+    void CheckFlushInterval()
+    {
+        if (std::chrono::steady_clock::now() - last_flush_ >= options_.flush_interval) {
+            FlushAll();
+        }
+    }
+
+    void FlushAll()
+    {
+        if (console_dirty_) {
+            boost::nowide::cout.flush();
+            console_dirty_ = false;
+        }
+        if (all_dirty_) {
+            file_all_.flush();
+            all_dirty_ = false;
+        }
+        for (auto const& game : dirty_games_) {
+            game->file_game.flush();
+        }
+        dirty_games_.clear();
+        last_flush_ = std::chrono::steady_clock::now();
+    }
+
+    void Wake()
+    {
+        {
+            std::lock_guard g(wait_mutex_);
+        }
+        wait_cv_.notify_one();
+    }
+
+    // 書き込みスレッド
+    void Run()
+    {
+        Record record;
+        while (true) {
+            bool const stopping = stop_.load();
+
+            while (queue_->TryPop(record)) {
+                Write(std::move(record));
+            }
+
+            if (auto const dropped = dropped_.exchange(0); dropped > 0) {
+                std::ostringstream buf;
+                buf << "log queue overflowed. " << dropped << " log records were dropped.";
+                auto const t = boost::posix_time::second_clock::local_time();
+                Write(Record(Record::Sink::kConsole, true, FormatMessage(t, "[warning] ", buf.str())));
+            }
+
+            if (options_.flush_policy == FlushPolicy::kInterval) {
+                CheckFlushInterval();
+            }
+
+            if (stopping) {
+                break;  // stop_ を確認した後にキューを空にしている
+            }
+
+            std::unique_lock lock(wait_mutex_);
+            sleeping_.store(true);
+            if (queue_->IsEmpty() && !stop_.load()) {
+                auto wait_time = kWriterMaxWait;
+                if (options_.flush_policy == FlushPolicy::kInterval && options_.flush_interval < wait_time) {
+                    wait_time = options_.flush_interval;
+                }
+                wait_cv_.wait_for(lock, wait_time);
+            }
+            sleeping_.store(false);
+        }
+    }
+};
+
+
+// --- Log ---
+
+Log::Log(boost::filesystem::path const& log_file, bool verbose, bool debug)
+    : Log(log_file, verbose, debug, Options()) {}
+
+Log::Log(boost::filesystem::path const& log_file, bool verbose, bool debug, Options const& options)
+    : verbose_(verbose)
     , debug_(debug)
+    , game_log_format_(options.game_log_format)
     , mutex_()
     , next_id_(0)
-    , directory_created_(false)
-    , file_all_()
-    , file_game_()
+    , writer_()
 {
     assert(instance_ == nullptr);
-    instance_ = this;
 
-    boost::filesystem::create_directories(log_file.parent_path());
-    file_all_.open(log_file, std::ios_base::out);
+    writer_ = std::make_unique<Writer>(log_file, options);
 
-    // check game_log_directory
-    if (boost::filesystem::exists(game_log_directory)) {
-        throw std::runtime_error("log directory already exists");
-    }
+    instance_ = this;
 }
 
 Log::~Log()
 {
     instance_ = nullptr;
+    writer_.reset();  // 非同期モードでは書き込みスレッドが残りのレコードを書き込んでから終了する
 }
 
 void Log::Trace(Target const& from, Target const& to, std::string_view message)
 {
     assert(instance_);
-    std::lock_guard g(instance_->mutex_);
 
     boost::posix_time::ptime const t = boost::posix_time::second_clock::local_time();
 
@@ -152,113 +807,128 @@ void Log::Trace(Target const& from, Target const& to, std::string_view message)
 
     auto const detailed = instance_->CreateDetailedLog(kTagTrace, json, t);
 
-    instance_->file_all_ << detailed << std::endl;
+    instance_->Submit(Record(Record::Sink::kAll, false, detailed.dump()));
 }
 
 void Log::Debug(std::string_view message)
 {
     assert(instance_);
-    std::lock_guard g(instance_->mutex_);
 
     boost::posix_time::ptime const t = boost::posix_time::second_clock::local_time();
-    auto const detailed = instance_->CreateDetailedLog(kTagDebug, message, t);
+    auto detailed = instance_->CreateDetailedLog(kTagDebug, message, t).dump();
 
     if (instance_->debug_) {
         if (instance_->verbose_) {
-            boost::nowide::cout << detailed << std::endl;
+            instance_->Submit(Record(Record::Sink::kConsole, false, std::string(detailed)));
         } else {
-            PutMessage(boost::nowide::cout, t, "[debug] ", message);
+            instance_->Submit(Record(Record::Sink::kConsole, false, FormatMessage(t, "[debug] ", message)));
         }
     }
 
     // all
-    instance_->file_all_ << detailed << std::endl;
+    instance_->Submit(Record(Record::Sink::kAll, false, std::move(detailed)));
 }
 
 void Log::Info(std::string_view message)
 {
     assert(instance_);
-    std::lock_guard g(instance_->mutex_);
 
     boost::posix_time::ptime const t = boost::posix_time::second_clock::local_time();
-    auto const detailed = instance_->CreateDetailedLog(kTagInfo, message, t);
-    
+    auto detailed = instance_->CreateDetailedLog(kTagInfo, message, t).dump();
+
     // stdout
     if (instance_->verbose_) {
-        boost::nowide::cout << detailed << std::endl;
+        instance_->Submit(Record(Record::Sink::kConsole, false, std::string(detailed)));
     } else {
-        PutMessage(boost::nowide::cout, t, "", message);
+        instance_->Submit(Record(Record::Sink::kConsole, false, FormatMessage(t, "", message)));
     }
 
     // all
-    instance_->file_all_ << detailed << std::endl;
+    instance_->Submit(Record(Record::Sink::kAll, false, std::move(detailed)));
 }
 
-void Log::Game(nlohmann::json const& json)
+void Log::Game(GameLog & game_log, nlohmann::json const& json)
+{
+    GameSerialized(game_log, json.dump());
+}
+
+void Log::GameSerialized(GameLog & game_log, std::string_view json_text)
 {
     assert(instance_);
-    std::lock_guard g(instance_->mutex_);
 
     boost::posix_time::ptime const t = boost::posix_time::second_clock::local_time();
-    auto const detailed = instance_->CreateDetailedLog(kTagGame, json, t);
-
-    instance_->CheckGameLogFileOpen();
+    auto detailed = instance_->CreateDetailedLogText(kTagGame, json_text, t);
 
     if (instance_->verbose_) {
-        boost::nowide::cout << detailed << std::endl;
+        instance_->Submit(Record(Record::Sink::kConsole, false, std::string(detailed)));
     }
 
-    instance_->file_game_ << detailed << std::endl;
-    instance_->file_all_ << detailed << std::endl;
+    instance_->Submit(Record(Record::Sink::kGame, false, game_log.files_, std::string(detailed)));
+    instance_->Submit(Record(Record::Sink::kAll, false, std::move(detailed)));
+}
+
+void Log::Shot(GameLog & game_log, nlohmann::json const& json, std::uint8_t end, std::uint8_t shot)
+{
+    ShotSerialized(game_log, json.dump(), end, shot);
 }
 
-void Log::Shot(nlohmann::json const& json, std::uint8_t end, std::uint8_t shot)
+void Log::ShotSerialized(GameLog & game_log, std::string_view json_text, std::uint8_t end, std::uint8_t shot)
 {
     assert(instance_);
-    std::lock_guard g(instance_->mutex_);
 
     boost::posix_time::ptime const t = boost::posix_time::second_clock::local_time();
-    auto const detailed = instance_->CreateDetailedLog(kTagShot, json, t);
+    auto detailed = instance_->CreateDetailedLogText(kTagShot, json_text, t);
 
-    instance_->CheckGameLogDirectoryCreated();
-
-    boost::nowide::ofstream file(instance_->game_log_directory_ / GetShotLogFile(end, shot));
-    file << detailed.dump(2) << std::endl;
+    {
+        Record record(Record::Sink::kShot, false, game_log.files_, std::string(detailed));
+        record.end = end;
+        record.shot = shot;
+        instance_->Submit(std::move(record));
+    }
 
-    instance_->file_all_ << detailed << std::endl;
+    instance_->Submit(Record(Record::Sink::kAll, false, std::move(detailed)));
 }
 
 void Log::Warning(std::string_view message)
 {
     assert(instance_);
-    std::lock_guard g(instance_->mutex_);
 
     boost::posix_time::ptime const t = boost::posix_time::second_clock::local_time();
-    auto const detailed = instance_->CreateDetailedLog(kTagWarning, message, t);
+    auto detailed = instance_->CreateDetailedLog(kTagWarning, message, t).dump();
 
-    PutMessage(boost::nowide::cerr, t, "[warning] ", message);
+    instance_->Submit(Record(Record::Sink::kConsole, false, FormatMessage(t, "[warning] ", message)));
 
     // all
-    instance_->file_all_ << detailed << std::endl;
+    instance_->Submit(Record(Record::Sink::kAll, false, std::move(detailed)));
 }
 
 void Log::Error(std::string_view message)
 {
     assert(instance_);
-    std::lock_guard g(instance_->mutex_);
 
     boost::posix_time::ptime const t = boost::posix_time::second_clock::local_time();
-    auto const detailed = instance_->CreateDetailedLog(kTagError, message, t);
+    auto detailed = instance_->CreateDetailedLog(kTagError, message, t).dump();
 
-    PutMessage(boost::nowide::cerr, t, "[error] ", message);
+    instance_->Submit(Record(Record::Sink::kConsole, true, FormatMessage(t, "[error] ", message)));
 
     // all
-    instance_->file_all_ << detailed << std::endl;
+    instance_->Submit(Record(Record::Sink::kAll, true, std::move(detailed)));
+}
+
+void Log::Error(GameLog & game_log, std::string_view message)
+{
+    assert(instance_);
+
+    boost::posix_time::ptime const t = boost::posix_time::second_clock::local_time();
+    auto detailed = instance_->CreateDetailedLog(kTagError, message, t).dump();
+
+    instance_->Submit(Record(Record::Sink::kConsole, true, FormatMessage(t, "[error] ", message)));
+
+    // all
+    instance_->Submit(Record(Record::Sink::kAll, true, std::string(detailed)));
 
     // gameログファイルが開かれているなら，エラーメッセージを出す
-    if (instance_->file_game_) {
-        instance_->file_game_ << detailed << std::endl;
-    }
+    instance_->Submit(Record(Record::Sink::kGameError, true, game_log.files_, std::move(detailed)));
 }
 
 bool Log::IsValid()
@@ -266,6 +936,16 @@ bool Log::IsValid()
     return instance_ != nullptr;
 }
 
+size_t Log::GetQueueDepth()
+{
+    return instance_ ? instance_->writer_->GetQueueDepth() : 0;
+}
+
+size_t Log::GetQueueCapacity()
+{
+    return instance_ ? instance_->writer_->GetQueueCapacity() : 0;
+}
+
 nlohmann::ordered_json Log::CreateDetailedLog(std::string_view tag, nlohmann::json const& json, boost::posix_time::ptime time)
 {
     std::ostringstream buf_thread_id;
@@ -274,33 +954,42 @@ nlohmann::ordered_json Log::CreateDetailedLog(std::string_view tag, nlohmann::js
     nlohmann::ordered_json j{
         { "ver", { GetLogVersionMajor(), GetLogVersionMinor() } },
         { "tag", tag },
-        { "id", next_id_ },
+        { "id", next_id_.fetch_add(1, std::memory_order_relaxed) },
         { "date_time", GetISO8601ExtendedString(time) },
         { "thread", buf_thread_id.str() },
         { "log", json }
     };
 
-    ++next_id_;
-
     return j;
 }
 
-void Log::CheckGameLogFileOpen()
+std::string Log::CreateDetailedLogText(std::string_view tag, std::string_view json_text, boost::posix_time::ptime time)
 {
-    CheckGameLogDirectoryCreated();
+    // "log" は最後のキーなので，値を null にしてシリアライズし，末尾の null を差し替える
+    std::string text = CreateDetailedLog(tag, nullptr, time).dump();
 
-    if (!file_game_.is_open()) {  // operator bool で判定すると初回にスキップされるため is_open() で判定する
-        file_game_.open(game_log_directory_ / kGameLogFile.data());
-    }
+    constexpr auto kNullEnd = "null}"sv;
+    assert(std::string_view(text).substr(text.size() - kNullEnd.size()) == kNullEnd);
+    text.resize(text.size() - kNullEnd.size());
+    text.reserve(text.size() + json_text.size() + 1);
+    text += json_text;
+    text += '}';
+
+    return text;
 }
 
-void Log::CheckGameLogDirectoryCreated()
+void Log::Submit(Record && record)
 {
-    if (directory_created_) return;
-
-    boost::filesystem::create_directories(game_log_directory_);
+    if (record.sink != Record::Sink::kGameClose) {
+        Metrics::Add(Metrics::Counter::kLogRecords);
+    }
 
-    directory_created_ = true;
+    if (writer_->IsAsync()) {
+        writer_->Push(std::move(record));
+    } else {
+        std::lock_guard g(mutex_);
+        writer_->Write(std::move(record));
+    }
 }
 
 
@@ -23,11 +23,15 @@
 #ifndef DIGITALCURLING3_SERVER_LOG_HPP
 #define DIGITALCURLING3_SERVER_LOG_HPP
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <memory>
 #include <string_view>
 #include <fstream>
 #include <mutex>
 #include <variant>
+#include <vector>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/nowide/fstream.hpp>
@@ -37,13 +41,128 @@
 
 namespace digitalcurling3_server {
 
+/// \brief 試合ログ，ショットログの形式
+enum class GameLogFormat {
+    /// \brief 試合ログを game.dcl2 に1行1レコードで，ショットログを1ショット1ファイルで出力する(デフォルト)
+    kFiles,
+
+    /// \brief 試合ログとショットログを1つのファイル game.dclc に出力する
+    ///
+    /// 追記のみのチャンク列で，先頭から順に読めば書き込み途中のファイルも読める．
+    /// 正常に閉じられたファイルの末尾には，全レコードの位置を記録したインデックスが付く．
+    /// 整数は全てリトルエンディアン．
+    ///
+    /// \code
+    /// ファイルヘッダ
+    ///   u8[4]  magic "DCLC"
+    ///   u8     バージョン (1)
+    ///   u8[3]  予約 (0)
+    /// チャンク × N
+    ///   u32    ペイロードのバイト数
+    ///   u8     種類 (1: 試合ログ, 2: ショットログ, 3: インデックス)
+    ///   u8     エンド番号 (ショットログのみ．それ以外は0)
+    ///   u8     ショット番号 (ショットログのみ．それ以外は0)
+    ///   u8     予約 (0)
+    ///   u8[]   ペイロード (試合ログ，ショットログは game.dcl2 の1行，ショットログファイルと同じJSON．改行なし)
+    /// インデックスチャンクのペイロード (インデックス以外のチャンク1つにつき12バイト)
+    ///   u64    チャンクのファイル先頭からの位置
+    ///   u8     種類
+    ///   u8     エンド番号
+    ///   u8     ショット番号
+    ///   u8     予約 (0)
+    /// フッタ
+    ///   u64    インデックスチャンクのファイル先頭からの位置
+    ///   u8[4]  magic "DCLI"
+    /// \endcode
+    ///
+    /// フッタが無いファイル(サーバーが異常終了した場合など)はチャンクを先頭から順に読む．
+    kContainer,
+};
+
+/// \brief 1試合分の試合ログ，ショットログの出力先
+///
+/// 試合ごとに1つ作成し， Log::Game() や Log::Shot() に渡す．
+/// 形式は Log::Options::game_log_format に従う．
+class GameLog {
+public:
+    /// \param directory 試合ログを出力するディレクトリ．既に存在する場合は例外を送出する．
+    explicit GameLog(boost::filesystem::path const& directory);
+
+    /// \brief 書き込み側に試合ログを閉じさせる
+    ///
+    /// 非同期モードでは，それまでに積まれたレコードの書き込み後に閉じられる．
+    ~GameLog();
+
+    GameLog(GameLog const&) = delete;
+    GameLog & operator = (GameLog const&) = delete;
+
+    boost::filesystem::path const& GetDirectory() const;
+
+private:
+    friend class Log;
+    struct Files;
+    // 非同期モードでは GameLog の破棄後に書き込まれることがあるため共有する
+    std::shared_ptr<Files> files_;
+};
+
+/// \brief 試合ログのディレクトリから読み込んだレコード
+struct GameLogRecords {
+    std::vector<nlohmann::json> game;   ///< 試合ログの各レコードの "log" (記録順)
+    std::vector<nlohmann::json> shots;  ///< ショットログの各レコードの "log" (記録順)
+};
+
+/// \brief ディレクトリに試合ログ(game.dcl2 または game.dclc)があるか？
+///
+/// \param directory ディレクトリ
+/// \return 試合ログがあれば \c true
+bool IsGameLogDirectory(boost::filesystem::path const& directory);
+
+/// \brief 試合ログのディレクトリを読み込む
+///
+/// game.dclc があればそれを，無ければ game.dcl2 とショットログファイルを読む．
+/// 書き込み途中のファイルも読めるように，末尾の不完全なレコードは無視する．
+/// 読めない場合は例外を送出する．
+///
+/// \param directory 試合ログのディレクトリ
+/// \return 読み込んだレコード
+GameLogRecords ReadGameLog(boost::filesystem::path const& directory);
+
 /// \brief サーバーのログはこのクラスの関数を介して出力される．
 ///
 /// シングルトン
 class Log {
 public:
 
-    Log(boost::filesystem::path const& log_file, boost::filesystem::path const& game_log_directory, bool verbose, bool debug);
+    /// \brief フラッシュの方針
+    enum class FlushPolicy {
+        kEveryRecord,  ///< 1レコード書き込むごとにフラッシュする(デフォルト)
+        kInterval,     ///< Options::flush_interval ごとにフラッシュする
+        kOnShutdown,   ///< 終了時にのみフラッシュする
+    };
+
+    /// \brief 非同期モードでキューが満杯になった場合の動作
+    enum class OverflowPolicy {
+        kBlock,  ///< 空きができるまで待つ(デフォルト)
+        kDrop,   ///< レコードを破棄する．破棄した数は後で警告として出力する．
+    };
+
+    /// \brief ログの出力方法の設定
+    ///
+    /// エラーのレコードは方針によらず破棄されず，書き込み後に全てのファイルをフラッシュする．
+    struct Options {
+        /// \brief 非同期モード
+        ///
+        /// \c true の場合，整形済みのレコードをロックフリーのキューに積み，書き込み専用スレッドがまとめて書き込む．
+        bool async = false;
+        FlushPolicy flush_policy = FlushPolicy::kEveryRecord;
+        std::chrono::milliseconds flush_interval = std::chrono::milliseconds(1000);
+        size_t queue_capacity = 65536;  ///< 非同期モードのキューの容量(レコード数)
+        OverflowPolicy overflow_policy = OverflowPolicy::kBlock;
+        GameLogFormat game_log_format = GameLogFormat::kFiles;  ///< 試合ログの形式
+    };
+
+    Log(boost::filesystem::path const& log_file, bool verbose, bool debug);
+    Log(boost::filesystem::path const& log_file, bool verbose, bool debug, Options const& options);
     Log(Log const&) = delete;
     Log & operator = (Log const&) = delete;
     ~Log();
@@ -74,17 +193,37 @@ public:
     ///
     /// GUIで試合ログを表示するためのデータ
     ///
+    /// \param game_log 出力先の試合ログ
     /// \param json ログデータ
-    static void Game(nlohmann::json const& json);
+    static void Game(GameLog & game_log, nlohmann::json const& json);
+
+    /// \brief シリアライズ済みの試合ログを出す
+    ///
+    /// Game(GameLog &, nlohmann::json const&) と同じだが，JSONの木を経由しない．
+    ///
+    /// \param game_log 出力先の試合ログ
+    /// \param json_text JSONとしてシリアライズしたログデータ
+    static void GameSerialized(GameLog & game_log, std::string_view json_text);
 
     /// \brief ショットのログを出す
     ///
     /// GUIで試合ログを表示するためのデータ
     ///
+    /// \param game_log 出力先の試合ログ
     /// \param json ログデータ
     /// \param end エンド番号
     /// \param shot ショット番号
-    static void Shot(nlohmann::json const& json, std::uint8_t end, std::uint8_t shot);
+    static void Shot(GameLog & game_log, nlohmann::json const& json, std::uint8_t end, std::uint8_t shot);
+
+    /// \brief シリアライズ済みのショットログを出す
+    ///
+    /// Shot(GameLog &, nlohmann::json const&, std::uint8_t, std::uint8_t) と同じだが，JSONの木を経由しない．
+    ///
+    /// \param game_log 出力先の試合ログ
+    /// \param json_text JSONとしてシリアライズしたログデータ
+    /// \param end エンド番号
+    /// \param shot ショット番号
+    static void ShotSerialized(GameLog & game_log, std::string_view json_text, std::uint8_t end, std::uint8_t shot);
 
     /// \brief CUIに表示するログを出す
     ///
@@ -106,26 +245,47 @@ public:
     /// \param message エラーメッセージ
     static void Error(std::string_view message);
 
+    /// \brief 試合中に発生したエラーのメッセージを出す
+    ///
+    /// Error(std::string_view) に加え，試合ログが開かれているなら試合ログにも出力する．
+    ///
+    /// \param game_log エラーが発生した試合の試合ログ
+    /// \param message エラーメッセージ
+    static void Error(GameLog & game_log, std::string_view message);
+
     /// \brief ログを出せる状態にあるか？
     /// 
     /// \return ログが出せるなら \c true
     static bool IsValid();
 
+    /// \brief 非同期モードのキューに積まれているレコードのおおよその数
+    ///
+    /// \return レコード数．同期モードの場合やログが出せない状態の場合は0．
+    static size_t GetQueueDepth();
+
+    /// \brief 非同期モードのキューの容量
+    ///
+    /// \return 容量．同期モードの場合やログが出せない状態の場合は0．
+    static size_t GetQueueCapacity();
+
 private:
+    friend class GameLog;
+    struct Record;
+    class Writer;
+
     static inline Log * instance_ = nullptr;
-    boost::filesystem::path const game_log_directory_;
     bool const verbose_;
     bool const debug_;
+    GameLogFormat const game_log_format_;
 
-    std::mutex mutex_;
-    uint64_t next_id_;  // ログのID値生成用
-    bool directory_created_;
-    boost::nowide::ofstream file_all_;
-    boost::nowide::ofstream file_game_;
+    std::mutex mutex_;  // 同期モードでの書き込み用
+    std::atomic<uint64_t> next_id_;  // ログのID値生成用
+    std::unique_ptr<Writer> writer_;
     nlohmann::ordered_json CreateDetailedLog(std::string_view tag, nlohmann::json const& json,
         boost::posix_time::ptime time);
-    void CheckGameLogFileOpen();
-    void CheckGameLogDirectoryCreated();
+    std::string CreateDetailedLogText(std::string_view tag, std::string_view json_text,
+        boost::posix_time::ptime time);
+    void Submit(Record && record);
 };
 
 } // namespace digitalcurling3_server
@@ -31,6 +31,8 @@
 
 #include <boost/program_options.hpp>
 
+#include <boost/asio/ip/tcp.hpp>
+
 #include <boost/nowide/args.hpp>
 #include <boost/nowide/fstream.hpp>
 #include <boost/nowide/filesystem.hpp>
@@ -41,6 +43,10 @@
 
 #include "digitalcurling3/digitalcurling3.hpp"
 
+#include "batch.hpp"
+#include "engine.hpp"
+#include "replay.hpp"
+#include "tournament.hpp"
 #include "log.hpp"
 #include "util.hpp"
 #include "config.hpp"
@@ -49,7 +55,10 @@
 
 namespace digitalcurling3_server {
 
-void Start(Config && config, std::string const& launch_time, std::string const& game_id);
+void Start(Config && config, std::string const& launch_time, std::string const& game_id,
+    boost::filesystem::path const& game_log_directory, size_t thread_count);
+void StartHost(Config && config, std::string const& launch_time, boost::filesystem::path const& log_directory, size_t thread_count,
+    std::optional<boost::asio::ip::tcp::endpoint> const& metrics_endpoint);
 
 } // namespace digitalcurling3_server
 
@@ -102,6 +111,27 @@ int main(int argc, char* argv[])
                 ("config,C", boost::program_options::value<std::string>(), buf_config_desc.str().c_str())
                 ("config-json", boost::program_options::value<std::string>(), "set config json text. do not set the option --config at the same time.")
                 ("log-dir", boost::program_options::value<std::string>(), buf_log_dir_desc.str().c_str())
+                ("host", "host multiple games on the same ports. each client specifies the match by \"match_id\" in dc_ok.")
+                ("threads", boost::program_options::value<size_t>()->default_value(1), "number of worker threads")
+                ("metrics-port", boost::program_options::value<unsigned short>(), "serve metrics in the Prometheus text format at http://<metrics-address>:<port>/metrics (with --host)")
+                ("metrics-address", boost::program_options::value<std::string>()->default_value("127.0.0.1"), "address the metrics listener binds to")
+                ("batch", boost::program_options::value<size_t>(), "run the specified number of games between in-process engines (--engine0, --engine1) without TCP")
+                ("tournament", boost::program_options::value<std::string>(), "run a tournament between in-process engines described in the specified json file (round-robin|swiss|gauntlet)")
+                ("replay", boost::program_options::value<std::string>(), "re-simulate every shot of the game logs under the specified directory without network and verify that the results match the logs")
+                ("batch-parallel", boost::program_options::value<size_t>(), "number of games played in parallel in batch and tournament mode (default: --threads)")
+                ("batch-fixed-teams", "do not swap the teams of the engines every other game in batch mode")
+                ("engine0", boost::program_options::value<std::string>(), "shared library of engine 0 for batch mode")
+                ("engine1", boost::program_options::value<std::string>(), "shared library of engine 1 for batch mode")
+                ("engine0-args", boost::program_options::value<std::string>()->default_value(""), "argument string passed to engine 0")
+                ("engine1-args", boost::program_options::value<std::string>()->default_value(""), "argument string passed to engine 1")
+                ("engine0-command", boost::program_options::value<std::string>(), "command line of engine 0 launched as a persistent subprocess (instead of --engine0)")
+                ("engine1-command", boost::program_options::value<std::string>(), "command line of engine 1 launched as a persistent subprocess (instead of --engine1)")
+                ("log-async", "write logs on a dedicated writer thread")
+                ("log-flush", boost::program_options::value<std::string>()->default_value("record"), "log flush policy (record|interval|shutdown)")
+                ("log-flush-interval", boost::program_options::value<unsigned int>()->default_value(1000), "log flush interval in milliseconds (with --log-flush interval)")
+                ("log-queue-size", boost::program_options::value<size_t>()->default_value(65536), "capacity of the log queue in records (with --log-async)")
+                ("log-overflow", boost::program_options::value<std::string>()->default_value("block"), "behavior when the log queue is full (block|drop)")
+                ("game-log-format", boost::program_options::value<std::string>()->default_value("files"), "game log format (files: game.dcl2 and one file per shot | container: single game.dclc file)")
                 ("version", "show version")
                 ("verbose,v", "verbose command line")
                 ("debug", "debug mode")
@@ -132,8 +162,54 @@ int main(int argc, char* argv[])
 
         bool const arg_verbose = vm.count("verbose");
         bool const arg_debug = vm.count("debug");
+        bool const arg_host = vm.count("host");
+        bool const arg_batch = vm.count("batch");
+        bool const arg_tournament = vm.count("tournament");
+        bool const arg_replay = vm.count("replay");
+        size_t const arg_threads = vm["threads"].as<size_t>();
+
+        Log::Options const log_options = [&] {
+            Log::Options options;
+            options.async = vm.count("log-async");
+
+            auto const flush = vm["log-flush"].as<std::string>();
+            if (flush == "record") {
+                options.flush_policy = Log::FlushPolicy::kEveryRecord;
+            } else if (flush == "interval") {
+                options.flush_policy = Log::FlushPolicy::kInterval;
+            } else if (flush == "shutdown") {
+                options.flush_policy = Log::FlushPolicy::kOnShutdown;
+            } else {
+                throw std::runtime_error("--log-flush must be one of record, interval and shutdown");
+            }
+            options.flush_interval = std::chrono::milliseconds(vm["log-flush-interval"].as<unsigned int>());
+
+            options.queue_capacity = vm["log-queue-size"].as<size_t>();
+            if (options.queue_capacity == 0) {
+                throw std::runtime_error("--log-queue-size must be 1 or more");
+            }
+
+            auto const overflow = vm["log-overflow"].as<std::string>();
+            if (overflow == "block") {
+                options.overflow_policy = Log::OverflowPolicy::kBlock;
+            } else if (overflow == "drop") {
+                options.overflow_policy = Log::OverflowPolicy::kDrop;
+            } else {
+                throw std::runtime_error("--log-overflow must be one of block and drop");
+            }
+
+            auto const game_log_format = vm["game-log-format"].as<std::string>();
+            if (game_log_format == "files") {
+                options.game_log_format = dcs::GameLogFormat::kFiles;
+            } else if (game_log_format == "container") {
+                options.game_log_format = dcs::GameLogFormat::kContainer;
+            } else {
+                throw std::runtime_error("--game-log-format must be one of files and container");
+            }
+            return options;
+        }();
 
-        log_instance.emplace(log_file_path, game_log_directory, arg_verbose, arg_debug); // ログシステムの起動
+        log_instance.emplace(log_file_path, arg_verbose, arg_debug, log_options); // ログシステムの起動
 
         {
             std::ostringstream buf;
@@ -191,12 +267,32 @@ int main(int argc, char* argv[])
             Log::Info(buf.str());
         }
 
-        {
+        if (!arg_host && !arg_batch && !arg_tournament && !arg_replay) {  // ホスティングモード，バッチモード，トーナメントモードでは試合ごとに作成する．リプレイモードでは作成しない．
             std::ostringstream buf;
             buf << "game log dir: \"" << game_log_directory.string() << "\"";
             Log::Info(buf.str());
         }
 
+        // --- リプレイモード(設定は試合ログから読むため，コンフィグは使わない) ---
+
+        if (arg_replay) {
+            if (arg_host || arg_batch || arg_tournament) {
+                throw std::runtime_error("option --replay can not be used with --host, --batch or --tournament");
+            }
+            if (arg_threads == 0) {
+                throw std::runtime_error("--threads must be 1 or more");
+            }
+
+            auto const results_file = [&] {
+                std::ostringstream buf;
+                buf << dcs::GetISO8601String(launch_time) << "_replay.json";
+                return log_directory / buf.str();
+            }();
+
+            bool const matched = dcs::StartReplay(boost::filesystem::absolute(vm["replay"].as<std::string>()), results_file, arg_threads);
+            return matched ? 0 : 1;
+        }
+
         // --- コンフィグのパース ---
 
         bool const arg_config = vm.count("config");
@@ -251,7 +347,93 @@ int main(int argc, char* argv[])
 
         // --- サーバーの起動 ---
 
-        dcs::Start(std::move(config), dcs::GetISO8601ExtendedString(launch_time), game_uuid_str);
+        if (arg_threads == 0) {
+            throw std::runtime_error("--threads must be 1 or more");
+        }
+
+        if (int(arg_host) + int(arg_batch) + int(arg_tournament) > 1) {
+            throw std::runtime_error("set at most one of option --host, --batch and --tournament");
+        }
+
+        if (vm.count("metrics-port") && !arg_host) {
+            throw std::runtime_error("option --metrics-port is only available with --host");
+        }
+
+        if (arg_batch || arg_tournament) {
+            dcs::BatchOptions batch_options;
+            batch_options.parallel = vm.count("batch-parallel") ? vm["batch-parallel"].as<size_t>() : arg_threads;
+            if (batch_options.parallel == 0) {
+                throw std::runtime_error("--batch-parallel must be 1 or more");
+            }
+            batch_options.results_file = [&] {
+                std::ostringstream buf;
+                buf << dcs::GetISO8601String(launch_time) << "_results.json";
+                return log_directory / buf.str();
+            }();
+
+            if (arg_batch) {
+                for (size_t i = 0; i < 2; ++i) {
+                    std::string const engine_option = i == 0 ? "engine0" : "engine1";
+                    bool const has_library = vm.count(engine_option);
+                    bool const has_command = vm.count(engine_option + "-command");
+                    if (has_library == has_command) {
+                        throw std::runtime_error("specify exactly one of --engineN and --engineN-command for each engine in batch mode");
+                    }
+                    if (has_library) {
+                        batch_options.engines.push_back({
+                            engine_option,
+                            dcs::LoadEngineLibrary(
+                                boost::filesystem::absolute(vm[engine_option].as<std::string>()),
+                                vm[engine_option + "-args"].as<std::string>()) });
+                    } else {
+                        batch_options.engines.push_back({
+                            engine_option,
+                            dcs::LaunchEngineProcess(vm[engine_option + "-command"].as<std::string>(), config.server.timeout_dc_ok) });
+                    }
+                }
+                batch_options.schedule = dcs::CreateRepeatedSchedule(vm["batch"].as<size_t>(), !vm.count("batch-fixed-teams"));
+            } else {
+                auto const tournament_path = boost::filesystem::absolute(vm["tournament"].as<std::string>());
+                {
+                    std::ostringstream buf;
+                    buf << "tournament file: \"" << tournament_path.string() << "\"";
+                    Log::Info(buf.str());
+                }
+
+                boost::nowide::ifstream tournament_file(tournament_path);
+                if (!tournament_file) {
+                    throw std::runtime_error("could not open tournament file");
+                }
+                auto const tournament = nlohmann::json::parse(tournament_file, nullptr, true, true).get<dcs::TournamentSettings>();
+
+                for (auto const& engine : tournament.engines) {
+                    if (!engine.library.empty()) {
+                        // ライブラリのパスは設定ファイルからの相対パス
+                        batch_options.engines.push_back({
+                            engine.name,
+                            dcs::LoadEngineLibrary(
+                                boost::filesystem::absolute(engine.library, tournament_path.parent_path()),
+                                engine.args) });
+                    } else {
+                        batch_options.engines.push_back({ engine.name, dcs::LaunchEngineProcess(engine.command, config.server.timeout_dc_ok) });
+                    }
+                }
+                batch_options.schedule = dcs::CreateSchedule(tournament.scheme, tournament.engines.size(),
+                    tournament.rounds, tournament.games_per_pairing);
+            }
+
+            dcs::StartBatch(std::move(config), std::move(batch_options), log_directory, arg_threads);
+        } else if (arg_host) {
+            std::optional<boost::asio::ip::tcp::endpoint> metrics_endpoint;
+            if (vm.count("metrics-port")) {
+                metrics_endpoint.emplace(
+                    boost::asio::ip::make_address(vm["metrics-address"].as<std::string>()),
+                    vm["metrics-port"].as<unsigned short>());
+            }
+            dcs::StartHost(std::move(config), dcs::GetISO8601ExtendedString(launch_time), log_directory, arg_threads, metrics_endpoint);
+        } else {
+            dcs::Start(std::move(config), dcs::GetISO8601ExtendedString(launch_time), game_uuid_str, game_log_directory, arg_threads);
+        }
 
         Log::Info("server terminated successfully");
 
@@ -0,0 +1,134 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "message_template.hpp"
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include "config.hpp"
+#include "version.hpp"
+
+namespace dc = digitalcurling3;
+
+namespace digitalcurling3_server {
+
+// --- MessageTemplate ---
+
+MessageTemplate::MessageTemplate(nlohmann::json const& json, std::initializer_list<std::string_view> slot_names)
+    : segments_()
+    , slots_()
+{
+    std::string const text = json.dump();
+
+    // 各スロットの位置を探す(スロットの値は文字列なので，引用符を含めた全体を置き換える)
+    struct Position {
+        size_t begin;
+        size_t end;
+        size_t slot;
+    };
+    std::vector<Position> positions;
+    size_t slot = 0;
+    for (auto const name : slot_names) {
+        std::string const slot_text = nlohmann::json(Slot(name)).dump();
+        size_t const begin = text.find(slot_text);
+        if (begin == std::string::npos || text.find(slot_text, begin + 1) != std::string::npos) {
+            throw std::logic_error("message template: each slot must appear exactly once");
+        }
+        positions.push_back({ begin, begin + slot_text.size(), slot });
+        ++slot;
+    }
+    std::sort(positions.begin(), positions.end(),
+        [](Position const& a, Position const& b) { return a.begin < b.begin; });
+
+    size_t prev_end = 0;
+    for (auto const& position : positions) {
+        segments_.emplace_back(text, prev_end, position.begin - prev_end);
+        slots_.emplace_back(position.slot);
+        prev_end = position.end;
+    }
+    segments_.emplace_back(text, prev_end, std::string::npos);
+}
+
+std::string MessageTemplate::Slot(std::string_view name)
+{
+    // 通常のメッセージに現れない制御文字で囲む
+    std::string slot = "\x01" "dcs-slot:";
+    slot += name;
+    slot += '\x01';
+    return slot;
+}
+
+SharedMessage MessageTemplate::Render(std::initializer_list<std::string_view> values) const
+{
+    assert(values.size() == slots_.size());
+
+    size_t size = 1;  // SharedMessage が追加する改行文字の分
+    for (auto const& segment : segments_) {
+        size += segment.size();
+    }
+    for (auto const value : values) {
+        size += value.size();
+    }
+
+    std::string message;
+    message.reserve(size);
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        message += segments_[i];
+        message += values.begin()[slots_[i]];
+    }
+    message += segments_.back();
+
+    return SharedMessage(std::move(message));
+}
+
+
+// --- GameMessageTemplates ---
+
+std::shared_ptr<GameMessageTemplates const> GameMessageTemplates::Create(Config const& config)
+{
+    nlohmann::json const json_dc{
+        { "cmd", "dc" },
+        { "version", {
+            { "major", GetProtocolVersionMajor() },
+            { "minor", GetProtocolVersionMinor() },
+        }},
+        { "game_id", MessageTemplate::Slot("game_id") },
+        { "date_time", MessageTemplate::Slot("date_time") } };
+
+    nlohmann::json const json_is_ready{
+        { "cmd", "is_ready" },
+        { "game", config.game_is_ready },
+        { "team", MessageTemplate::Slot("team") } };
+
+    nlohmann::json json_new_game{
+        { "cmd", "new_game" } };
+    for (size_t i = 0; i < 2; ++i) {
+        json_new_game["name"][dc::ToString(static_cast<dc::Team>(i))] = MessageTemplate::Slot(dc::ToString(static_cast<dc::Team>(i)));
+    }
+
+    return std::make_shared<GameMessageTemplates const>(GameMessageTemplates{
+        MessageTemplate(json_dc, { "game_id", "date_time" }),
+        MessageTemplate(json_is_ready, { "team" }),
+        MessageTemplate(json_new_game, { dc::ToString(dc::Team::k0), dc::ToString(dc::Team::k1) }) });
+}
+
+} // namespace digitalcurling3_server
@@ -0,0 +1,88 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_MESSAGE_TEMPLATE_HPP
+#define DIGITALCURLING3_SERVER_MESSAGE_TEMPLATE_HPP
+
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "shared_message.hpp"
+
+namespace digitalcurling3_server {
+
+struct Config;
+
+/// \brief シリアライズ済みのメッセージのひな形
+///
+/// 一部の値(スロット)だけが異なるメッセージを，JSONの木を辿らずに文字列の連結で作る．
+/// 作られるメッセージは，スロットに値を入れたJSONを dump() したものとバイト単位で一致する．
+class MessageTemplate {
+public:
+    /// \param json ひな形．スロットにする箇所には Slot() で得た値を入れておく．
+    /// \param slot_names スロット名．各スロットは json 中にちょうど1回現れる必要がある．
+    MessageTemplate(nlohmann::json const& json, std::initializer_list<std::string_view> slot_names);
+
+    /// \brief スロットにする箇所に入れておく値を得る
+    ///
+    /// \param name スロット名
+    /// \return スロットの目印となる文字列
+    static std::string Slot(std::string_view name);
+
+    /// \brief メッセージを作る
+    ///
+    /// \param values 各スロットの値(JSONとしてシリアライズしたもの)．コンストラクタで指定したスロット名の順に並べる．
+    /// \return メッセージ
+    SharedMessage Render(std::initializer_list<std::string_view> values) const;
+
+private:
+    std::vector<std::string> segments_;  // スロット以外の部分(要素数はスロット数 + 1)
+    std::vector<size_t> slots_;  // segments_[i] の後に入るスロットの番号
+};
+
+
+/// \brief 試合開始までのメッセージのひな形
+///
+/// 1プロセスで複数の試合をホストする場合，全ての試合で共有する．
+struct GameMessageTemplates {
+    /// \brief dc (スロット: game_id, date_time)
+    MessageTemplate dc;
+
+    /// \brief is_ready (スロット: team)
+    MessageTemplate is_ready;
+
+    /// \brief new_game (スロット: team0 の名前, team1 の名前)
+    MessageTemplate new_game;
+
+    /// \brief コンフィグからひな形を作る
+    ///
+    /// \param config コンフィグ
+    /// \return ひな形
+    static std::shared_ptr<GameMessageTemplates const> Create(Config const& config);
+};
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_MESSAGE_TEMPLATE_HPP
@@ -0,0 +1,246 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "metrics.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <vector>
+#include "log.hpp"
+#include "timing.hpp"
+
+namespace digitalcurling3_server {
+
+namespace {
+
+using namespace std::string_view_literals;
+
+constexpr size_t kCounterCount = static_cast<size_t>(Metrics::Counter::kCount);
+constexpr size_t kGaugeCount = static_cast<size_t>(Metrics::Gauge::kCount);
+
+/// \brief 1スレッド分の値
+///
+/// 書き込むのは所有するスレッドのみ． CreateText() は他のスレッドから読み出すため atomic にしておく．
+struct alignas(64) Shard {
+    std::array<std::atomic<std::uint64_t>, kCounterCount> counters{};
+    std::array<std::atomic<std::int64_t>, kGaugeCount> gauges{};
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Shard>> shards;  // 全てのスレッドの値(破棄しない)
+    std::vector<Shard *> free_shards;  // 終了したスレッドの値
+};
+
+Registry & GetRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+/// \brief スレッドに Shard を割り当てる．スレッドの終了時に返却する．
+class ShardHolder {
+public:
+    ShardHolder()
+        : shard_(nullptr)
+    {
+        auto & registry = GetRegistry();
+        std::lock_guard g(registry.mutex);
+        if (registry.free_shards.empty()) {
+            registry.shards.emplace_back(std::make_unique<Shard>());
+            shard_ = registry.shards.back().get();
+        } else {
+            shard_ = registry.free_shards.back();
+            registry.free_shards.pop_back();
+        }
+    }
+
+    ShardHolder(ShardHolder const&) = delete;
+    ShardHolder & operator = (ShardHolder const&) = delete;
+
+    ~ShardHolder()
+    {
+        auto & registry = GetRegistry();
+        std::lock_guard g(registry.mutex);
+        registry.free_shards.push_back(shard_);
+    }
+
+    Shard & Get() { return *shard_; }
+
+private:
+    Shard * shard_;
+};
+
+inline Shard & GetShard()
+{
+    thread_local ShardHolder holder;
+    return holder.Get();
+}
+
+template <class T>
+inline void AddRelaxed(std::atomic<T> & target, T value)
+{
+    // 書き込むのは1スレッドのみのため，RMW命令は不要
+    target.store(target.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+struct CounterInfo {
+    std::string_view name;
+    std::string_view help;
+};
+
+constexpr std::array<CounterInfo, kCounterCount> kCounterInfos{{
+    { "dcs_games_started_total"sv, "Number of games started."sv },
+    { "dcs_games_finished_total"sv, "Number of games finished normally."sv },
+    { "dcs_games_aborted_total"sv, "Number of games aborted after start."sv },
+    { "dcs_shots_total"sv, "Number of shots simulated."sv },
+    { "dcs_timeouts_total"sv, "Number of thinking time expirations."sv },
+    { "dcs_simulation_seconds_total"sv, "Total time spent in ApplyMove."sv },
+    { "dcs_sessions_opened_total"sv, "Number of client sessions opened."sv },
+    { "dcs_messages_sent_total"sv, "Number of messages sent to clients."sv },
+    { "dcs_bytes_sent_total"sv, "Number of bytes sent to clients."sv },
+    { "dcs_messages_received_total"sv, "Number of messages received from clients."sv },
+    { "dcs_bytes_received_total"sv, "Number of bytes received from clients."sv },
+    { "dcs_log_records_total"sv, "Number of log records submitted."sv },
+    { "dcs_log_records_dropped_total"sv, "Number of log records dropped because the log queue was full."sv },
+    { "dcs_speculations_total"sv, "Number of hinted moves simulated speculatively."sv },
+    { "dcs_speculation_hits_total"sv, "Number of moves applied from a speculative simulation."sv },
+}};
+
+constexpr std::array<CounterInfo, kGaugeCount> kGaugeInfos{{
+    { "dcs_running_games"sv, "Number of games in progress."sv },
+    { "dcs_open_sessions"sv, "Number of open client sessions."sv },
+}};
+
+template <class T>
+void WriteMetric(std::ostringstream & buf, std::string_view name, std::string_view help, std::string_view type, T value)
+{
+    buf << "# HELP " << name << ' ' << help << '\n'
+        << "# TYPE " << name << ' ' << type << '\n'
+        << name << ' ' << value << '\n';
+}
+
+} // unnamed namespace
+
+void Metrics::Add(Counter counter, std::uint64_t value)
+{
+    AddRelaxed(GetShard().counters[static_cast<size_t>(counter)], value);
+}
+
+void Metrics::Add(Gauge gauge, std::int64_t value)
+{
+    AddRelaxed(GetShard().gauges[static_cast<size_t>(gauge)], value);
+}
+
+std::uint64_t Metrics::Get(Counter counter)
+{
+    auto & registry = GetRegistry();
+    std::lock_guard g(registry.mutex);
+    std::uint64_t sum = 0;
+    for (auto const& shard : registry.shards) {
+        sum += shard->counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+std::int64_t Metrics::Get(Gauge gauge)
+{
+    auto & registry = GetRegistry();
+    std::lock_guard g(registry.mutex);
+    std::int64_t sum = 0;
+    for (auto const& shard : registry.shards) {
+        sum += shard->gauges[static_cast<size_t>(gauge)].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+std::string Metrics::CreateText()
+{
+    std::array<std::uint64_t, kCounterCount> counters{};
+    std::array<std::int64_t, kGaugeCount> gauges{};
+    {
+        auto & registry = GetRegistry();
+        std::lock_guard g(registry.mutex);
+        for (auto const& shard : registry.shards) {
+            for (size_t i = 0; i < kCounterCount; ++i) {
+                counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+            }
+            for (size_t i = 0; i < kGaugeCount; ++i) {
+                gauges[i] += shard->gauges[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::ostringstream buf;
+    for (size_t i = 0; i < kCounterCount; ++i) {
+        if (static_cast<Counter>(i) == Counter::kSimulationNanoseconds) {
+            // ナノ秒単位の整数を秒に変換する(桁落ちしないよう文字列で組み立てる)
+            std::ostringstream seconds;
+            seconds << counters[i] / 1000000000 << '.' << std::setw(9) << std::setfill('0') << counters[i] % 1000000000;
+            WriteMetric(buf, kCounterInfos[i].name, kCounterInfos[i].help, "counter"sv, seconds.str());
+        } else {
+            WriteMetric(buf, kCounterInfos[i].name, kCounterInfos[i].help, "counter"sv, counters[i]);
+        }
+    }
+    for (size_t i = 0; i < kGaugeCount; ++i) {
+        WriteMetric(buf, kGaugeInfos[i].name, kGaugeInfos[i].help, "gauge"sv, gauges[i]);
+    }
+
+    // 問い合わせ時に取得する値
+    WriteMetric(buf, "dcs_log_queue_depth"sv, "Number of log records waiting in the log queue."sv, "gauge"sv, Log::GetQueueDepth());
+    WriteMetric(buf, "dcs_log_queue_capacity"sv, "Capacity of the log queue (0 in synchronous mode)."sv, "gauge"sv, Log::GetQueueCapacity());
+
+    return buf.str();
+}
+
+std::string Metrics::CreateText(GameTiming const& timing)
+{
+    constexpr auto kName = "dcs_phase_seconds"sv;
+    constexpr std::array<std::pair<std::string_view, double>, 4> kQuantiles{{
+        { "0.5"sv, 50.0 }, { "0.9"sv, 90.0 }, { "0.99"sv, 99.0 }, { "0.999"sv, 99.9 },
+    }};
+    auto const to_seconds = [](std::chrono::nanoseconds value) { return std::chrono::duration<double>(value).count(); };
+
+    std::ostringstream buf;
+    buf << CreateText()
+        << "# HELP " << kName << " Processing time per phase of games with \"timing\" enabled.\n"
+        << "# TYPE " << kName << " summary\n";
+    for (size_t i = 0; i < static_cast<size_t>(TimingPhase::kCount); ++i) {
+        auto const phase = static_cast<TimingPhase>(i);
+        auto const& histogram = timing.Get(phase);
+        for (auto const& [label, percentile] : kQuantiles) {
+            buf << kName << "{phase=\"" << ToString(phase) << "\",quantile=\"" << label << "\"} "
+                << to_seconds(histogram.GetPercentile(percentile)) << '\n';
+        }
+        buf << kName << "_sum{phase=\"" << ToString(phase) << "\"} " << to_seconds(histogram.GetSum()) << '\n'
+            << kName << "_count{phase=\"" << ToString(phase) << "\"} " << histogram.GetCount() << '\n';
+    }
+    return buf.str();
+}
+
+} // namespace digitalcurling3_server
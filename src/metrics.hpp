@@ -0,0 +1,111 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_METRICS_HPP
+#define DIGITALCURLING3_SERVER_METRICS_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace digitalcurling3_server {
+
+class GameTiming;
+
+/// \brief サーバーの稼働状況のカウンタとゲージ
+///
+/// 値はスレッドごとに持ち，更新はそのスレッドの値への relaxed な読み書きのみで行う(ロックもRMW命令も使わない)．
+/// 全スレッドの値は CreateText() を呼び出した時に合計する．
+/// 終了したスレッドの値は破棄せず，次に作られたスレッドが引き継いで加算を続ける．
+///
+/// Log と同じく静的関数のみを持ち，どのスレッドからでも呼び出せる．
+class Metrics {
+public:
+    /// \brief 単調増加する値
+    enum class Counter {
+        kGamesStarted,           ///< 開始した試合(new_gameを送信した試合)
+        kGamesFinished,          ///< 正常に終了した試合
+        kGamesAborted,           ///< 開始後にエラーや停止により中断した試合
+        kShots,                  ///< 処理したショット
+        kTimeouts,               ///< 思考時間切れ
+        kSimulationNanoseconds,  ///< digitalcurling3::ApplyMove() にかかった時間の合計
+        kSessionsOpened,         ///< 開いたクライアントとのセッション
+        kMessagesSent,           ///< クライアントに送信したメッセージ
+        kBytesSent,              ///< クライアントに送信したバイト数
+        kMessagesReceived,       ///< クライアントから受信したメッセージ
+        kBytesReceived,          ///< クライアントから受信したバイト数
+        kLogRecords,             ///< ログのレコード
+        kLogRecordsDropped,      ///< キューが満杯のため破棄したログのレコード
+        kSpeculations,           ///< hint により事前シミュレーションを始めた手
+        kSpeculationHits,        ///< 事前シミュレーションの結果を使った手
+        kCount,
+    };
+
+    /// \brief 増減する値
+    enum class Gauge {
+        kRunningGames,  ///< 進行中の試合
+        kOpenSessions,  ///< 開いているクライアントとのセッション
+        kCount,
+    };
+
+    Metrics() = delete;
+
+    /// \brief カウンタに加算する
+    ///
+    /// \param counter カウンタ
+    /// \param value 加算する値
+    static void Add(Counter counter, std::uint64_t value = 1);
+
+    /// \brief ゲージに加算する
+    ///
+    /// \param gauge ゲージ
+    /// \param value 加算する値(負の値で減算)
+    static void Add(Gauge gauge, std::int64_t value);
+
+    /// \brief 全スレッドの値を合計する
+    ///
+    /// \param counter カウンタ
+    /// \return 合計
+    static std::uint64_t Get(Counter counter);
+
+    /// \brief 全スレッドの値を合計する
+    ///
+    /// \param gauge ゲージ
+    /// \return 合計
+    static std::int64_t Get(Gauge gauge);
+
+    /// \brief Prometheus のテキスト形式(version 0.0.4)で全ての値を出力する
+    ///
+    /// ログのキューの状態など，問い合わせ時に取得する値も含む．
+    ///
+    /// \return 出力したテキスト
+    static std::string CreateText();
+
+    /// \brief CreateText() の値に加えて，処理ごとの処理時間を summary として出力する
+    ///
+    /// \param timing 全ての試合の処理時間( TimingRegistry::Collect() で合計したもの)
+    /// \return 出力したテキスト
+    static std::string CreateText(GameTiming const& timing);
+};
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_METRICS_HPP
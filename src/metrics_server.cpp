@@ -0,0 +1,224 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "metrics_server.hpp"
+
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+#include "log.hpp"
+#include "metrics.hpp"
+#include "timing.hpp"
+
+namespace digitalcurling3_server {
+
+using boost::asio::ip::tcp;
+using namespace std::string_view_literals;
+
+namespace {
+
+constexpr size_t kMaxRequestSize = 8192;
+constexpr auto kRequestTimeout = std::chrono::seconds(5);
+
+std::string CreateResponse(std::string_view status, std::string_view content_type, std::string_view body, bool head)
+{
+    std::ostringstream buf;
+    buf << "HTTP/1.0 " << status << "\r\n"
+        << "Content-Type: " << content_type << "\r\n"
+        << "Content-Length: " << body.size() << "\r\n"
+        << "Connection: close\r\n"
+        << "\r\n";
+    if (!head) {
+        buf << body;
+    }
+    return buf.str();
+}
+
+} // unnamed namespace
+
+
+/// \brief 1つのHTTPリクエストを処理する接続
+class MetricsServer::Connection : public std::enable_shared_from_this<MetricsServer::Connection> {
+public:
+    Connection(MetricsServer & server, tcp::socket && socket)
+        : server_(server)
+        , socket_(std::move(socket))
+        , request_()
+        , response_()
+        , deadline_(server.strand_)
+    {}
+
+    void Start()
+    {
+        deadline_.expires_after(kRequestTimeout);
+        deadline_.async_wait(
+            [this, self = shared_from_this()](boost::system::error_code const& error)
+            {
+                if (error) return;  // キャンセルされた
+                Close();
+            });
+
+        boost::asio::async_read_until(socket_,
+            boost::asio::dynamic_buffer(request_, kMaxRequestSize), "\r\n\r\n"sv,
+            boost::asio::bind_executor(server_.strand_, [this, self = shared_from_this()](boost::system::error_code const& error, std::size_t /* n */)
+            {
+                if (!socket_.is_open()) {
+                    return;
+                }
+
+                if (error == boost::asio::error::not_found) {
+                    Respond(CreateResponse("431 Request Header Fields Too Large"sv, "text/plain"sv, "request too large\n"sv, false));
+                    return;
+                }
+
+                if (error) {
+                    Close();
+                    return;
+                }
+
+                HandleRequest();
+            }));
+    }
+
+private:
+    MetricsServer & server_;
+    tcp::socket socket_;
+    std::string request_;
+    std::string response_;
+    boost::asio::steady_timer deadline_;
+
+    void HandleRequest()
+    {
+        // リクエストラインのみ解釈する: <method> SP <target> SP <version>
+        std::string_view const request(request_);
+        auto const line = request.substr(0, request.find("\r\n"sv));
+        auto const method_end = line.find(' ');
+        auto const target_end = method_end == std::string_view::npos ? std::string_view::npos : line.find(' ', method_end + 1);
+        if (target_end == std::string_view::npos) {
+            Respond(CreateResponse("400 Bad Request"sv, "text/plain"sv, "bad request\n"sv, false));
+            return;
+        }
+        auto const method = line.substr(0, method_end);
+        auto target = line.substr(method_end + 1, target_end - method_end - 1);
+        target = target.substr(0, target.find('?'));
+
+        bool const head = method == "HEAD"sv;
+        if (method != "GET"sv && !head) {
+            Respond(CreateResponse("405 Method Not Allowed"sv, "text/plain"sv, "method not allowed\n"sv, false));
+        } else if (target != "/metrics"sv) {
+            Respond(CreateResponse("404 Not Found"sv, "text/plain"sv, "not found\n"sv, head));
+        } else {
+            // 処理時間は各試合のストランド上で合計するため，応答は合計の完了後に送る
+            TimingRegistry::Collect([this, self = shared_from_this(), head](GameTiming const& timing)
+            {
+                auto response = CreateResponse("200 OK"sv, "text/plain; version=0.0.4; charset=utf-8"sv, Metrics::CreateText(timing), head);
+                boost::asio::post(server_.strand_, [this, self, response = std::move(response)]() mutable
+                {
+                    if (!socket_.is_open()) {
+                        return;  // タイムアウトで閉じられた
+                    }
+                    Respond(std::move(response));
+                });
+            });
+        }
+    }
+
+    void Respond(std::string && response)
+    {
+        response_ = std::move(response);
+        boost::asio::async_write(socket_,
+            boost::asio::buffer(response_),
+            boost::asio::bind_executor(server_.strand_, [this, self = shared_from_this()](boost::system::error_code const& /* error */, std::size_t /* n */)
+            {
+                Close();
+            }));
+    }
+
+    void Close()
+    {
+        boost::system::error_code ignored_error;
+        socket_.shutdown(tcp::socket::shutdown_both, ignored_error);
+        socket_.close(ignored_error);
+        deadline_.cancel();
+    }
+};
+
+
+MetricsServer::MetricsServer(boost::asio::io_context & io_context, tcp::endpoint const& endpoint)
+    : strand_(boost::asio::make_strand(io_context))
+    , acceptor_(io_context, endpoint)
+    , stopped_(false)
+{
+    {
+        std::ostringstream buf;
+        buf << "metrics: http://" << acceptor_.local_endpoint() << "/metrics";
+        Log::Info(buf.str());
+    }
+
+    Accept();
+}
+
+void MetricsServer::Stop()
+{
+    boost::asio::post(strand_,
+        [this]
+        {
+            if (stopped_) return;
+            stopped_ = true;
+
+            boost::system::error_code ignored_error;
+            acceptor_.close(ignored_error);
+
+            Log::Debug("metrics server stopped");
+        });
+}
+
+void MetricsServer::Accept()
+{
+    acceptor_.async_accept(
+        boost::asio::bind_executor(strand_, [this](boost::system::error_code const& error, tcp::socket && socket)
+        {
+            if (stopped_) {
+                return;
+            }
+
+            if (error) {
+                std::ostringstream buf;
+                buf << "metrics: accept failed (error code: " << error.value() << ")";
+                Log::Warning(buf.str());
+            } else {
+                std::make_shared<Connection>(*this, std::move(socket))->Start();
+            }
+
+            Accept();
+        }));
+}
+
+} // namespace digitalcurling3_server
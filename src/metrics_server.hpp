@@ -0,0 +1,66 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_METRICS_SERVER_HPP
+#define DIGITALCURLING3_SERVER_METRICS_SERVER_HPP
+
+#include <optional>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/strand.hpp>
+
+namespace digitalcurling3_server {
+
+/// \brief Metrics の値をHTTPで公開する
+///
+/// `GET /metrics` に Prometheus のテキスト形式で応答する最小限のHTTP/1.0サーバー．
+/// Metrics の値に加えて， TimingRegistry で合計した処理時間も出力する．
+/// 1接続につき1リクエストのみ処理し，応答後に接続を閉じる．
+/// 認証は行わないため，ループバックアドレスなど外部から到達できないアドレスで待ち受けること．
+///
+/// 試合と同じ io_context 上で動作し，ハンドラは MetricsServer のストランド上で実行される．
+class MetricsServer {
+public:
+    /// \param io_context 使用する io_context
+    /// \param endpoint 待ち受けるアドレスとポート
+    MetricsServer(boost::asio::io_context & io_context, boost::asio::ip::tcp::endpoint const& endpoint);
+    MetricsServer(MetricsServer const&) = delete;
+    MetricsServer & operator = (MetricsServer const&) = delete;
+
+    /// \brief 接続の受付を止める
+    ///
+    /// どのスレッドからでも呼び出せる．処理中の接続は応答後に閉じられる．
+    void Stop();
+
+private:
+    class Connection;
+
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    bool stopped_;
+
+    void Accept();
+};
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_METRICS_SERVER_HPP
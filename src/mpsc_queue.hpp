@@ -0,0 +1,155 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_MPSC_QUEUE_HPP
+#define DIGITALCURLING3_SERVER_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace digitalcurling3_server {
+
+/// \brief 容量固定のロックフリーなキュー(複数の生産者，単一の消費者)
+///
+/// Dmitry Vyukov の bounded MPMC queue を消費者1つに特化したもの．
+/// 各セルのシーケンス番号で所有権を受け渡すため，生産者同士の競合は CAS 1回で解決する．
+///
+/// \tparam T 要素の型(デフォルト構築可能かつムーブ代入可能)
+template <class T>
+class MPSCQueue {
+public:
+    /// \param capacity 容量．2のべき乗に切り上げる．
+    explicit MPSCQueue(size_t capacity)
+        : capacity_(RoundUpToPowerOfTwo(capacity))
+        , mask_(capacity_ - 1)
+        , cells_(std::make_unique<Cell[]>(capacity_))
+        , enqueue_pos_(0)
+        , dequeue_pos_(0)
+    {
+        for (size_t i = 0; i < capacity_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MPSCQueue(MPSCQueue const&) = delete;
+    MPSCQueue & operator = (MPSCQueue const&) = delete;
+
+    /// \brief 要素を追加する(複数のスレッドから呼び出せる)
+    ///
+    /// \param value 追加する要素．失敗した場合はムーブされない．
+    /// \return キューが満杯で追加できなかった場合 \c false
+    bool TryPush(T && value)
+    {
+        Cell * cell;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t const sequence = cell->sequence.load(std::memory_order_acquire);
+            auto const diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;  // 満杯
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// \brief 要素を取り出す(消費者のスレッドからのみ呼び出す)
+    ///
+    /// \param value 取り出した要素の格納先
+    /// \return キューが空の場合 \c false
+    bool TryPop(T & value)
+    {
+        size_t const pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell & cell = cells_[pos & mask_];
+        size_t const sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos + 1) < 0) {
+            return false;  // 空(または書き込み途中)
+        }
+
+        value = std::move(cell.value);
+        cell.value = T();  // 保持しているリソースを早めに解放する
+        cell.sequence.store(pos + capacity_, std::memory_order_release);
+        dequeue_pos_.store(pos + 1, std::memory_order_relaxed);  // 書き込むのは消費者のみ
+        return true;
+    }
+
+    /// \brief 取り出せる要素が無いか(消費者のスレッドからのみ呼び出す)
+    bool IsEmpty() const
+    {
+        size_t const pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell const& cell = cells_[pos & mask_];
+        size_t const sequence = cell.sequence.load(std::memory_order_acquire);
+        return static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos + 1) < 0;
+    }
+
+    /// \brief おおよその要素数(任意のスレッドから呼び出せる)
+    ///
+    /// 統計用．他のスレッドの操作と同時に呼び出した場合，直前または直後の値になりうる．
+    size_t GetSizeApprox() const
+    {
+        size_t const dequeue_pos = dequeue_pos_.load(std::memory_order_relaxed);
+        size_t const enqueue_pos = enqueue_pos_.load(std::memory_order_relaxed);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+
+    size_t GetCapacity() const { return capacity_; }
+
+private:
+    static constexpr size_t kCacheLineSize = 64;
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t RoundUpToPowerOfTwo(size_t n)
+    {
+        assert(n >= 1);
+        size_t result = 1;
+        while (result < n) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    size_t const capacity_;
+    size_t const mask_;
+    std::unique_ptr<Cell[]> const cells_;
+    alignas(kCacheLineSize) std::atomic<size_t> enqueue_pos_;
+    alignas(kCacheLineSize) std::atomic<size_t> dequeue_pos_;
+};
+
+} // namespace digitalcurling3_server
+
+#endif
@@ -0,0 +1,428 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "engine.hpp"
+
+#include <cassert>
+#include <csignal>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/process.hpp>
+#include "nlohmann/json.hpp"
+#include "log.hpp"
+
+namespace digitalcurling3_server {
+
+namespace bp = boost::process;
+using namespace std::string_view_literals;
+
+namespace {
+
+/// 起動したエンジンのプロセス1つ．標準出力は応答を待つ間だけ，呼び出し元のストランド上で非同期に読み取る．
+///
+/// 読み取り中のハンドラが参照するため共有する．
+class EngineProcess : public std::enable_shared_from_this<EngineProcess> {
+public:
+    /// 読み取った1行を受け取る関数．取り消された場合は std::nullopt
+    using LineHandler = std::function<void(std::exception_ptr error, std::optional<std::string> && line)>;
+
+    EngineProcess(boost::asio::io_context & io_context, std::string const& command)
+        : input_()
+        , output_(io_context)
+        , child_(command, bp::std_in < input_, bp::std_out > output_)
+        , read_buffer_()
+        , lines_()
+        , exited_(false)
+    {}
+
+    EngineProcess(EngineProcess const&) = delete;
+    EngineProcess & operator = (EngineProcess const&) = delete;
+
+    ~EngineProcess()
+    {
+        std::error_code ignored_error;
+        if (child_.running(ignored_error)) {
+            child_.terminate(ignored_error);
+        }
+        input_.close();
+    }
+
+    void Write(std::string_view message)
+    {
+        input_.write(message.data(), static_cast<std::streamsize>(message.size()));
+        input_.put('\n');
+        input_.flush();
+        if (!input_) {
+            throw std::runtime_error("could not write to engine process");
+        }
+    }
+
+    /// 1行を読み，ストランドにポストして handler を呼び出す．読み取りは CancelRead() で取り消せる
+    void AsyncReadLine(Engine::Strand const& strand, LineHandler && handler)
+    {
+        if (!lines_.empty() || exited_) {
+            boost::asio::post(strand, [self = shared_from_this(), handler = std::move(handler)]
+                {
+                    self->DeliverLine(handler);
+                });
+            return;
+        }
+
+        boost::asio::async_read_until(output_, boost::asio::dynamic_buffer(read_buffer_), '\n',
+            boost::asio::bind_executor(strand, [self = shared_from_this(), strand, handler = std::move(handler)](
+                boost::system::error_code const& error, std::size_t /* n */) mutable
+            {
+                self->SplitLines();
+                if (error == boost::asio::error::operation_aborted) {
+                    handler(nullptr, std::nullopt);  // 取り消された(読み取り済みの行は次に読む)
+                    return;
+                }
+                if (error) {
+                    self->exited_ = true;  // EOF など
+                }
+                self->DeliverLine(handler);
+            }));
+    }
+
+    /// 読み取りを取り消す(読み取り中のストランド上で呼び出す)
+    void CancelRead()
+    {
+        if (output_.is_open()) {
+            output_.cancel();
+        }
+    }
+
+    /// 読み取り済みの行があれば1行を返す
+    std::optional<std::string> TryPopLine()
+    {
+        if (lines_.empty()) {
+            return std::nullopt;
+        }
+        std::string line = std::move(lines_.front());
+        lines_.pop_front();
+        return line;
+    }
+
+    /// 次の試合で再利用できるか(プロセスが動いていて，未読の出力が無い)．読み取り中でないときに呼び出す
+    bool IsReusable()
+    {
+        std::error_code ignored_error;
+        return !exited_ && lines_.empty() && read_buffer_.empty() && child_.running(ignored_error);
+    }
+
+private:
+    bp::opstream input_;
+    bp::async_pipe output_;
+    bp::child child_;
+    std::string read_buffer_;  // 改行まで届いていない出力
+    std::deque<std::string> lines_;
+    bool exited_;
+
+    void SplitLines()
+    {
+        size_t begin = 0;
+        for (size_t end; (end = read_buffer_.find('\n', begin)) != std::string::npos; begin = end + 1) {
+            std::string line = read_buffer_.substr(begin, end - begin);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            lines_.emplace_back(std::move(line));
+        }
+        read_buffer_.erase(0, begin);
+    }
+
+    void DeliverLine(LineHandler const& handler)
+    {
+        if (auto line = TryPopLine()) {
+            handler(nullptr, std::move(line));
+        } else {
+            assert(exited_);
+            handler(std::make_exception_ptr(std::runtime_error("engine process exited")), std::nullopt);
+        }
+    }
+};
+
+
+/// 試合に使っていないプロセス
+class EngineProcessPool {
+public:
+    explicit EngineProcessPool(std::string const& command)
+        : command_(command)
+    {}
+
+    std::shared_ptr<EngineProcess> Acquire(boost::asio::io_context & io_context)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            while (!idle_.empty()) {
+                auto process = std::move(idle_.back());
+                idle_.pop_back();
+                if (process->IsReusable()) {
+                    return process;
+                }
+            }
+        }
+
+        std::ostringstream buf;
+        buf << "launch engine process: " << command_;
+        Log::Debug(buf.str());
+
+        return std::make_shared<EngineProcess>(io_context, command_);
+    }
+
+    void Release(std::shared_ptr<EngineProcess> && process)
+    {
+        std::lock_guard lock(mutex_);
+        idle_.emplace_back(std::move(process));
+    }
+
+    std::string const& GetCommand() const
+    {
+        return command_;
+    }
+
+private:
+    std::string const command_;
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<EngineProcess>> idle_;  // 全て同じ io_context に属する
+};
+
+
+/// メッセージの "cmd" を得る(サーバーのメッセージは常に "cmd" から始まる)
+std::string_view GetCommand(std::string_view message)
+{
+    constexpr auto kPrefix = R"({"cmd":")"sv;
+    if (message.substr(0, kPrefix.size()) != kPrefix) {
+        return std::string_view();
+    }
+    auto const rest = message.substr(kPrefix.size());
+    return rest.substr(0, rest.find('"'));
+}
+
+/// エンジンの出力が hint か？(エンジンの出力は書式が決まっていないため，必要であればパースする)
+bool IsHint(std::string const& line)
+{
+    if (auto const command = GetCommand(line); !command.empty()) {
+        return command == "hint"sv;
+    }
+    auto const j = nlohmann::json::parse(line, nullptr, false);
+    if (!j.is_object()) {
+        return false;
+    }
+    auto const it = j.find("cmd");
+    return it != j.end() && it->is_string() && it->get_ref<std::string const&>() == "hint";
+}
+
+
+class ProcessEngine : public Engine {
+public:
+    ProcessEngine(std::shared_ptr<EngineProcessPool> const& pool, std::chrono::milliseconds ready_timeout, Strand const& strand)
+        : pool_(pool)
+        , ready_timeout_(ready_timeout)
+        , strand_(strand)
+        , process_(pool_->Acquire(strand.get_inner_executor().context()))
+        , wait_()
+        , game_over_(false)
+    {}
+
+    ~ProcessEngine()
+    {
+        // 試合が最後まで進んだ場合のみ再利用する(game_over には応答を待たないため，読み取り中ではない)
+        if (game_over_ && !IsWaiting() && process_->IsReusable()) {
+            pool_->Release(std::move(process_));
+        }
+    }
+
+    void AsyncOnMessage(std::string_view message, std::optional<std::chrono::milliseconds> const& input_timeout,
+        HintHandler on_hint, ResponseHandler on_response) override
+    {
+        assert(!IsWaiting());
+
+        auto const command = GetCommand(message);
+
+        try {
+            process_->Write(message);
+        } catch (std::exception &) {
+            boost::asio::post(strand_, [on_response = std::move(on_response), error = std::current_exception()]
+                {
+                    on_response(error, std::nullopt);
+                });
+            return;
+        }
+
+        if (command == "game_over"sv) {
+            game_over_ = true;
+        }
+
+        // 応答が必要なのは制限時間付きのメッセージ(dc，手番のチームへのupdate)と is_ready
+        // is_ready には試合上の制限時間が無いため，応答が無ければ試合をエラーとする
+        if (!input_timeout && command != "is_ready"sv) {
+            // 応答が不要なメッセージへの応答も，TCPで受信した場合と同様に試合に渡す
+            boost::asio::post(strand_, [on_response = std::move(on_response), line = process_->TryPopLine()]() mutable
+                {
+                    on_response(nullptr, std::move(line));
+                });
+            return;
+        }
+
+        wait_ = std::make_shared<Wait>(strand_);
+        wait_->accept_hints = input_timeout.has_value();
+        wait_->is_ready = !input_timeout;
+        wait_->timeout = input_timeout ? *input_timeout : ready_timeout_;
+        wait_->on_hint = std::move(on_hint);
+        wait_->on_response = std::move(on_response);
+
+        wait_->deadline.expires_after(wait_->timeout);
+        wait_->deadline.async_wait([wait = wait_, process = process_](boost::system::error_code const& error)
+            {
+                if (error || wait->done) return;
+                wait->timed_out = true;
+                process->CancelRead();
+            });
+
+        ReadNext(wait_, process_);
+    }
+
+    void Cancel() override
+    {
+        if (IsWaiting()) {
+            wait_->cancelled = true;
+            process_->CancelRead();
+        }
+    }
+
+private:
+    /// 1つのメッセージへの応答の待機．読み取りとタイマーのハンドラが参照するため共有する
+    struct Wait {
+        explicit Wait(Strand const& strand) : strand(strand), deadline(strand) {}
+
+        Strand const strand;
+        boost::asio::steady_timer deadline;
+        std::chrono::milliseconds timeout{ 0 };
+        bool accept_hints = false;  // hint を応答とみなさずに次の行を待つか
+        bool is_ready = false;
+        bool timed_out = false;
+        bool cancelled = false;
+        bool done = false;
+        HintHandler on_hint;
+        ResponseHandler on_response;
+    };
+
+    std::shared_ptr<EngineProcessPool> const pool_;
+    std::chrono::milliseconds const ready_timeout_;
+    Strand const strand_;
+    std::shared_ptr<EngineProcess> process_;
+    std::shared_ptr<Wait> wait_;  // 最後のメッセージの待機
+    bool game_over_;
+
+    bool IsWaiting() const
+    {
+        return wait_ && !wait_->done;
+    }
+
+    static void ReadNext(std::shared_ptr<Wait> const& wait, std::shared_ptr<EngineProcess> const& process)
+    {
+        process->AsyncReadLine(wait->strand, [wait, process](std::exception_ptr error, std::optional<std::string> && line)
+            {
+                if (wait->done) return;
+
+                if (error) {
+                    Complete(*wait, error, std::nullopt);
+                } else if (wait->cancelled) {
+                    Complete(*wait, nullptr, std::nullopt);
+                } else if (!line) {  // タイムアウトにより読み取りを取り消した
+                    if (wait->is_ready) {
+                        std::ostringstream buf;
+                        buf << "engine process did not answer is_ready within " << wait->timeout.count() << " ms";
+                        Complete(*wait, std::make_exception_ptr(std::runtime_error(buf.str())), std::nullopt);
+                    } else {
+                        Complete(*wait, nullptr, std::nullopt);
+                    }
+                } else if (wait->accept_hints && IsHint(*line)) {
+                    // hint は応答ではないため，制限時間まで続きの行を待つ
+                    wait->on_hint(std::move(*line));
+                    if (wait->timed_out || wait->cancelled) {
+                        Complete(*wait, nullptr, std::nullopt);
+                    } else {
+                        ReadNext(wait, process);
+                    }
+                } else {
+                    Complete(*wait, nullptr, std::move(line));
+                }
+            });
+    }
+
+    static void Complete(Wait & wait, std::exception_ptr error, std::optional<std::string> && response)
+    {
+        wait.done = true;
+        wait.deadline.cancel();
+        wait.on_hint = nullptr;
+        auto const on_response = std::move(wait.on_response);
+        on_response(error, std::move(response));
+    }
+};
+
+
+class ProcessEngineFactory : public EngineFactory {
+public:
+    ProcessEngineFactory(std::string const& command, std::chrono::milliseconds ready_timeout)
+        : pool_(std::make_shared<EngineProcessPool>(command))
+        , ready_timeout_(ready_timeout)
+    {}
+
+    std::unique_ptr<Engine> CreateEngine(Engine::Strand const& strand) const override
+    {
+        return std::make_unique<ProcessEngine>(pool_, ready_timeout_, strand);
+    }
+
+    std::string GetDescription() const override
+    {
+        std::ostringstream buf;
+        buf << "process \"" << pool_->GetCommand() << '"';
+        return buf.str();
+    }
+
+private:
+    std::shared_ptr<EngineProcessPool> const pool_;
+    std::chrono::milliseconds const ready_timeout_;
+};
+
+} // unnamed namespace
+
+std::unique_ptr<EngineFactory> LaunchEngineProcess(std::string const& command, std::chrono::milliseconds ready_timeout)
+{
+#ifndef _WIN32
+    // 終了したエンジンのパイプへの書き込みでサーバーが終了しないようにする(書き込みはエラーとして扱う)
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    return std::make_unique<ProcessEngineFactory>(command, ready_timeout);
+}
+
+} // namespace digitalcurling3_server
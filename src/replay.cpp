@@ -0,0 +1,347 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "replay.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <utility>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/nowide/fstream.hpp>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "log.hpp"
+#include "server.hpp"
+
+namespace digitalcurling3_server {
+
+namespace dc = digitalcurling3;
+using nlohmann::json;
+
+namespace {
+
+/// \brief 一致しなかった最初の箇所を説明する
+std::string DescribeMismatch(std::string_view what, json const& logged, json const& replayed)
+{
+    std::ostringstream buf;
+    buf << what << " mismatch";
+
+    auto const patch = json::diff(logged, replayed);
+    if (!patch.empty()) {
+        json::json_pointer const pointer(patch.front().at("path").get<std::string>());
+        buf << " at \"" << pointer.to_string() << "\" (logged: "
+            << (logged.contains(pointer) ? logged.at(pointer).dump() : "none")
+            << ", replayed: "
+            << (replayed.contains(pointer) ? replayed.at(pointer).dump() : "none") << ')';
+    }
+
+    return buf.str();
+}
+
+/// \brief ショットの前後の試合の状態から，そのショットに使われた思考時間を求める
+///
+/// "elapsed_ms" を含まないショットログのために， thinking_time_remaining の差を思考時間とする．
+/// 時間切れで負けた場合は残り時間を超える値を返す．
+/// エキストラエンドの開始で残り時間が設定し直された場合は正しい値にならないが，その場合の状態は思考時間によらない．
+std::chrono::milliseconds DeriveThinkingTime(dc::GameState const& before, dc::GameState const& after)
+{
+    auto const team = static_cast<size_t>(before.GetNextTeam());
+    auto const remaining = before.thinking_time_remaining[team];
+    if (after.game_result && after.game_result->reason == dc::GameResult::Reason::kTimeLimit) {
+        return remaining + std::chrono::milliseconds(1);
+    }
+    return std::max(remaining - after.thinking_time_remaining[team], std::chrono::milliseconds(0));
+}
+
+/// \brief リプレイ中に一致しない箇所が見つかった
+struct Mismatch {
+    std::string message;
+};
+
+} // unnamed namespace
+
+
+void to_json(nlohmann::json & j, ReplayResult const& result)
+{
+    j = nlohmann::json{
+        { "directory", result.directory.string() },
+        { "game_id", result.game_id },
+        { "status", result.status },
+        { "shots", result.shots },
+        { "end", result.end },
+        { "shot", result.shot },
+        { "message", result.message },
+    };
+}
+
+ReplayResult ReplayGame(boost::filesystem::path const& directory)
+{
+    ReplayResult result;
+    result.directory = directory;
+
+    try {
+        auto const records = ReadGameLog(directory);
+
+        // ショットログを (エンド番号, ショット番号) で引けるようにする
+        std::map<std::pair<std::uint8_t, std::uint8_t>, json const*> shot_logs;
+        for (auto const& shot_log : records.shots) {
+            shot_logs.emplace(
+                std::make_pair(shot_log.at("end").get<std::uint8_t>(), shot_log.at("shot").get<std::uint8_t>()),
+                &shot_log);
+        }
+
+        std::optional<dc::GameSetting> setting;
+        std::optional<dc::GameState> state;
+        std::optional<json> simulator_storage;  // 直前のショットの適用後のシミュレータの状態
+        std::optional<bool> free_guard_zone_foul;  // 直前のショットの結果(直後の update で確かめる)
+
+        for (size_t i_record = 0; i_record < records.game.size(); ++i_record) {
+            auto const& record = records.game[i_record];
+            auto const cmd = record.at("cmd").get<std::string>();
+
+            if (cmd == "dc") {
+                result.game_id = record.at("game_id").get<std::string>();
+
+            } else if (cmd == "meta") {
+                if (record.at("meta").get<std::string>() == "config") {
+                    setting = record.at("config_all").at("game").at("setting").get<dc::GameSetting>();
+                    state.emplace(*setting);
+                }
+
+            } else if (cmd == "move") {
+                if (!state) {
+                    throw std::runtime_error("move was logged before meta config");
+                }
+
+                auto const it = shot_logs.find(std::make_pair(state->end, state->shot));
+                if (it == shot_logs.end()) {
+                    std::ostringstream buf;
+                    buf << "shot log of end " << static_cast<unsigned int>(state->end)
+                        << " shot " << static_cast<unsigned int>(state->shot) << " not found";
+                    throw std::runtime_error(buf.str());
+                }
+                auto const& shot_log = *it->second;
+
+                result.end = state->end;
+                result.shot = state->shot;
+
+                if (shot_log.at("selected_move") != record.at("move")) {
+                    throw Mismatch{ DescribeMismatch("selected_move", record.at("move"), shot_log.at("selected_move")) };
+                }
+                if (simulator_storage && *simulator_storage != shot_log.at("simulator_storage")) {
+                    throw Mismatch{ DescribeMismatch("simulator_storage", shot_log.at("simulator_storage"), *simulator_storage) };
+                }
+
+                auto const player = shot_log.at("player_storage").get<std::unique_ptr<dc::IPlayerStorage>>()->CreatePlayer();
+                auto const simulator = shot_log.at("simulator_storage").get<std::unique_ptr<dc::ISimulatorStorage>>()->CreateSimulator();
+                auto move = shot_log.at("selected_move").get<dc::Move>();
+
+                // ログバージョン 1.3 より前のショットログには "elapsed_ms" が無いので，直後の update の残り時間から求める
+                std::chrono::milliseconds elapsed;
+                if (auto const it_elapsed = shot_log.find("elapsed_ms"); it_elapsed != shot_log.end()) {
+                    elapsed = std::chrono::milliseconds(it_elapsed->get<std::chrono::milliseconds::rep>());
+                } else {
+                    auto const it_update = std::find_if(records.game.begin() + static_cast<std::ptrdiff_t>(i_record) + 1, records.game.end(),
+                        [](json const& r) { return r.at("cmd").get<std::string>() == "update"; });
+                    if (it_update == records.game.end()) {
+                        throw std::runtime_error("shot log has no \"elapsed_ms\" and no update follows the move");
+                    }
+                    elapsed = DeriveThinkingTime(*state, it_update->at("state").get<dc::GameState>());
+                }
+
+                dc::ApplyMoveResult apply_move_result;
+                dc::ApplyMove(*setting, *simulator, *player, *state, move, elapsed, &apply_move_result,
+                    [](dc::ISimulator const&) {});
+                ++result.shots;
+
+                json const actual_move = move;
+                if (actual_move != shot_log.at("actual_move")) {
+                    throw Mismatch{ DescribeMismatch("actual_move", shot_log.at("actual_move"), actual_move) };
+                }
+
+                simulator_storage = *simulator->CreateStorage();
+                free_guard_zone_foul = apply_move_result.free_guard_zone_foul;
+
+            } else if (cmd == "update") {
+                if (!state) {
+                    throw std::runtime_error("update was logged before meta config");
+                }
+
+                json const replayed_state = *state;
+                if (replayed_state != record.at("state")) {
+                    throw Mismatch{ DescribeMismatch("state", record.at("state"), replayed_state) };
+                }
+
+                if (free_guard_zone_foul) {
+                    auto const& logged_foul = record.at("last_move").at("free_guard_zone_foul");
+                    if (logged_foul != *free_guard_zone_foul) {
+                        throw Mismatch{ DescribeMismatch("free_guard_zone_foul", logged_foul, json(*free_guard_zone_foul)) };
+                    }
+                    free_guard_zone_foul.reset();
+                }
+            }
+        }
+
+        if (!state) {
+            throw std::runtime_error("meta config was not found");
+        }
+
+        result.status = ReplayResult::Status::kMatch;
+        result.end.reset();
+        result.shot.reset();
+        result.message.clear();
+
+    } catch (Mismatch & e) {
+        result.status = ReplayResult::Status::kMismatch;
+        result.message = std::move(e.message);
+    } catch (std::exception & e) {
+        result.status = ReplayResult::Status::kError;
+        result.message = e.what();
+    }
+
+    return result;
+}
+
+std::vector<boost::filesystem::path> FindGameLogDirectories(boost::filesystem::path const& root)
+{
+    std::vector<boost::filesystem::path> directories;
+
+    if (IsGameLogDirectory(root)) {
+        directories.push_back(root);
+        return directories;
+    }
+
+    for (auto const& entry : boost::filesystem::recursive_directory_iterator(root)) {
+        if (entry.status().type() == boost::filesystem::directory_file && IsGameLogDirectory(entry.path())) {
+            directories.push_back(entry.path());
+        }
+    }
+    std::sort(directories.begin(), directories.end());
+
+    return directories;
+}
+
+bool StartReplay(boost::filesystem::path const& root, std::optional<boost::filesystem::path> const& results_file, size_t thread_count)
+{
+    auto const directories = FindGameLogDirectories(root);
+
+    {
+        std::ostringstream buf;
+        buf << "replay mode: " << directories.size() << " games in \"" << root.string() << "\", " << thread_count << " threads";
+        Log::Info(buf.str());
+    }
+
+    if (directories.empty()) {
+        Log::Warning("no game log was found");
+        return false;
+    }
+
+    auto const start_time = std::chrono::steady_clock::now();
+
+    // 試合ごとに独立しているので，ストランドを使わずに並列に実行する．結果は試合ごとの要素にのみ書き込む．
+    std::vector<ReplayResult> results(directories.size());
+    {
+        boost::asio::io_context io_context(static_cast<int>(thread_count));
+        for (size_t i = 0; i < directories.size(); ++i) {
+            boost::asio::post(io_context, [&directories, &results, i]
+            {
+                auto & result = results[i];
+                result = ReplayGame(directories[i]);
+
+                if (result.status != ReplayResult::Status::kMatch) {
+                    std::ostringstream buf;
+                    buf << "replay " << (result.status == ReplayResult::Status::kMismatch ? "mismatch" : "error")
+                        << ": \"" << result.directory.string() << "\"";
+                    if (result.end && result.shot) {
+                        buf << " (end " << static_cast<unsigned int>(*result.end)
+                            << " shot " << static_cast<unsigned int>(*result.shot) << ')';
+                    }
+                    buf << ": " << result.message;
+                    Log::Warning(buf.str());
+                }
+            });
+        }
+        RunIOContext(io_context, thread_count);
+    }
+
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    size_t matched = 0;
+    size_t mismatched = 0;
+    size_t errors = 0;
+    size_t shots = 0;
+    for (auto const& result : results) {
+        switch (result.status) {
+            case ReplayResult::Status::kMatch:
+                ++matched;
+                break;
+            case ReplayResult::Status::kMismatch:
+                ++mismatched;
+                break;
+            case ReplayResult::Status::kError:
+                ++errors;
+                break;
+        }
+        shots += result.shots;
+    }
+
+    {
+        std::ostringstream buf;
+        buf << "replay results (" << results.size() << " games, " << shots << " shots, "
+            << std::fixed << std::setprecision(2) << elapsed << " s)\n"
+            << "match   : " << matched << '\n'
+            << "mismatch: " << mismatched << '\n'
+            << "error   : " << errors;
+        Log::Info(buf.str());
+    }
+
+    if (results_file) {
+        nlohmann::json const j_results{
+            { "root", root.string() },
+            { "games", results.size() },
+            { "match", matched },
+            { "mismatch", mismatched },
+            { "error", errors },
+            { "shots", shots },
+            { "results", results },
+        };
+
+        boost::nowide::ofstream file(*results_file);
+        file << j_results.dump(2) << std::endl;
+        if (!file) {
+            std::ostringstream buf;
+            buf << "could not write results file \"" << results_file->string() << "\"";
+            Log::Warning(buf.str());
+        } else {
+            std::ostringstream buf;
+            buf << "results file: \"" << results_file->string() << "\"";
+            Log::Info(buf.str());
+        }
+    }
+
+    return mismatched == 0 && errors == 0;
+}
+
+} // namespace digitalcurling3_server
@@ -0,0 +1,97 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_REPLAY_HPP
+#define DIGITALCURLING3_SERVER_REPLAY_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "nlohmann/json.hpp"
+
+namespace digitalcurling3_server {
+
+/// \brief 1試合のリプレイの結果
+struct ReplayResult {
+    enum class Status {
+        kMatch,     ///< 全てのショットの結果が試合ログと一致した
+        kMismatch,  ///< 結果が試合ログと一致しないショットがあった
+        kError,     ///< 試合ログを読めないなど，リプレイできなかった
+    };
+
+    boost::filesystem::path directory;  ///< 試合ログのディレクトリ
+    std::string game_id;
+    Status status = Status::kError;
+    size_t shots = 0;  ///< 再シミュレーションしたショット数
+    std::optional<std::uint8_t> end;   ///< 一致しなかったショットのエンド番号
+    std::optional<std::uint8_t> shot;  ///< 一致しなかったショットのショット番号
+    std::string message;  ///< 一致しなかった箇所，あるいはエラーの内容
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(ReplayResult::Status, {
+    {ReplayResult::Status::kMatch, "match"},
+    {ReplayResult::Status::kMismatch, "mismatch"},
+    {ReplayResult::Status::kError, "error"},
+})
+
+void to_json(nlohmann::json & j, ReplayResult const& result);
+
+/// \brief 1試合をリプレイする
+///
+/// 試合ログの "meta" "config" の "config_all" から試合の設定を読み，
+/// 各ショットについてショットログの "player_storage" と "simulator_storage" からプレイヤーとシミュレータを復元して
+/// "selected_move" に ApplyMove() を適用する．ネットワークは使わない．
+///
+/// 次の全てがJSONの値として(浮動小数点数はビット単位で)一致すれば一致とみなす．
+/// - 適用後の手と，ショットログの "actual_move"
+/// - 適用後の試合の状態と，試合ログの直後の "update" の "state"
+/// - 適用後のシミュレータの状態と，次のショットのショットログの "simulator_storage"
+///
+/// 思考時間はショットログの "elapsed_ms" を用いる．
+/// それを含まない(ログバージョン 1.3 より前の)ショットログでは，直後の "update" の thinking_time_remaining との差から求める．
+///
+/// \param directory 試合ログのディレクトリ
+/// \return 結果
+ReplayResult ReplayGame(boost::filesystem::path const& directory);
+
+/// \brief ディレクトリ以下の試合ログのディレクトリを探す
+///
+/// \param root 試合ログのディレクトリ，またはそれらを含むディレクトリ
+/// \return 見つかった試合ログのディレクトリ(パスの順)
+std::vector<boost::filesystem::path> FindGameLogDirectories(boost::filesystem::path const& root);
+
+/// \brief リプレイモードを実行する
+///
+/// root 以下の全ての試合を thread_count 個のスレッドで並列にリプレイし，結果を集計する．
+/// 全ての試合が終了するまで戻らない．
+///
+/// \param root 試合ログのディレクトリ，またはそれらを含むディレクトリ
+/// \param results_file 全ての試合の結果をJSONで出力するファイル(省略時は出力しない)
+/// \param thread_count 実行するスレッド数(>= 1)
+/// \return 全ての試合が一致した場合 \c true
+bool StartReplay(boost::filesystem::path const& root, std::optional<boost::filesystem::path> const& results_file, size_t thread_count);
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_REPLAY_HPP
@@ -21,6 +21,9 @@
 // SOFTWARE.
 
 #include "server.hpp"
+#include <thread>
+#include <vector>
+#include <boost/asio/bind_executor.hpp>
 #include <boost/asio/io_context.hpp>
 #include "log.hpp"
 #include "util.hpp"
@@ -29,11 +32,16 @@ namespace digitalcurling3_server {
 
 using boost::asio::ip::tcp;
 
-Server::Server(boost::asio::io_context & io_context, Config && config, std::string const& date_time, std::string const& game_id)
-    : listen_endpoints_()
+Server::Server(boost::asio::io_context & io_context, Config && config, std::string const& date_time, std::string const& game_id,
+    boost::filesystem::path const& game_log_directory, std::shared_ptr<GameMessageTemplates const> const& templates)
+    : strand_(boost::asio::make_strand(io_context))
+    , listen_endpoints_()
     , acceptors_()
     , sessions_()
-    , game_(*this, std::move(config), date_time, game_id)
+    , attached_{ false, false }
+    , hosted_(false)
+    , on_finished_()
+    , game_(*this, std::move(config), date_time, game_id, game_log_directory, templates)
 {
     for (size_t i = 0; i < 2; ++i) {
         listen_endpoints_[i].emplace(tcp::v4(), game_.GetConfig().server.port[i]);
@@ -41,21 +49,54 @@ Server::Server(boost::asio::io_context & io_context, Config && config, std::stri
 
         // accept
         acceptors_.at(i)->async_accept(
-            [this, i](boost::system::error_code const& error, tcp::socket && socket)
-            {
-                if (!error) {
-                    sessions_[i] = std::make_shared<TCPSession>(std::move(socket), *this, i);
-                    sessions_[i]->Open();
-                }
-            });
+            boost::asio::bind_executor(strand_,
+                [this, i](boost::system::error_code const& error, tcp::socket && socket)
+                {
+                    if (!error) {
+                        attached_[i] = true;
+                        sessions_[i] = std::make_shared<TCPSession>(std::move(socket), *this, i,
+                            game_.GetConfig().server.max_line_length);
+                        sessions_[i]->Open();
+                    }
+                }));
     }
 }
 
+Server::Server(boost::asio::io_context & io_context, Config && config, std::string const& date_time, std::string const& game_id,
+    boost::filesystem::path const& game_log_directory, std::shared_ptr<GameMessageTemplates const> const& templates,
+    std::function<void()> && on_finished)
+    : strand_(boost::asio::make_strand(io_context))
+    , listen_endpoints_()
+    , acceptors_()
+    , sessions_()
+    , attached_{ false, false }
+    , hosted_(true)
+    , on_finished_(std::move(on_finished))
+    , game_(*this, std::move(config), date_time, game_id, game_log_directory, templates)
+{}
+
+void Server::Attach(size_t client_id, tcp::socket && socket, std::string && input_buffer)
+{
+    if (!on_finished_) {
+        return;  // 試合は既に終了している(socketはここで閉じられる)
+    }
+
+    assert(!attached_[client_id]);
+    attached_[client_id] = true;
+    sessions_[client_id] = std::make_shared<TCPSession>(std::move(socket), *this, client_id,
+        game_.GetConfig().server.max_line_length, input_buffer);
+    sessions_[client_id]->Open();
+}
+
 void Server::Stop()
 {
+    game_.Stop();
+
     // stop accept
     for (auto & acceptor : acceptors_) {
-        acceptor->cancel();
+        if (acceptor) {
+            acceptor->cancel();
+        }
     }
 
     for (auto & session : sessions_) {
@@ -66,6 +107,8 @@ void Server::Stop()
     }
 
     Log::Debug("server stopped");
+
+    Finish();
 }
 
 void Server::OnSessionStop(size_t client_id)
@@ -77,23 +120,34 @@ void Server::OnSessionStop(size_t client_id)
     } catch (std::exception & e) {
         HandleError(e);
     }
+
+    // 両方のセッションが正常に閉じられたら試合を終了する
+    if (attached_[0] && attached_[1] && !sessions_[0] && !sessions_[1]) {
+        Finish();
+    }
 }
 
 void Server::OnSessionStart(size_t client_id)
 {
     try {
-        game_.OnSessionStart(client_id);
+        if (hosted_) {
+            // ホスティングモードではdcは Host が送信済み
+            game_.OnSessionAttach(client_id);
+        } else {
+            game_.OnSessionStart(client_id);
+        }
     } catch (std::exception & e) {
         HandleError(e);
     }
 }
 
-void Server::OnSessionRead(size_t client_id, std::string_view input_message, std::chrono::milliseconds const& elapsed_from_output)
+bool Server::OnSessionRead(size_t client_id, std::string_view input_message, std::chrono::nanoseconds elapsed_from_output)
 {
     try {
-        game_.OnSessionRead(client_id, input_message, elapsed_from_output);
+        return game_.OnSessionRead(client_id, input_message, elapsed_from_output);
     } catch (std::exception & e) {
         HandleError(e);
+        return true;
     }
 }
 
@@ -106,10 +160,15 @@ void Server::OnSessionTimeout(size_t client_id)
     }
 }
 
-void Server::DeliverMessage(size_t client_id, std::string && message, std::optional<std::chrono::milliseconds> const& input_timeout)
+void Server::OnSessionWritten(size_t client_id, std::chrono::nanoseconds elapsed)
+{
+    game_.OnSessionWritten(client_id, elapsed);
+}
+
+void Server::DeliverMessage(size_t client_id, SharedMessage const& message, std::optional<std::chrono::milliseconds> const& input_timeout)
 {
     if (sessions_[client_id] && !sessions_[client_id]->IsClosed()) {
-        sessions_[client_id]->Deliver(std::move(message), input_timeout);
+        sessions_[client_id]->Deliver(message, input_timeout);
     } else {
         std::ostringstream buf;
         buf << "client " << client_id << " deliver message failed";
@@ -118,14 +177,48 @@ void Server::DeliverMessage(size_t client_id, std::string && message, std::optio
 }
 
 
+void Server::OnGameError(std::exception & e)
+{
+    HandleError(e);
+}
+
 void Server::HandleError(std::exception & e)
 {
-    Log::Error(e.what());
+    Log::Error(game_.GetGameLog(), e.what());
     Stop();
 }
 
+void Server::Finish()
+{
+    if (!on_finished_) return;
+
+    // 1度だけ呼び出す
+    auto on_finished = std::move(on_finished_);
+    on_finished_ = nullptr;
+    on_finished();
+}
 
-void Start(Config && config, std::string const& launch_time, std::string const& game_id)
+
+void RunIOContext(boost::asio::io_context & io_context, size_t thread_count)
+{
+    assert(thread_count >= 1);
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (size_t i = 1; i < thread_count; ++i) {
+        threads.emplace_back([&io_context] { io_context.run(); });
+    }
+
+    io_context.run();
+
+    for (auto & thread : threads) {
+        thread.join();
+    }
+}
+
+
+void Start(Config && config, std::string const& launch_time, std::string const& game_id,
+    boost::filesystem::path const& game_log_directory, size_t thread_count)
 {
     {
         std::ostringstream buf;
@@ -146,12 +239,13 @@ void Start(Config && config, std::string const& launch_time, std::string const&
     }
     Log::Info("Note: Team 1 has the last stone in the first end.");
 
-    boost::asio::io_context io_context;
-    Server s(io_context, std::move(config), launch_time, game_id);
+    boost::asio::io_context io_context(static_cast<int>(thread_count));
+    auto const templates = GameMessageTemplates::Create(config);
+    Server s(io_context, std::move(config), launch_time, game_id, game_log_directory, templates);
 
     Log::Info("server started");
 
-    io_context.run();
+    RunIOContext(io_context, thread_count);
 }
 
 } // namespace digitalcurling3_server
@@ -30,45 +30,104 @@
 #include <chrono>
 #include <memory>
 #include <exception>
+#include <functional>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
 #include "config.hpp"
 #include "game.hpp"
+#include "game_transport.hpp"
+#include "message_template.hpp"
+#include "shared_message.hpp"
 #include "tcp_session.hpp"
 
 namespace digitalcurling3_server {
 
-class Server {
+/// \brief 1試合分のセッションと Game を持つ
+///
+/// 試合ごとのハンドラ(セッションの入出力，タイマー)は全てこの試合のストランド上で実行される．
+/// このため，複数のスレッドで io_context を実行しても Game 内でのロックは不要．
+class Server : public GameTransport {
 public:
     // Start() から呼び出す関数 ---
 
-    Server(boost::asio::io_context & io_context, Config && config, std::string const& date_time, std::string const& game_id);
+    Server(boost::asio::io_context & io_context, Config && config, std::string const& date_time, std::string const& game_id,
+        boost::filesystem::path const& game_log_directory, std::shared_ptr<GameMessageTemplates const> const& templates);
+
+    // Host から呼び出す関数 ---
+
+    /// \brief ホスティングモード用のコンストラクタ
+    ///
+    /// 自身では接続を受け付けず， Attach() で渡された接続を用いる．
+    ///
+    /// \param templates 全ての試合で共有するメッセージのひな形
+    /// \param on_finished 試合が終了し，2つのセッションが閉じられた(あるいはサーバーが停止した)際に1度だけ呼ばれる
+    Server(boost::asio::io_context & io_context, Config && config, std::string const& date_time, std::string const& game_id,
+        boost::filesystem::path const& game_log_directory, std::shared_ptr<GameMessageTemplates const> const& templates,
+        std::function<void()> && on_finished);
+
+    /// \brief 接続済みのソケットをセッションとして試合に加える
+    ///
+    /// dcは送信済みで，受信済みのデータ(dc_okを含む)は \p input_buffer に格納されている前提．
+    /// GetStrand() 上で呼び出すこと．
+    ///
+    /// \param client_id クライアントID(チーム)
+    /// \param socket 接続済みのソケット
+    /// \param input_buffer 受信済みのデータ
+    void Attach(size_t client_id, boost::asio::ip::tcp::socket && socket, std::string && input_buffer);
+
+    // TCPSession, Game から呼び出す関数 ---
+
+    /// \brief この試合のストランド
+    Strand const& GetStrand() const override { return strand_; }
 
     // TCPSessionから呼び出す関数 ---
 
     /// \brief サーバーを停止する
     void Stop();
     void OnSessionStart(size_t client_id);
-    void OnSessionRead(size_t client_id, std::string_view input_message, std::chrono::milliseconds const& elapsed_from_output);
+    /// \return Game::OnSessionRead() の戻り値．エラーが発生した場合は \c true
+    bool OnSessionRead(size_t client_id, std::string_view input_message, std::chrono::nanoseconds elapsed_from_output);
     void OnSessionTimeout(size_t client_id);
     void OnSessionStop(size_t client_id);
+    void OnSessionWritten(size_t client_id, std::chrono::nanoseconds elapsed);
 
     // Game から呼び出す関数 ---
 
     /// \brief メッセージを送信する
     /// 
     /// \param client_id 送信先クライアントID
-    /// \param message 送信するメッセージ(末尾の改行文字を含まない)
+    /// \param message 送信するメッセージ．バッファは送信完了まで共有される．
     /// \param input_timeout タイムアウトまでの時間( \c std::nullopt で制限時間無し)
-    void DeliverMessage(size_t client_id, std::string && message, std::optional<std::chrono::milliseconds> const& input_timeout = std::nullopt);
+    void DeliverMessage(size_t client_id, SharedMessage const& message,
+        std::optional<std::chrono::milliseconds> const& input_timeout) override;
+
+    /// \brief Game のタイマーのハンドラで発生したエラーを処理する
+    ///
+    /// \param e 発生した例外
+    void OnGameError(std::exception & e) override;
 
 private:
+    Strand strand_;
     std::array<std::optional<boost::asio::ip::tcp::endpoint>, 2> listen_endpoints_;
     std::array<std::optional<boost::asio::ip::tcp::acceptor>, 2> acceptors_;
     std::array<std::shared_ptr<TCPSession>, 2> sessions_;
+    std::array<bool, 2> attached_;
+    bool const hosted_;
+    std::function<void()> on_finished_;  // ホスティングモードでのみ設定される
     Game game_;
 
     void HandleError(std::exception & e);
+    void Finish();
 };
 
+/// \brief io_context を複数のスレッドで実行する
+///
+/// 呼び出したスレッドも実行に加わり， io_context の処理がなくなるまで戻らない．
+///
+/// \param io_context 実行する io_context
+/// \param thread_count 実行するスレッド数(>= 1)
+void RunIOContext(boost::asio::io_context & io_context, size_t thread_count);
+
 } // namespace digitalcurling3_server
 
 #endif
@@ -0,0 +1,71 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_SHARED_MESSAGE_HPP
+#define DIGITALCURLING3_SERVER_SHARED_MESSAGE_HPP
+
+#include <cassert>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace digitalcurling3_server {
+
+/// \brief 送信するメッセージの共有バッファ
+///
+/// 作成後は内容を変更しないため，複数のセッションやログが同じバイト列をコピーせずに参照できる．
+/// コピーは参照カウントの増加のみ．
+class SharedMessage {
+public:
+    SharedMessage() = default;
+
+    /// \param message メッセージ(末尾の改行文字を含まない)
+    explicit SharedMessage(std::string && message)
+        : data_()
+    {
+        message.push_back('\n');
+        data_ = std::make_shared<std::string const>(std::move(message));
+    }
+
+    /// \brief 送信するバイト列(末尾の改行文字を含む)
+    std::string_view GetData() const
+    {
+        assert(data_);
+        return *data_;
+    }
+
+    /// \brief メッセージ(末尾の改行文字を含まない)
+    std::string_view GetLine() const
+    {
+        assert(data_);
+        return std::string_view(*data_).substr(0, data_->size() - 1);
+    }
+
+    explicit operator bool () const { return static_cast<bool>(data_); }
+
+private:
+    std::shared_ptr<std::string const> data_;
+};
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_SHARED_MESSAGE_HPP
@@ -0,0 +1,277 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "speculation.hpp"
+#include <cstring>
+#include <functional>
+#include <boost/asio/post.hpp>
+#include "log.hpp"
+#include "metrics.hpp"
+
+namespace digitalcurling3_server {
+
+namespace dc = digitalcurling3;
+
+namespace {
+
+inline std::uint32_t FloatBits(float f)
+{
+    std::uint32_t bits;
+    static_assert(sizeof(bits) == sizeof(f));
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+inline bool IsSameStoneData(dc::ISimulator::StoneData const& a, dc::ISimulator::StoneData const& b)
+{
+    return FloatBits(a.position.x) == FloatBits(b.position.x)
+        && FloatBits(a.position.y) == FloatBits(b.position.y)
+        && FloatBits(a.angle) == FloatBits(b.angle)
+        && FloatBits(a.linear_velocity.x) == FloatBits(b.linear_velocity.x)
+        && FloatBits(a.linear_velocity.y) == FloatBits(b.linear_velocity.y)
+        && FloatBits(a.angular_velocity) == FloatBits(b.angular_velocity);
+}
+
+/// \brief 全てのストーンがビット単位で一致するか
+bool IsSameStones(dc::ISimulator::AllStoneData const& a, dc::ISimulator::AllStoneData const& b)
+{
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].has_value() != b[i].has_value()) return false;
+        if (a[i] && !IsSameStoneData(*a[i], *b[i])) return false;
+    }
+    return true;
+}
+
+/// \brief 事前シミュレーション中に SpeculativeSimulator での再生に必要な値を記録するシミュレータ
+class RecordingSimulator : public dc::ISimulator {
+public:
+    RecordingSimulator(dc::ISimulator & simulator, Speculation::Result & result)
+        : simulator_(simulator)
+        , result_(result)
+        , initial_stones_set_(false)
+    {}
+
+    void SetStones(AllStoneData const& stones) override
+    {
+        simulator_.SetStones(stones);
+        if (!initial_stones_set_) {
+            initial_stones_set_ = true;
+            result_.initial_stones = stones;
+            result_.initially_stopped = simulator_.AreAllStonesStopped();
+            result_.stopped_stones = stones;
+        }
+    }
+    void Step() override
+    {
+        simulator_.Step();
+        if (simulator_.AreAllStonesStopped()) {
+            result_.stopped_stones = simulator_.GetStones();
+        }
+    }
+    AllStoneData const& GetStones() const override { return simulator_.GetStones(); }
+    bool AreAllStonesStopped() const override { return simulator_.AreAllStonesStopped(); }
+    float GetSecondsPerFrame() const override { return simulator_.GetSecondsPerFrame(); }
+    dc::ISimulatorFactory const& GetFactory() const override { return simulator_.GetFactory(); }
+    std::unique_ptr<dc::ISimulatorStorage> CreateStorage() const override { return simulator_.CreateStorage(); }
+    void Save(dc::ISimulatorStorage & storage) const override { simulator_.Save(storage); }
+    void Load(dc::ISimulatorStorage const& storage) override { simulator_.Load(storage); }
+
+private:
+    dc::ISimulator & simulator_;
+    Speculation::Result & result_;
+    bool initial_stones_set_;
+};
+
+} // unnamed namespace
+
+
+Speculation::Speculation(GameTransport::Strand const& strand, size_t max_moves)
+    : strand_(strand)
+    , max_moves_(max_moves)
+    , shared_(std::make_shared<Shared>())
+{}
+
+void Speculation::Start(dc::GameSetting const& setting, dc::GameState const& state,
+    dc::ISimulator const& simulator, dc::IPlayer const& player,
+    std::vector<dc::moves::Shot> const& shots,
+    size_t steps_per_frame, TrajectoryCompressor::Tolerance const& tolerance)
+{
+    auto const state_hash = HashState(state);
+
+    for (auto const& shot : shots) {
+        if (shared_->results.size() >= max_moves_) {
+            break;
+        }
+
+        auto const key = MakeKey(state_hash, shot);
+        if (!shared_->results.emplace(key, nullptr).second) {
+            continue;  // 既に始めている
+        }
+
+        Metrics::Add(Metrics::Counter::kSpeculations);
+
+        // 試合のストランドを止めないよう，シミュレーションはストランドの外で行う
+        boost::asio::post(strand_.get_inner_executor(),
+            [strand = strand_, weak_shared = std::weak_ptr<Shared>(shared_), generation = shared_->generation, key,
+                setting, state, shot, steps_per_frame, tolerance,
+                simulator_storage = std::shared_ptr<dc::ISimulatorStorage const>(simulator.CreateStorage()),
+                player_storage = std::shared_ptr<dc::IPlayerStorage const>(player.CreateStorage())]
+            {
+                auto result = std::make_shared<Result>();
+                try {
+                    auto const simulator = simulator_storage->CreateSimulator();
+                    auto const player = player_storage->CreatePlayer();
+                    RecordingSimulator recording_simulator(*simulator, *result);
+                    TrajectoryCompressor compressor;
+                    compressor.Begin(steps_per_frame, state.end, tolerance);
+
+                    // 思考時間と試合の状態の更新は move の受信時に改めて行うため，ここでは複製に対して適用する
+                    dc::GameState game_state = state;
+                    dc::Move move = shot;
+                    dc::ApplyMoveResult apply_move_result;
+                    dc::ApplyMove(setting, recording_simulator, *player, game_state, move, std::chrono::milliseconds(0), &apply_move_result,
+                        [&compressor](dc::ISimulator const& s) { compressor.OnStep(s); });
+
+                    compressor.End(*simulator);
+                    result->final_storage = simulator->CreateStorage();
+                    result->trajectory = compressor.GetResult();
+                } catch (std::exception & e) {
+                    std::ostringstream buf;
+                    buf << "speculative simulation failed: " << e.what();
+                    Log::Warning(buf.str());
+                    return;  // 登録しない(シミュレーション中のまま残り，通常通りシミュレーションされる)
+                }
+
+                boost::asio::post(strand,
+                    [weak_shared, generation, key, result = std::move(result)]() mutable
+                    {
+                        auto const shared = weak_shared.lock();
+                        if (!shared || shared->generation != generation) {
+                            return;  // 試合が終わったか，既に手が適用された
+                        }
+                        if (auto const it = shared->results.find(key); it != shared->results.end()) {
+                            it->second = std::move(result);
+                        }
+                    });
+            });
+    }
+}
+
+std::shared_ptr<Speculation::Result const> Speculation::Find(dc::GameState const& state, dc::moves::Shot const& shot) const
+{
+    auto const it = shared_->results.find(MakeKey(HashState(state), shot));
+    if (it == shared_->results.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+void Speculation::Clear()
+{
+    ++shared_->generation;
+    shared_->results.clear();
+}
+
+std::size_t Speculation::HashState(dc::GameState const& state)
+{
+    return std::hash<std::string>{}(nlohmann::json(state).dump());
+}
+
+Speculation::Key Speculation::MakeKey(std::size_t state_hash, dc::moves::Shot const& shot)
+{
+    return Key(state_hash, FloatBits(shot.velocity.x), FloatBits(shot.velocity.y), static_cast<int>(shot.rotation));
+}
+
+
+SpeculativeSimulator::SpeculativeSimulator(Speculation::Result const& result, dc::ISimulator & simulator)
+    : result_(result)
+    , simulator_(simulator)
+    , mode_(Mode::kUndecided)
+    , stepped_(false)
+    , stones_()
+{}
+
+void SpeculativeSimulator::SetStones(AllStoneData const& stones)
+{
+    if (mode_ == Mode::kUndecided) {
+        mode_ = IsSameStones(stones, result_.initial_stones) ? Mode::kReplay : Mode::kDelegate;
+    }
+
+    if (mode_ == Mode::kReplay) {
+        stones_ = stones;
+    } else {
+        simulator_.SetStones(stones);
+    }
+}
+
+void SpeculativeSimulator::Step()
+{
+    if (mode_ != Mode::kReplay) {
+        simulator_.Step();
+        return;
+    }
+
+    if (!stepped_) {
+        stepped_ = true;
+        stones_ = result_.stopped_stones;
+    }
+}
+
+SpeculativeSimulator::AllStoneData const& SpeculativeSimulator::GetStones() const
+{
+    return mode_ == Mode::kReplay ? stones_ : simulator_.GetStones();
+}
+
+bool SpeculativeSimulator::AreAllStonesStopped() const
+{
+    if (mode_ != Mode::kReplay) {
+        return simulator_.AreAllStonesStopped();
+    }
+    return stepped_ || result_.initially_stopped;
+}
+
+float SpeculativeSimulator::GetSecondsPerFrame() const
+{
+    return simulator_.GetSecondsPerFrame();
+}
+
+dc::ISimulatorFactory const& SpeculativeSimulator::GetFactory() const
+{
+    return simulator_.GetFactory();
+}
+
+std::unique_ptr<dc::ISimulatorStorage> SpeculativeSimulator::CreateStorage() const
+{
+    return simulator_.CreateStorage();
+}
+
+void SpeculativeSimulator::Save(dc::ISimulatorStorage & storage) const
+{
+    simulator_.Save(storage);
+}
+
+void SpeculativeSimulator::Load(dc::ISimulatorStorage const& storage)
+{
+    simulator_.Load(storage);
+}
+
+} // namespace digitalcurling3_server
@@ -0,0 +1,151 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_SPECULATION_HPP
+#define DIGITALCURLING3_SERVER_SPECULATION_HPP
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "game_transport.hpp"
+#include "trajectory_compressor.hpp"
+
+namespace digitalcurling3_server {
+
+/// \brief 手番のクライアントが hint で予告した手を，思考時間中に事前にシミュレーションする
+///
+/// 結果は (シミュレーション開始時の試合の状態のハッシュ値, 手) をキーとして保持する．
+/// move を受信した際にキーが一致する結果があれば， SpeculativeSimulator を渡して ApplyMove() を実行し，
+/// 物理シミュレーションを省略する．
+/// 再利用するのは物理シミュレーションの結果だけで，プレイヤーによる手の変化や試合の状態の更新(思考時間，得点など)は
+/// ApplyMove() がそのまま行うため，結果は通常のシミュレーションと同じになる．
+///
+/// Game のストランド上で使う．シミュレーションは io_context の空いているスレッドで行い，結果はストランド上で登録する．
+/// 手を適用するたびに Clear() で全ての結果を破棄する．
+class Speculation {
+public:
+    /// \brief 事前シミュレーションの結果
+    struct Result {
+        digitalcurling3::ISimulator::AllStoneData initial_stones;  ///< ApplyMove() が最初に ISimulator::SetStones() に渡した値
+        bool initially_stopped = false;  ///< その直後に全てのストーンが停止していたか
+        digitalcurling3::ISimulator::AllStoneData stopped_stones;  ///< 全てのストーンが停止した時点の値
+        std::unique_ptr<digitalcurling3::ISimulatorStorage> final_storage;  ///< ApplyMove() 終了後のシミュレータの状態
+        TrajectoryCompressor::Result trajectory;  ///< 軌跡
+    };
+
+    /// \param strand 試合のストランド
+    /// \param max_moves 1手番で事前シミュレーションする手の最大数
+    Speculation(GameTransport::Strand const& strand, size_t max_moves);
+    Speculation(Speculation const&) = delete;
+    Speculation & operator = (Speculation const&) = delete;
+
+    /// \brief 手の事前シミュレーションを始める
+    ///
+    /// 既に始めた手と，最大数を超えた手は無視する．
+    /// シミュレータとプレイヤーは状態を複製して使うため，呼び出し後に変更してよい．
+    ///
+    /// \param setting 試合設定
+    /// \param state 現在の試合の状態
+    /// \param simulator 試合のシミュレータ
+    /// \param player 次に投げるプレイヤー
+    /// \param shots 予告された手
+    /// \param steps_per_frame 軌跡の1フレームのステップ数
+    /// \param tolerance 軌跡の非可逆圧縮の許容誤差
+    void Start(digitalcurling3::GameSetting const& setting, digitalcurling3::GameState const& state,
+        digitalcurling3::ISimulator const& simulator, digitalcurling3::IPlayer const& player,
+        std::vector<digitalcurling3::moves::Shot> const& shots,
+        size_t steps_per_frame, TrajectoryCompressor::Tolerance const& tolerance);
+
+    /// \brief 完了した結果を探す
+    ///
+    /// \param state 現在の試合の状態
+    /// \param shot 受信した手
+    /// \return 結果．無い場合やシミュレーション中の場合は \c nullptr
+    std::shared_ptr<Result const> Find(digitalcurling3::GameState const& state, digitalcurling3::moves::Shot const& shot) const;
+
+    /// \brief 全ての結果を破棄する
+    ///
+    /// シミュレーション中の手の結果も登録されなくなる．
+    void Clear();
+
+private:
+    using Key = std::tuple<std::size_t, std::uint32_t, std::uint32_t, int>;  // 状態のハッシュ値，速度x，速度y(ビット列)，回転
+
+    /// \brief バックグラウンドのシミュレーションと共有する状態(ストランド上でのみ読み書きする)
+    struct Shared {
+        std::uint64_t generation = 0;  ///< Clear() のたびに増やす
+        std::map<Key, std::shared_ptr<Result const>> results;  ///< シミュレーション中の手は \c nullptr
+    };
+
+    GameTransport::Strand const strand_;
+    size_t const max_moves_;
+    std::shared_ptr<Shared> const shared_;
+
+    static std::size_t HashState(digitalcurling3::GameState const& state);
+    static Key MakeKey(std::size_t state_hash, digitalcurling3::moves::Shot const& shot);
+};
+
+
+/// \brief 事前シミュレーションの結果を再生するシミュレータ
+///
+/// ApplyMove() から最初に渡されたストーンが Speculation::Result::initial_stones と一致すれば，
+/// 1回の Step() で Speculation::Result::stopped_stones まで進める．
+/// 一致しない場合は全ての呼び出しを元のシミュレータに委ね，通常通りシミュレーションする．
+class SpeculativeSimulator : public digitalcurling3::ISimulator {
+public:
+    /// \param result 事前シミュレーションの結果
+    /// \param simulator 一致しなかった場合に使う試合のシミュレータ
+    SpeculativeSimulator(Speculation::Result const& result, digitalcurling3::ISimulator & simulator);
+
+    /// \brief 事前シミュレーションの結果を再生しているか
+    bool IsReplaying() const { return mode_ == Mode::kReplay; }
+
+    void SetStones(AllStoneData const& stones) override;
+    void Step() override;
+    AllStoneData const& GetStones() const override;
+    bool AreAllStonesStopped() const override;
+    float GetSecondsPerFrame() const override;
+    digitalcurling3::ISimulatorFactory const& GetFactory() const override;
+    std::unique_ptr<digitalcurling3::ISimulatorStorage> CreateStorage() const override;
+    void Save(digitalcurling3::ISimulatorStorage & storage) const override;
+    void Load(digitalcurling3::ISimulatorStorage const& storage) override;
+
+private:
+    enum class Mode {
+        kUndecided,  ///< まだ SetStones() が呼び出されていない
+        kReplay,
+        kDelegate,
+    };
+
+    Speculation::Result const& result_;
+    digitalcurling3::ISimulator & simulator_;
+    Mode mode_;
+    bool stepped_;
+    AllStoneData stones_;
+};
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_SPECULATION_HPP
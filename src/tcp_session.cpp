@@ -21,42 +21,57 @@
 // SOFTWARE.
 
 #include "tcp_session.hpp"
+#include <boost/asio/bind_executor.hpp>
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/read_until.hpp>
 #include <boost/asio/write.hpp>
 #include "server.hpp"
 #include "log.hpp"
+#include "metrics.hpp"
 
 namespace digitalcurling3_server {
 
 using boost::asio::steady_timer;
 using boost::asio::ip::tcp;
 
-TCPSession::TCPSession(tcp::socket && socket, Server & server, size_t client_id)
+TCPSession::TCPSession(tcp::socket && socket, Server & server, size_t client_id, size_t max_line_length,
+    std::string_view input_buffer)
     : server_(server)
+    , strand_(server.GetStrand())
     , socket_(std::move(socket))
     , client_id_(client_id)
-    , input_deadline_(socket_.get_executor())
-    , non_empty_output_queue_(socket_.get_executor())
+    , input_buffer_(max_line_length, input_buffer)
+    , input_deadline_(strand_)
+    , output_queue_()
+    , writing_messages_()
+    , write_buffers_()
     , last_output_time_(steady_timer::time_point::max())
+    , write_start_time_()
 {
     input_deadline_.expires_at(steady_timer::time_point::max());
 }
 
 void TCPSession::Open()
 {
-    ReadLine();
+    Metrics::Add(Metrics::Counter::kSessionsOpened);
+    Metrics::Add(Metrics::Gauge::kOpenSessions, 1);
+
     CheckInputDeadline();
-    AwaitOutput();
 
     server_.OnSessionStart(client_id_);
+
+    // 受信済みのデータがあれば ReadLine() 内で直ちに処理するため，セッション開始の通知の後に呼ぶ
+    ReadLine();
 }
 
-void TCPSession::Deliver(std::string && message, std::optional<std::chrono::milliseconds> const& input_timeout)
+void TCPSession::Deliver(SharedMessage const& message, std::optional<std::chrono::milliseconds> const& input_timeout)
 {
-    message.push_back('\n');
-    output_queue_.emplace_back(std::move(message), input_timeout); // TODO これやめたい．．
-    non_empty_output_queue_.expires_at(steady_timer::time_point::min());
+    output_queue_.emplace_back(message, input_timeout);
+
+    // 送信中であれば，送信完了後に送信待ちのメッセージをまとめて送信する
+    if (writing_messages_.empty()) {
+        WriteLines();
+    }
 }
 
 void TCPSession::Close()
@@ -66,7 +81,8 @@ void TCPSession::Close()
     boost::system::error_code ignored_error;
     socket_.close(ignored_error);
     input_deadline_.cancel();
-    non_empty_output_queue_.cancel();
+
+    Metrics::Add(Metrics::Gauge::kOpenSessions, -1);
 
     {
         std::ostringstream buf;
@@ -85,9 +101,18 @@ bool TCPSession::IsClosed() const
 
 void TCPSession::ReadLine()
 {
-    boost::asio::async_read_until(socket_,
-        boost::asio::dynamic_buffer(input_buffer_), '\n',
-        [this, self = shared_from_this()](boost::system::error_code const& error, std::size_t n)
+    if (IsClosed()) {
+        return;
+    }
+
+    // 受信済みの行を先に処理する(ホスティングモードで引き継いだデータなど)
+    if (!ProcessLines()) {
+        return;
+    }
+
+    socket_.async_read_some(
+        input_buffer_.Prepare(),
+        boost::asio::bind_executor(strand_, [this, self = shared_from_this()](boost::system::error_code const& error, std::size_t n)
         {
             if (IsClosed()) {
                 return;
@@ -103,60 +128,82 @@ void TCPSession::ReadLine()
                 return;
             }
 
-            auto read_time = steady_timer::clock_type::now();
-            std::chrono::milliseconds elapsed_from_output;
-            if (last_output_time_ == steady_timer::time_point::max()) {
-                elapsed_from_output = std::chrono::milliseconds(0);
-            } else {
-                elapsed_from_output = std::chrono::duration_cast<std::chrono::milliseconds>(read_time - last_output_time_);
-            }
+            input_buffer_.Commit(n);
+            Metrics::Add(Metrics::Counter::kBytesReceived, n);
+            ReadLine();
+        }));
+}
 
-            // 入力タイムアウトが起こらないようにする．
-            input_deadline_.expires_at(steady_timer::time_point::max());
+bool TCPSession::ProcessLines()
+{
+    while (auto const msg = input_buffer_.PopLine()) {  // メッセージを取得(次の Prepare() まで有効)
+        Metrics::Add(Metrics::Counter::kMessagesReceived);
+
+        auto read_time = steady_timer::clock_type::now();
+        std::chrono::nanoseconds elapsed_from_output;
+        if (last_output_time_ == steady_timer::time_point::max()) {
+            elapsed_from_output = std::chrono::nanoseconds(0);
+        } else {
+            elapsed_from_output = read_time - last_output_time_;
+        }
 
-            std::string_view msg(input_buffer_.c_str(), n - 1);  // メッセージを取得
+        // 入力タイムアウトが起こらないようにする．
+        auto const deadline = input_deadline_.expiry();
+        input_deadline_.expires_at(steady_timer::time_point::max());
 
-            // 通信ログ．(文字列が長すぎる場合は文字数だけにする．)
-            {
-                Log::Trace(Log::Client(client_id_), Log::kServer, msg);
-                std::ostringstream buf;
-                buf << "client " << client_id_ << ": elapsed_from_output=" << elapsed_from_output.count() << "ms, msg_length=" << msg.size();
-                Log::Debug(buf.str());
-            }
+        // 通信ログ．(文字列が長すぎる場合は文字数だけにする．)
+        {
+            Log::Trace(Log::Client(client_id_), Log::kServer, *msg);
+            std::ostringstream buf;
+            buf << "client " << client_id_ << ": elapsed_from_output=" << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed_from_output).count() << "ms, msg_length=" << msg->size();
+            Log::Debug(buf.str());
+        }
 
-            server_.OnSessionRead(client_id_, msg, elapsed_from_output);
+        bool const responded = server_.OnSessionRead(client_id_, *msg, elapsed_from_output);
 
-            // 読み取り完了したのでバッファから削除
-            // msgをstring_viewにしている都合，input_buffer_からの削除は読み取り完了後にする必要がある
-            input_buffer_.erase(0, n);
+        // エラーなどでセッションが閉じられた場合は，残りの行を読まない
+        if (IsClosed()) {
+            return false;
+        }
 
-            ReadLine();
-        });
-}
+        // hint などの応答ではないメッセージでは，入力タイムアウトを元に戻す
+        if (!responded) {
+            input_deadline_.expires_at(deadline);
+        }
+    }
 
-void TCPSession::AwaitOutput()
-{
-    non_empty_output_queue_.async_wait(
-        [this, self = shared_from_this()](boost::system::error_code const& /* error */)
-        {
-            if (IsClosed()) {
-                return;
-            }
+    // 長すぎる行は改行を待たずに拒否する(メモリを際限なく確保しないため)
+    if (input_buffer_.IsOverflowed()) {
+        std::ostringstream buf;
+        buf << "client " << client_id_ << ": input line is too long (max: " << input_buffer_.GetMaxLineLength() << " bytes)";
+        std::runtime_error e(buf.str());
+        server_.OnGameError(e);
+        return false;
+    }
 
-            if (output_queue_.empty()) {
-                non_empty_output_queue_.expires_at(steady_timer::time_point::max());
-                AwaitOutput();
-            } else {
-                WriteLine();
-            }
-        });
+    return true;
 }
 
-void TCPSession::WriteLine()
+void TCPSession::WriteLines()
 {
+    assert(writing_messages_.empty());
+
+    if (IsClosed() || output_queue_.empty()) {
+        return;
+    }
+
+    // 送信待ちのメッセージを全てまとめ，1回の書き込みで送信する
+    write_buffers_.clear();
+    for (auto & message : output_queue_) {
+        write_buffers_.emplace_back(boost::asio::buffer(message.message.GetData()));
+        writing_messages_.emplace_back(std::move(message));
+    }
+    output_queue_.clear();
+
+    write_start_time_ = steady_timer::clock_type::now();
     boost::asio::async_write(socket_,
-        boost::asio::buffer(output_queue_.front().message),
-        [this, self = shared_from_this()](boost::system::error_code const& error, std::size_t /* n */)
+        write_buffers_,
+        boost::asio::bind_executor(strand_, [this, self = shared_from_this()](boost::system::error_code const& error, std::size_t n)
         {
             if (IsClosed()) {
                 return;
@@ -164,30 +211,32 @@ void TCPSession::WriteLine()
 
             if (error) { // 書き込み失敗はエラーなのでサーバーを停止
                 std::ostringstream buf;
-                buf << "client " << client_id_ << " error (WriteLine). (error code: " << error.value() << ")";
+                buf << "client " << client_id_ << " error (WriteLines). (error code: " << error.value() << ")";
                 Log::Error(buf.str());
                 server_.Stop();
                 return;
             }
 
             last_output_time_ = steady_timer::clock_type::now();
+            Metrics::Add(Metrics::Counter::kMessagesSent, writing_messages_.size());
+            Metrics::Add(Metrics::Counter::kBytesSent, n);
+            server_.OnSessionWritten(client_id_, last_output_time_ - write_start_time_);
 
             // input_deadline_ の設定
-            Message const& message = output_queue_.front();
-            if (message.input_timeout) {
-                input_deadline_.expires_after(*message.input_timeout);
+            // 1つずつ送信した場合と同じく，最後に送信したメッセージの設定が有効になる
+            if (auto const& input_timeout = writing_messages_.back().input_timeout; input_timeout) {
+                input_deadline_.expires_after(*input_timeout);
             } else {
                 input_deadline_.expires_at(steady_timer::time_point::max());
             }
 
-            {
-                std::string_view str = std::string_view(message.message).substr(0, message.message.size() - 1);
-                Log::Trace(Log::kServer, Log::Client(client_id_), str);
+            for (auto const& message : writing_messages_) {
+                Log::Trace(Log::kServer, Log::Client(client_id_), message.message.GetLine());
             }
 
-            output_queue_.pop_front();
-            AwaitOutput();
-        });
+            writing_messages_.clear();
+            WriteLines();
+        }));
 }
 
 void TCPSession::CheckInputDeadline()
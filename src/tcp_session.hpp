@@ -24,55 +24,73 @@
 #define DIGITALCURLING3_SERVER_TCP_SESSION_HPP
 
 #include <deque>
+#include <vector>
 #include <chrono>
 #include <optional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <exception>
+#include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include "line_buffer.hpp"
+#include "shared_message.hpp"
 
 namespace digitalcurling3_server {
 
 class Server;
 
+/// \brief クライアントとの1本の接続
+///
+/// ハンドラは全て Server::GetStrand() 上で実行される．
 class TCPSession : public std::enable_shared_from_this<TCPSession> {
 public:
-    TCPSession(boost::asio::ip::tcp::socket && socket, Server & server, size_t client_id);
+    /// \param socket 接続済みのソケット
+    /// \param server サーバー
+    /// \param client_id クライアントID
+    /// \param max_line_length 受信する1行の長さの上限．超えた場合はエラーとする．
+    /// \param input_buffer 受信済みのデータ(ホスティングモードで，接続を引き継ぐ場合に用いる)
+    TCPSession(boost::asio::ip::tcp::socket && socket, Server & server, size_t client_id, size_t max_line_length,
+        std::string_view input_buffer = std::string_view());
     void Open();
 
     /// <summary>
     /// メッセージを送信する．
     /// </summary>
-    /// <param name="message">送信するメッセージ．</param>
+    /// <param name="message">送信するメッセージ．バッファはコピーせず，送信完了まで参照を保持する．</param>
     /// <param name="input_timeout">次回の入力までのタイムアウト．nulloptの場合タイムアウトは発生しない．</param>
-    void Deliver(std::string && message, std::optional<std::chrono::milliseconds> const& input_timeout);
+    void Deliver(SharedMessage const& message, std::optional<std::chrono::milliseconds> const& input_timeout);
     void Close();
     bool IsClosed() const;
 
 private:
     struct Message {
-        std::string message;
+        SharedMessage message;
         std::optional<std::chrono::milliseconds> input_timeout;
 
-        Message(std::string const& m, std::optional<std::chrono::milliseconds> const& t)
+        Message(SharedMessage const& m, std::optional<std::chrono::milliseconds> const& t)
             : message(m)
             , input_timeout(t) {}
     };
 
     void ReadLine();
-    void AwaitOutput();
-    void WriteLine();
+    bool ProcessLines();
+    void WriteLines();
     void CheckInputDeadline();
 
     Server & server_;
+    boost::asio::strand<boost::asio::io_context::executor_type> const strand_;
     boost::asio::ip::tcp::socket socket_;
     size_t const client_id_;
-    std::string input_buffer_;
+    LineBuffer input_buffer_;
     boost::asio::steady_timer input_deadline_;
-    std::deque<Message> output_queue_;
-    boost::asio::steady_timer non_empty_output_queue_;
+    std::deque<Message> output_queue_;  // 送信待ちのメッセージ
+    std::vector<Message> writing_messages_;  // 送信中のメッセージ( WriteLines() でまとめて送信する)
+    std::vector<boost::asio::const_buffer> write_buffers_;
     boost::asio::steady_timer::time_point last_output_time_;
+    boost::asio::steady_timer::time_point write_start_time_;
 };
 
 } // namespace digitalcurling3_server
@@ -0,0 +1,293 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "timing.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <boost/asio/post.hpp>
+
+namespace digitalcurling3_server {
+
+namespace {
+
+constexpr size_t kBucketCount =
+    (LatencyHistogram::kMaxValueBits - LatencyHistogram::kSubBucketBits + 1) * LatencyHistogram::kSubBucketCount;
+
+inline int GetMostSignificantBit(std::uint64_t value)
+{
+    assert(value != 0);
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+inline double ToMicroseconds(std::chrono::nanoseconds value)
+{
+    return std::chrono::duration<double, std::micro>(value).count();
+}
+
+struct RegisteredTiming {
+    TimingRegistry::Strand strand;
+    GameTiming const* timing;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::uint64_t next_id = 0;
+    std::map<std::uint64_t, RegisteredTiming> timings;  // 進行中の試合
+    GameTiming finished;  // 終了した試合の合計
+};
+
+Registry & GetRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+/// \brief 1回の TimingRegistry::Collect() の途中経過
+struct Collection {
+    std::mutex mutex;
+    GameTiming total;
+    size_t remaining;
+    std::function<void(GameTiming const&)> handler;
+};
+
+void CompleteCollection(std::shared_ptr<Collection> const& collection)
+{
+    bool last;
+    {
+        std::lock_guard g(collection->mutex);
+        last = --collection->remaining == 0;
+    }
+    if (last) {
+        collection->handler(collection->total);
+    }
+}
+
+} // unnamed namespace
+
+LatencyHistogram::LatencyHistogram()
+    : counts_(kBucketCount, 0)
+    , count_(0)
+    , min_(std::numeric_limits<std::uint64_t>::max())
+    , max_(0)
+    , sum_(0)
+{}
+
+size_t LatencyHistogram::GetIndex(std::uint64_t value)
+{
+    // [0, kSubBucketCount) は値そのもの．
+    // それ以上は，最上位ビットの位置でグループを決め，最上位ビットを含む上位 kSubBucketBits + 1 ビットでグループ内の位置を決める．
+    if (value < kSubBucketCount) {
+        return static_cast<size_t>(value);
+    }
+    int const msb = std::min(GetMostSignificantBit(value), kMaxValueBits - 1);
+    if (msb == kMaxValueBits - 1 && (value >> msb) > 1) {
+        return kBucketCount - 1;
+    }
+    int const shift = msb - kSubBucketBits;
+    size_t const group = static_cast<size_t>(shift + 1);
+    size_t const sub = static_cast<size_t>((value >> shift) - kSubBucketCount);
+    return group * kSubBucketCount + sub;
+}
+
+std::uint64_t LatencyHistogram::GetUpperBound(size_t index)
+{
+    if (index < kSubBucketCount) {
+        return index;
+    }
+    size_t const group = index / kSubBucketCount;
+    std::uint64_t const sub = index % kSubBucketCount;
+    int const shift = static_cast<int>(group) - 1;
+    return ((kSubBucketCount + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(std::chrono::nanoseconds value)
+{
+    std::uint64_t const v = value.count() > 0 ? static_cast<std::uint64_t>(value.count()) : 0;
+    ++counts_[GetIndex(v)];
+    ++count_;
+    min_ = std::min(min_, v);
+    max_ = std::max(max_, v);
+    sum_ += v;
+}
+
+void LatencyHistogram::Merge(LatencyHistogram const& other)
+{
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetMin() const
+{
+    return std::chrono::nanoseconds(count_ == 0 ? 0 : min_);
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetMax() const
+{
+    return std::chrono::nanoseconds(max_);
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetMean() const
+{
+    return std::chrono::nanoseconds(count_ == 0 ? 0 : sum_ / count_);
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetPercentile(double percentile) const
+{
+    if (count_ == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+
+    auto const rank = std::max<std::uint64_t>(1,
+        static_cast<std::uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * static_cast<double>(count_))));
+    std::uint64_t accumulated = 0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        accumulated += counts_[i];
+        if (accumulated >= rank) {
+            // 最大のバケットには上限を超えた値も数えている
+            return std::chrono::nanoseconds(i + 1 == counts_.size() ? max_ : std::min(GetUpperBound(i), max_));
+        }
+    }
+    return std::chrono::nanoseconds(max_);
+}
+
+void to_json(nlohmann::json & j, LatencyHistogram const& histogram)
+{
+    j = nlohmann::json{
+        { "count", histogram.GetCount() },
+        { "min", ToMicroseconds(histogram.GetMin()) },
+        { "mean", ToMicroseconds(histogram.GetMean()) },
+        { "p50", ToMicroseconds(histogram.GetPercentile(50.0)) },
+        { "p90", ToMicroseconds(histogram.GetPercentile(90.0)) },
+        { "p99", ToMicroseconds(histogram.GetPercentile(99.0)) },
+        { "p999", ToMicroseconds(histogram.GetPercentile(99.9)) },
+        { "max", ToMicroseconds(histogram.GetMax()) },
+    };
+}
+
+
+std::string_view ToString(TimingPhase phase)
+{
+    switch (phase) {
+        case TimingPhase::kApplyMove:           return "apply_move";
+        case TimingPhase::kTrajectoryCompress:  return "trajectory_compress";
+        case TimingPhase::kTrajectorySerialize: return "trajectory_serialize";
+        case TimingPhase::kShotLog:             return "shot_log";
+        case TimingPhase::kUpdateSerialize:     return "update_serialize";
+        case TimingPhase::kUpdateLog:           return "update_log";
+        case TimingPhase::kSocketWrite:         return "socket_write";
+        case TimingPhase::kThinkTime:           return "think_time";
+        default:
+            assert(false);
+            return "unknown";
+    }
+}
+
+
+void GameTiming::Merge(GameTiming const& other)
+{
+    for (size_t i = 0; i < histograms_.size(); ++i) {
+        histograms_[i].Merge(other.histograms_[i]);
+    }
+}
+
+void to_json(nlohmann::json & j, GameTiming const& timing)
+{
+    j = nlohmann::json::object();
+    for (size_t i = 0; i < static_cast<size_t>(TimingPhase::kCount); ++i) {
+        auto const phase = static_cast<TimingPhase>(i);
+        j[std::string(ToString(phase))] = timing.Get(phase);
+    }
+}
+
+
+std::uint64_t TimingRegistry::Register(Strand const& strand, GameTiming const* timing)
+{
+    auto & registry = GetRegistry();
+    std::lock_guard g(registry.mutex);
+    auto const id = registry.next_id++;
+    registry.timings.emplace(id, RegisteredTiming{ strand, timing });
+    return id;
+}
+
+void TimingRegistry::Unregister(std::uint64_t id)
+{
+    auto & registry = GetRegistry();
+    std::lock_guard g(registry.mutex);
+    auto const it = registry.timings.find(id);
+    assert(it != registry.timings.end());
+    registry.finished.Merge(*it->second.timing);
+    registry.timings.erase(it);
+}
+
+void TimingRegistry::Collect(std::function<void(GameTiming const&)> handler)
+{
+    auto & registry = GetRegistry();
+    auto const collection = std::make_shared<Collection>();
+    collection->handler = std::move(handler);
+
+    std::vector<std::pair<std::uint64_t, Strand>> targets;
+    {
+        std::lock_guard g(registry.mutex);
+        collection->total = registry.finished;
+        for (auto const& [id, registered] : registry.timings) {
+            targets.emplace_back(id, registered.strand);
+        }
+    }
+    collection->remaining = targets.size() + 1;  // +1 はこの関数の分
+
+    for (auto const& [id, strand] : targets) {
+        boost::asio::post(strand, [collection, id = id]
+        {
+            {
+                // 読み出し中に試合が破棄されないよう，レジストリのロックを保持したまま加える
+                auto & registry = GetRegistry();
+                std::lock_guard g(registry.mutex);
+                if (auto const it = registry.timings.find(id); it != registry.timings.end()) {
+                    std::lock_guard g_collection(collection->mutex);
+                    collection->total.Merge(*it->second.timing);
+                }
+            }
+            CompleteCollection(collection);
+        });
+    }
+
+    CompleteCollection(collection);
+}
+
+} // namespace digitalcurling3_server
@@ -0,0 +1,189 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_TIMING_HPP
+#define DIGITALCURLING3_SERVER_TIMING_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
+#include "nlohmann/json.hpp"
+
+namespace digitalcurling3_server {
+
+/// \brief 処理時間の分布
+///
+/// HDR Histogram と同様に，2のべき乗ごとの区間をそれぞれ kSubBucketCount 等分したバケットで数える．
+/// 記録した値の相対誤差は 1 / kSubBucketCount 以下．
+/// 記録は配列の要素のインクリメントのみで，メモリの確保は構築時の1回のみ．
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr std::uint64_t kSubBucketCount = std::uint64_t(1) << kSubBucketBits;
+    static constexpr int kMaxValueBits = 48;  ///< これ以上の値(約78時間)は最大のバケットに数える
+
+    LatencyHistogram();
+
+    /// \brief 値を記録する
+    ///
+    /// \param value 記録する時間
+    void Record(std::chrono::nanoseconds value);
+
+    /// \brief 他の分布の値を全て加える
+    ///
+    /// \param other 加える分布
+    void Merge(LatencyHistogram const& other);
+
+    std::uint64_t GetCount() const { return count_; }
+    std::chrono::nanoseconds GetMin() const;
+    std::chrono::nanoseconds GetMax() const;
+    std::chrono::nanoseconds GetMean() const;
+    std::chrono::nanoseconds GetSum() const { return std::chrono::nanoseconds(sum_); }
+
+    /// \brief パーセンタイル値を得る
+    ///
+    /// \param percentile パーセンタイル(0以上100以下)
+    /// \return パーセンタイル値(その値を含むバケットの上限．最大値を超えない)．記録が無い場合は0．
+    std::chrono::nanoseconds GetPercentile(double percentile) const;
+
+private:
+    std::vector<std::uint64_t> counts_;
+    std::uint64_t count_;
+    std::uint64_t min_;
+    std::uint64_t max_;
+    std::uint64_t sum_;  // 平均の計算用(ナノ秒)
+
+    static size_t GetIndex(std::uint64_t value);
+    static std::uint64_t GetUpperBound(size_t index);
+};
+
+/// \brief {"count", "min", "mean", "p50", "p90", "p99", "p999", "max"} に変換する(時間の単位はマイクロ秒)
+void to_json(nlohmann::json & j, LatencyHistogram const& histogram);
+
+
+/// \brief 計測する処理
+enum class TimingPhase {
+    kApplyMove,            ///< digitalcurling3::ApplyMove() 全体(シミュレーションと軌跡の圧縮を含む)
+    kTrajectoryCompress,   ///< TrajectoryCompressor の処理(1ショット分の合計)
+    kTrajectorySerialize,  ///< 軌跡のシリアライズ
+    kShotLog,              ///< ショットログの構築と出力
+    kUpdateSerialize,      ///< 更新メッセージの構築
+    kUpdateLog,            ///< 更新メッセージの試合ログへの出力
+    kSocketWrite,          ///< ソケットへの書き込みの開始から完了まで
+    kThinkTime,            ///< クライアントの思考時間(更新メッセージの送信完了からmoveの受信まで)
+    kCount,
+};
+
+std::string_view ToString(TimingPhase phase);
+
+
+/// \brief 1試合分の処理時間の計測結果
+class GameTiming {
+public:
+    void Record(TimingPhase phase, std::chrono::nanoseconds value)
+    {
+        histograms_[static_cast<size_t>(phase)].Record(value);
+    }
+
+    LatencyHistogram const& Get(TimingPhase phase) const
+    {
+        return histograms_[static_cast<size_t>(phase)];
+    }
+
+    void Merge(GameTiming const& other);
+
+private:
+    std::array<LatencyHistogram, static_cast<size_t>(TimingPhase::kCount)> histograms_;
+};
+
+/// \brief 処理ごとの LatencyHistogram のオブジェクトに変換する
+void to_json(nlohmann::json & j, GameTiming const& timing);
+
+
+/// \brief 全ての試合の GameTiming を問い合わせ時に合計する
+///
+/// GameTiming は試合のストランド上でのみ更新されるため， Collect() は各試合のストランド上で値を読み出す．
+/// 終了した試合の値は Unregister() の時点で合計に加え，以降の問い合わせにも含める．
+///
+/// Metrics と同じく静的関数のみを持ち，どのスレッドからでも呼び出せる．
+class TimingRegistry {
+public:
+    using Strand = boost::asio::strand<boost::asio::io_context::executor_type>;
+
+    TimingRegistry() = delete;
+
+    /// \brief 試合の計測結果を登録する
+    ///
+    /// \param strand timing を更新するストランド
+    /// \param timing 計測結果． Unregister() まで有効であること
+    /// \return Unregister() に渡すID
+    static std::uint64_t Register(Strand const& strand, GameTiming const* timing);
+
+    /// \brief 登録を解除し，計測結果を終了した試合の合計に加える
+    ///
+    /// \param id Register() の戻り値
+    static void Unregister(std::uint64_t id);
+
+    /// \brief 終了した試合と進行中の全ての試合の計測結果を合計する
+    ///
+    /// 問い合わせ中に終了した試合の値は，次の問い合わせから含まれる．
+    ///
+    /// \param handler 合計を受け取る関数．最後に値を読み出したスレッドで呼び出される
+    static void Collect(std::function<void(GameTiming const&)> handler);
+};
+
+
+/// \brief スコープの処理時間を計測する
+///
+/// 計測が無効( timing が \c nullptr )の場合は時刻を取得しない．
+class ScopedTiming {
+public:
+    ScopedTiming(GameTiming * timing, TimingPhase phase)
+        : timing_(timing)
+        , phase_(phase)
+        , start_(timing ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point())
+    {}
+
+    ScopedTiming(ScopedTiming const&) = delete;
+    ScopedTiming & operator = (ScopedTiming const&) = delete;
+
+    ~ScopedTiming()
+    {
+        if (timing_) {
+            timing_->Record(phase_, std::chrono::steady_clock::now() - start_);
+        }
+    }
+
+private:
+    GameTiming * const timing_;
+    TimingPhase const phase_;
+    std::chrono::steady_clock::time_point const start_;
+};
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_TIMING_HPP
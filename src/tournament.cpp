@@ -0,0 +1,335 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "tournament.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+namespace digitalcurling3_server {
+
+namespace dc = digitalcurling3;
+
+namespace {
+
+/// 予定した試合を順に開始するだけの予定
+class QueuedSchedule : public Schedule {
+public:
+    std::optional<ScheduledGame> Next() override
+    {
+        if (queue_.empty()) {
+            return std::nullopt;
+        }
+        auto const game = queue_.front();
+        queue_.pop_front();
+        return game;
+    }
+
+    void OnResult(ScheduledGame const& /* game */, std::optional<dc::Team> /* winner */) override
+    {
+        ++finished_;
+    }
+
+    bool IsFinished() const override
+    {
+        return finished_ == total_;
+    }
+
+    size_t GetTotalGames() const override
+    {
+        return total_;
+    }
+
+protected:
+    void Push(ScheduledGame const& game)
+    {
+        queue_.push_back(game);
+        ++total_;
+    }
+
+    /// 1つの組み合わせの試合を，チームを交互に入れ替えながら予定する
+    void PushPairing(size_t round, size_t a, size_t b, size_t games_per_pairing)
+    {
+        for (size_t i = 0; i < games_per_pairing; ++i) {
+            if (i % 2 == 0) {
+                Push(ScheduledGame{ round, { a, b } });
+            } else {
+                Push(ScheduledGame{ round, { b, a } });
+            }
+        }
+    }
+
+    size_t GetFinishedGames() const
+    {
+        return finished_;
+    }
+
+private:
+    std::deque<ScheduledGame> queue_;
+    size_t total_ = 0;
+    size_t finished_ = 0;
+};
+
+
+class RepeatedSchedule : public QueuedSchedule {
+public:
+    RepeatedSchedule(size_t games, bool alternate_teams)
+    {
+        for (size_t i = 0; i < games; ++i) {
+            if (alternate_teams && i % 2 == 1) {
+                Push(ScheduledGame{ 0, { 1, 0 } });
+            } else {
+                Push(ScheduledGame{ 0, { 0, 1 } });
+            }
+        }
+    }
+};
+
+
+class RoundRobinSchedule : public QueuedSchedule {
+public:
+    RoundRobinSchedule(size_t engine_count, size_t rounds, size_t games_per_pairing)
+    {
+        for (size_t round = 0; round < rounds; ++round) {
+            for (size_t a = 0; a < engine_count; ++a) {
+                for (size_t b = a + 1; b < engine_count; ++b) {
+                    PushPairing(round, a, b, games_per_pairing);
+                }
+            }
+        }
+    }
+};
+
+
+class GauntletSchedule : public QueuedSchedule {
+public:
+    GauntletSchedule(size_t engine_count, size_t rounds, size_t games_per_pairing)
+    {
+        for (size_t round = 0; round < rounds; ++round) {
+            for (size_t b = 1; b < engine_count; ++b) {
+                PushPairing(round, 0, b, games_per_pairing);
+            }
+        }
+    }
+};
+
+
+/// スイス式．前のラウンドの全ての試合が終わってから次のラウンドの組み合わせを決める．
+///
+/// 勝ち点(勝ち1，引き分け0.5)の高い順に並べ，上から順に，まだ対戦していない最も近い順位のエンジンと組み合わせる．
+/// そのようなエンジンが無い場合は再戦を許す．
+/// エンジンの数が奇数の場合，不戦勝を受けていない最下位のエンジンを不戦勝とする．
+/// 不戦勝は1つの組み合わせの全ての試合に勝った場合と同じ勝ち点を得る．
+class SwissSchedule : public QueuedSchedule {
+public:
+    SwissSchedule(size_t engine_count, size_t rounds, size_t games_per_pairing)
+        : engine_count_(engine_count)
+        , rounds_(rounds)
+        , games_per_pairing_(games_per_pairing)
+        , next_round_(0)
+        , half_points_(engine_count, 0)
+        , had_bye_(engine_count, false)
+        , met_(engine_count, std::vector<bool>(engine_count, false))
+        , byes_()
+    {
+        PairNextRound();
+    }
+
+    std::optional<ScheduledGame> Next() override
+    {
+        if (auto game = QueuedSchedule::Next(); game) {
+            return game;
+        }
+
+        // 前のラウンドの全ての試合が終わるまで，次のラウンドの組み合わせは決まらない
+        if (GetFinishedGames() == QueuedSchedule::GetTotalGames() && next_round_ < rounds_) {
+            PairNextRound();
+            return QueuedSchedule::Next();
+        }
+
+        return std::nullopt;
+    }
+
+    void OnResult(ScheduledGame const& game, std::optional<dc::Team> winner) override
+    {
+        QueuedSchedule::OnResult(game, winner);
+
+        if (!winner) return;  // エラーの場合は勝ち点を与えない
+
+        if (*winner == dc::Team::kInvalid) {
+            half_points_[game.engines[0]] += 1;
+            half_points_[game.engines[1]] += 1;
+        } else {
+            half_points_[game.engines[static_cast<size_t>(*winner)]] += 2;
+        }
+    }
+
+    bool IsFinished() const override
+    {
+        return next_round_ == rounds_ && QueuedSchedule::IsFinished();
+    }
+
+    size_t GetTotalGames() const override
+    {
+        return rounds_ * (engine_count_ / 2) * games_per_pairing_;
+    }
+
+    std::vector<ScheduledBye> GetByes() const override
+    {
+        return byes_;
+    }
+
+private:
+    size_t const engine_count_;
+    size_t const rounds_;
+    size_t const games_per_pairing_;
+    size_t next_round_;
+    std::vector<size_t> half_points_;  // 勝ち点の2倍
+    std::vector<bool> had_bye_;
+    std::vector<std::vector<bool>> met_;
+    std::vector<ScheduledBye> byes_;
+
+    void PairNextRound()
+    {
+        size_t const round = next_round_++;
+
+        std::vector<size_t> order(engine_count_);
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::stable_sort(order.begin(), order.end(),
+            [this](size_t a, size_t b) { return half_points_[a] > half_points_[b]; });
+
+        if (order.size() % 2 == 1) {
+            auto bye = std::find_if(order.rbegin(), order.rend(), [this](size_t e) { return !had_bye_[e]; });
+            if (bye == order.rend()) {
+                bye = order.rbegin();
+            }
+            had_bye_[*bye] = true;
+            half_points_[*bye] += 2 * games_per_pairing_;
+            byes_.push_back(ScheduledBye{ round, *bye, games_per_pairing_ });
+            order.erase(std::next(bye).base());
+        }
+
+        std::vector<bool> paired(engine_count_, false);
+        for (size_t i = 0; i < order.size(); ++i) {
+            size_t const a = order[i];
+            if (paired[a]) continue;
+
+            size_t opponent = engine_count_;
+            for (size_t j = i + 1; j < order.size(); ++j) {
+                size_t const b = order[j];
+                if (paired[b]) continue;
+                if (opponent == engine_count_) {
+                    opponent = b;  // 再戦を避けられない場合の候補
+                }
+                if (!met_[a][b]) {
+                    opponent = b;
+                    break;
+                }
+            }
+            assert(opponent != engine_count_);
+
+            paired[a] = true;
+            paired[opponent] = true;
+            met_[a][opponent] = true;
+            met_[opponent][a] = true;
+            PushPairing(round, a, opponent, games_per_pairing_);
+        }
+    }
+};
+
+} // unnamed namespace
+
+
+void from_json(nlohmann::json const& j, TournamentSettings & settings)
+{
+    j.at("scheme").get_to(settings.scheme);
+    if (nlohmann::json(settings.scheme) != j.at("scheme")) {  // 未知の値は最初の値に変換されるため
+        throw std::runtime_error("unknown tournament scheme");
+    }
+
+    settings.engines.clear();
+    for (auto const& j_engine : j.at("engines")) {
+        TournamentSettings::Engine engine;
+        if (auto it = j_engine.find("name"); it != j_engine.end()) {
+            it->get_to(engine.name);
+        } else {
+            std::ostringstream buf;
+            buf << "engine " << settings.engines.size();
+            engine.name = buf.str();
+        }
+        engine.library = j_engine.value("library", std::string());
+        engine.args = j_engine.value("args", std::string());
+        engine.command = j_engine.value("command", std::string());
+        if (engine.library.empty() == engine.command.empty()) {
+            throw std::runtime_error("specify exactly one of \"library\" and \"command\" for each engine");
+        }
+        settings.engines.emplace_back(std::move(engine));
+    }
+    if (settings.engines.size() < 2) {
+        throw std::runtime_error("tournament needs 2 or more engines");
+    }
+
+    if (auto it = j.find("rounds"); it != j.end()) {
+        it->get_to(settings.rounds);
+    } else if (settings.scheme == PairingScheme::kSwiss) {
+        settings.rounds = 0;
+        while ((size_t(1) << settings.rounds) < settings.engines.size()) {
+            ++settings.rounds;
+        }
+    } else {
+        settings.rounds = 1;
+    }
+
+    settings.games_per_pairing = j.value("games_per_pairing", size_t(2));
+
+    if (settings.rounds == 0 || settings.games_per_pairing == 0) {
+        throw std::runtime_error("rounds and games_per_pairing must be 1 or more");
+    }
+}
+
+
+std::unique_ptr<Schedule> CreateRepeatedSchedule(size_t games, bool alternate_teams)
+{
+    return std::make_unique<RepeatedSchedule>(games, alternate_teams);
+}
+
+std::unique_ptr<Schedule> CreateSchedule(PairingScheme scheme, size_t engine_count, size_t rounds, size_t games_per_pairing)
+{
+    assert(engine_count >= 2);
+
+    switch (scheme) {
+        case PairingScheme::kRoundRobin:
+            return std::make_unique<RoundRobinSchedule>(engine_count, rounds, games_per_pairing);
+        case PairingScheme::kSwiss:
+            return std::make_unique<SwissSchedule>(engine_count, rounds, games_per_pairing);
+        case PairingScheme::kGauntlet:
+            return std::make_unique<GauntletSchedule>(engine_count, rounds, games_per_pairing);
+        default:
+            throw std::invalid_argument("unsupported pairing scheme");
+    }
+}
+
+} // namespace digitalcurling3_server
@@ -0,0 +1,145 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_TOURNAMENT_HPP
+#define DIGITALCURLING3_SERVER_TOURNAMENT_HPP
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "nlohmann/json.hpp"
+
+namespace digitalcurling3_server {
+
+/// \brief 組み合わせの方式
+enum class PairingScheme {
+    kRoundRobin,  ///< 全てのエンジンの組み合わせで対戦する
+    kSwiss,       ///< ラウンドごとに，勝ち点の近いエンジン同士で(可能な限り再戦を避けて)対戦する
+    kGauntlet,    ///< エンジン0と他の全てのエンジンが対戦する
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(PairingScheme, {
+    {PairingScheme::kRoundRobin, "round-robin"},
+    {PairingScheme::kSwiss, "swiss"},
+    {PairingScheme::kGauntlet, "gauntlet"},
+})
+
+/// \brief 予定された1試合
+struct ScheduledGame {
+    size_t round;  ///< ラウンド番号(0始まり)
+    std::array<size_t, 2> engines;  ///< チームごとのエンジンの番号
+};
+
+/// \brief 不戦勝
+struct ScheduledBye {
+    size_t round;   ///< ラウンド番号(0始まり)
+    size_t engine;  ///< 不戦勝となったエンジンの番号
+    size_t wins;    ///< 勝ちとして数える試合数(1つの組み合わせの試合数)
+};
+
+/// \brief 試合の予定を決める
+///
+/// Batch のストランド上でのみ呼び出される．
+class Schedule {
+public:
+    virtual ~Schedule() = default;
+
+    /// \brief 次に開始する試合を得る
+    ///
+    /// \return 次に開始する試合．全ての試合を開始済みの場合や，
+    ///     進行中の試合の結果が出るまで次の試合が決まらない場合は \c std::nullopt
+    virtual std::optional<ScheduledGame> Next() = 0;
+
+    /// \brief 試合の結果を通知する
+    ///
+    /// \param game 終了した試合
+    /// \param winner 勝ったチーム．引き分けの場合は \c Team::kInvalid ，エラーなどで結果が無い場合は \c std::nullopt
+    virtual void OnResult(ScheduledGame const& game, std::optional<digitalcurling3::Team> winner) = 0;
+
+    /// \brief 全ての試合が終了したか
+    virtual bool IsFinished() const = 0;
+
+    /// \brief 予定している試合の総数
+    virtual size_t GetTotalGames() const = 0;
+
+    /// \brief これまでに決まった不戦勝
+    ///
+    /// 組み合わせに使った勝ち点と成績表の勝ち点を一致させるため，成績表にも加える．
+    virtual std::vector<ScheduledBye> GetByes() const { return {}; }
+};
+
+/// \brief トーナメントモードの設定ファイルの内容
+///
+/// \code{.json}
+/// {
+///     "scheme": "round-robin",    // "round-robin" | "swiss" | "gauntlet"
+///     "rounds": 1,                // 省略時は1(スイスでは省略時 ceil(log2(エンジン数)))
+///     "games_per_pairing": 2,     // 省略時は2
+///     "engines": [
+///         { "name": "A", "library": "engine_a.so", "args": "" },  // name, args は省略可
+///         { "name": "B", "library": "engine_b.so" },
+///         { "name": "C", "command": "./engine_c --model net.bin" }  // 子プロセスとして起動する
+///     ]
+/// }
+/// \endcode
+struct TournamentSettings {
+    /// \brief エンジンの指定
+    struct Engine {
+        std::string name;     ///< 結果の表に表示する名前(省略時は "engine <番号>")
+        std::string library;  ///< 共有ライブラリのパス(設定ファイルからの相対パス)． command とどちらか一方を指定する．
+        std::string args;     ///< エンジンに渡す文字列( library を指定した場合のみ)
+        std::string command;  ///< 子プロセスとして起動するコマンドライン．プロセスは試合をまたいで再利用する．
+    };
+
+    PairingScheme scheme;
+    size_t rounds;
+    size_t games_per_pairing;
+    std::vector<Engine> engines;
+};
+
+void from_json(nlohmann::json const& j, TournamentSettings & settings);
+
+
+/// \brief 2つのエンジンを繰り返し対戦させる
+///
+/// \param games 試合数
+/// \param alternate_teams \c true の場合，奇数番目(0始まり)の試合でチームを入れ替える
+/// \return 試合の予定
+std::unique_ptr<Schedule> CreateRepeatedSchedule(size_t games, bool alternate_teams);
+
+/// \brief 組み合わせの方式に従う試合の予定を作る
+///
+/// 1つの組み合わせでは games_per_pairing 試合を，チームを交互に入れ替えながら行う．
+///
+/// \param scheme 組み合わせの方式
+/// \param engine_count エンジンの数(>= 2)
+/// \param rounds ラウンド数．総当たりとガントレットでは全ての組み合わせを繰り返す回数，スイスではラウンド数．
+/// \param games_per_pairing 1つの組み合わせで行う試合数(>= 1)
+/// \return 試合の予定
+std::unique_ptr<Schedule> CreateSchedule(PairingScheme scheme, size_t engine_count, size_t rounds, size_t games_per_pairing);
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_TOURNAMENT_HPP
@@ -0,0 +1,683 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "trajectory_codec.hpp"
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include "util.hpp"
+
+namespace dc = digitalcurling3;
+
+namespace digitalcurling3_server {
+
+namespace {
+
+constexpr char kMagic[4] = { 'D', 'C', 'T', 'J' };
+constexpr std::uint8_t kBinaryVersion = 2;
+constexpr std::uint8_t kBinaryVersionWithoutTolerance = 1;  // 許容誤差を記録しない(可逆圧縮として読む)
+constexpr std::uint32_t kPositionUnit = 10000;  // 0.1mm
+constexpr std::uint32_t kAngleUnit = 10000;  // 0.0001rad
+
+constexpr std::uint8_t kFlagAbsolute = 0x40;
+constexpr std::uint8_t kFlagRemoved = 0x80;
+constexpr std::uint8_t kSlotMask = 0x3f;
+
+constexpr size_t kTeamCount = std::tuple_size_v<dc::GameState::Stones>;
+constexpr size_t kStonesPerTeam = std::tuple_size_v<dc::GameState::Stones::value_type>;
+constexpr size_t kSlotCount = kTeamCount * kStonesPerTeam;
+static_assert(kSlotCount <= kSlotMask + 1);
+
+constexpr auto kFormatBinary = "binary";
+
+
+/// 量子化したストーンの状態
+struct QuantizedStone {
+    std::int64_t x = 0;
+    std::int64_t y = 0;
+    std::int64_t angle = 0;
+};
+
+QuantizedStone Quantize(dc::Transform const& transform, std::uint32_t position_unit, std::uint32_t angle_unit)
+{
+    QuantizedStone q;
+    q.x = std::llround(static_cast<double>(transform.position.x) * position_unit);
+    q.y = std::llround(static_cast<double>(transform.position.y) * position_unit);
+    q.angle = std::llround(static_cast<double>(transform.angle) * angle_unit);
+    return q;
+}
+
+dc::Transform Dequantize(QuantizedStone const& q, std::uint32_t position_unit, std::uint32_t angle_unit)
+{
+    return dc::Transform(
+        dc::Vector2(
+            static_cast<float>(static_cast<double>(q.x) / position_unit),
+            static_cast<float>(static_cast<double>(q.y) / position_unit)),
+        static_cast<float>(static_cast<double>(q.angle) / angle_unit));
+}
+
+
+class BinaryWriter {
+public:
+    explicit BinaryWriter(std::string & out) : out_(out) {}
+
+    void PutU8(std::uint8_t v)
+    {
+        out_ += static_cast<char>(v);
+    }
+
+    void PutU32(std::uint32_t v)
+    {
+        for (size_t i = 0; i < 4; ++i) {
+            PutU8(static_cast<std::uint8_t>(v >> (8 * i)));
+        }
+    }
+
+    void PutF32(float v)
+    {
+        static_assert(sizeof(float) == sizeof(std::uint32_t));
+        std::uint32_t u;
+        std::memcpy(&u, &v, sizeof(u));
+        PutU32(u);
+    }
+
+    void PutVarint(std::uint64_t v)
+    {
+        while (v >= 0x80) {
+            PutU8(static_cast<std::uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        PutU8(static_cast<std::uint8_t>(v));
+    }
+
+    void PutSVarint(std::int64_t v)
+    {
+        PutVarint((static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63));
+    }
+
+    void PutStone(QuantizedStone const& q)
+    {
+        PutSVarint(q.x);
+        PutSVarint(q.y);
+        PutSVarint(q.angle);
+    }
+
+private:
+    std::string & out_;
+};
+
+
+class BinaryReader {
+public:
+    explicit BinaryReader(std::string_view in) : in_(in) {}
+
+    std::uint8_t GetU8()
+    {
+        if (in_.empty()) {
+            throw std::runtime_error("trajectory binary: unexpected end of data");
+        }
+        auto const v = static_cast<std::uint8_t>(in_.front());
+        in_.remove_prefix(1);
+        return v;
+    }
+
+    std::uint32_t GetU32()
+    {
+        std::uint32_t v = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            v |= static_cast<std::uint32_t>(GetU8()) << (8 * i);
+        }
+        return v;
+    }
+
+    float GetF32()
+    {
+        std::uint32_t const u = GetU32();
+        float v;
+        std::memcpy(&v, &u, sizeof(v));
+        return v;
+    }
+
+    std::uint64_t GetVarint()
+    {
+        std::uint64_t v = 0;
+        for (unsigned int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t const b = GetU8();
+            v |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+            if ((b & 0x80) == 0) {
+                return v;
+            }
+        }
+        throw std::runtime_error("trajectory binary: varint too long");
+    }
+
+    std::int64_t GetSVarint()
+    {
+        std::uint64_t const v = GetVarint();
+        return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+    }
+
+    QuantizedStone GetStone()
+    {
+        QuantizedStone q;
+        q.x = GetSVarint();
+        q.y = GetSVarint();
+        q.angle = GetSVarint();
+        return q;
+    }
+
+    std::string_view GetBytes(size_t size)
+    {
+        if (in_.size() < size) {
+            throw std::runtime_error("trajectory binary: unexpected end of data");
+        }
+        auto const bytes = in_.substr(0, size);
+        in_.remove_prefix(size);
+        return bytes;
+    }
+
+    bool IsEnd() const { return in_.empty(); }
+
+private:
+    std::string_view in_;
+};
+
+
+using QuantizedStones = std::array<std::optional<QuantizedStone>, kSlotCount>;
+
+void PutStones(BinaryWriter & writer, dc::GameState::Stones const& stones, QuantizedStones & quantized)
+{
+    std::array<std::uint8_t, (kSlotCount + 7) / 8> bitmap{};
+    for (size_t i_team = 0; i_team < kTeamCount; ++i_team) {
+        for (size_t i_stone = 0; i_stone < kStonesPerTeam; ++i_stone) {
+            size_t const slot = i_team * kStonesPerTeam + i_stone;
+            if (auto const& stone = stones[i_team][i_stone]; stone) {
+                bitmap[slot / 8] |= static_cast<std::uint8_t>(1u << (slot % 8));
+                quantized[slot] = Quantize(*stone, kPositionUnit, kAngleUnit);
+            } else {
+                quantized[slot] = std::nullopt;
+            }
+        }
+    }
+
+    for (auto const b : bitmap) {
+        writer.PutU8(b);
+    }
+    for (auto const& q : quantized) {
+        if (q) {
+            writer.PutStone(*q);
+        }
+    }
+}
+
+void GetStones(BinaryReader & reader, size_t stones_per_team, std::uint32_t position_unit, std::uint32_t angle_unit,
+    dc::GameState::Stones & stones, QuantizedStones & quantized)
+{
+    size_t const slot_count = kTeamCount * stones_per_team;
+    auto const bitmap = reader.GetBytes((slot_count + 7) / 8);
+
+    for (size_t slot = 0; slot < slot_count; ++slot) {
+        auto & stone = stones[slot / stones_per_team][slot % stones_per_team];
+        if (static_cast<std::uint8_t>(bitmap[slot / 8]) & (1u << (slot % 8))) {
+            quantized[slot] = reader.GetStone();
+            stone = Dequantize(*quantized[slot], position_unit, angle_unit);
+        } else {
+            quantized[slot] = std::nullopt;
+            stone = std::nullopt;
+        }
+    }
+}
+
+
+
+// --- JSON文字列の直接書き込み ---
+
+/// 指数部を nlohmann::json と同じ書式(符号付き，2桁以上)で書き込む
+void AppendExponent(std::string & out, int e)
+{
+    out += e < 0 ? '-' : '+';
+    if (e < 0) e = -e;
+    if (e < 10) out += '0';
+    out += std::to_string(e);
+}
+
+/// 浮動小数点数を nlohmann::json の dump() と同じ書式で書き込む
+///
+/// 最短の桁は std::to_chars で求め，小数点と指数の書式を nlohmann::json に合わせる
+/// (整数値には ".0" を付け，10進指数が -4 より大きく 15 以下なら指数表記にしない)．
+/// 最短の桁の選び方が nlohmann::json と異なり，ごく一部の値で末尾の桁が変わることがあるが，読み込んだ値は元の値に一致する．
+void AppendFloat(std::string & out, float value)
+{
+    double const d = value;  // nlohmann::json は double で保持する
+    if (!std::isfinite(d)) {
+        out += "null";
+        return;
+    }
+    if (d == 0.0) {
+        out += std::signbit(d) ? "-0.0" : "0.0";
+        return;
+    }
+
+    // "[-]d[.ddd]e[+-]xx" の形で最短の桁を得る
+    std::array<char, 64> buf;
+    auto const [end, ec] = std::to_chars(buf.data(), buf.data() + buf.size(), d, std::chars_format::scientific);
+    assert(ec == std::errc());
+    std::string_view text(buf.data(), static_cast<size_t>(end - buf.data()));
+
+    if (text.front() == '-') {
+        out += '-';
+        text.remove_prefix(1);
+    }
+    auto const e_pos = text.find('e');
+    std::array<char, 32> digits;
+    int k = 0;  // 桁数
+    for (auto const c : text.substr(0, e_pos)) {
+        if (c != '.') digits[k++] = c;
+    }
+    int exponent = 0;
+    std::from_chars(text.data() + e_pos + 1 + (text[e_pos + 1] == '+' ? 1 : 0), text.data() + text.size(), exponent);
+
+    constexpr int kMinExp = -4;
+    constexpr int kMaxExp = 15;
+    int const n = exponent + 1;  // 小数点の位置(先頭の桁から数えた桁数)
+    std::string_view const ds(digits.data(), static_cast<size_t>(k));
+
+    if (k <= n && n <= kMaxExp) {
+        // dddd00.0
+        out += ds;
+        out.append(static_cast<size_t>(n - k), '0');
+        out += ".0";
+    } else if (0 < n && n <= kMaxExp) {
+        // dd.dd
+        out += ds.substr(0, static_cast<size_t>(n));
+        out += '.';
+        out += ds.substr(static_cast<size_t>(n));
+    } else if (kMinExp < n && n <= 0) {
+        // 0.000ddd
+        out += "0.";
+        out.append(static_cast<size_t>(-n), '0');
+        out += ds;
+    } else {
+        // d.ddde+xx
+        out += ds.front();
+        if (k > 1) {
+            out += '.';
+            out += ds.substr(1);
+        }
+        out += 'e';
+        AppendExponent(out, n - 1);
+    }
+}
+
+/// dc::Transform のJSONの書式
+///
+/// Transform のJSON表現はライブラリ側で定義されているため，
+/// 識別用の値を入れた Transform を1度だけシリアライズし，値の位置を調べて書式とする．
+class TransformFormat {
+public:
+    static TransformFormat const& Get()
+    {
+        static TransformFormat const instance;
+        return instance;
+    }
+
+    void Append(std::string & out, dc::Transform const& transform) const
+    {
+        if (!valid_) {  // 想定外の表現の場合は nlohmann::json を経由する
+            out += nlohmann::json(transform).dump();
+            return;
+        }
+        float const values[3] = { transform.position.x, transform.position.y, transform.angle };
+        for (size_t i = 0; i < 3; ++i) {
+            out += segments_[i];
+            AppendFloat(out, values[order_[i]]);
+        }
+        out += segments_[3];
+    }
+
+private:
+    bool valid_;
+    std::array<std::string, 4> segments_;
+    std::array<size_t, 3> order_;  // segments_[i] の後に書く値(0: x, 1: y, 2: angle)
+
+    TransformFormat()
+        : valid_(false)
+        , segments_()
+        , order_()
+    {
+        std::string const text = nlohmann::json(dc::Transform(dc::Vector2(1.25f, 2.5f), 3.75f)).dump();
+        std::string_view const tokens[3] = { "1.25", "2.5", "3.75" };
+
+        std::array<std::pair<size_t, size_t>, 3> positions;  // (位置, 値)
+        for (size_t i = 0; i < 3; ++i) {
+            size_t const pos = text.find(tokens[i]);
+            if (pos == std::string::npos || text.find(tokens[i], pos + 1) != std::string::npos) {
+                return;
+            }
+            positions[i] = { pos, i };
+        }
+        std::sort(positions.begin(), positions.end());
+
+        size_t prev_end = 0;
+        for (size_t i = 0; i < 3; ++i) {
+            auto const [pos, value] = positions[i];
+            if (pos < prev_end) {
+                return;
+            }
+            segments_[i] = text.substr(prev_end, pos - prev_end);
+            order_[i] = value;
+            prev_end = pos + tokens[value].size();
+        }
+        segments_[3] = text.substr(prev_end);
+        valid_ = true;
+    }
+};
+
+std::string const& GetTeamJson(dc::Team team)
+{
+    static std::array<std::string, kTeamCount> const team_json{
+        nlohmann::json(dc::Team::k0).dump(),
+        nlohmann::json(dc::Team::k1).dump() };
+    return team_json[static_cast<size_t>(team)];
+}
+
+void AppendStone(std::string & out, std::optional<dc::Transform> const& stone)
+{
+    if (stone) {
+        TransformFormat::Get().Append(out, *stone);
+    } else {
+        out += "null";
+    }
+}
+
+// {"team0":[...],"team1":[...]}
+void AppendStones(std::string & out, dc::GameState::Stones const& stones)
+{
+    out += '{';
+    for (size_t i_team = 0; i_team < kTeamCount; ++i_team) {
+        if (i_team > 0) out += ',';
+        out += nlohmann::json(dc::ToString(static_cast<dc::Team>(i_team))).dump();
+        out += ":[";
+        for (size_t i_stone = 0; i_stone < kStonesPerTeam; ++i_stone) {
+            if (i_stone > 0) out += ',';
+            AppendStone(out, stones[i_team][i_stone]);
+        }
+        out += ']';
+    }
+    out += '}';
+}
+
+} // unnamed namespace
+
+
+std::string EncodeTrajectoryBinary(TrajectoryCompressor::Result const& result)
+{
+    std::string data;
+    BinaryWriter writer(data);
+
+    // header
+    for (auto const c : kMagic) {
+        writer.PutU8(static_cast<std::uint8_t>(c));
+    }
+    writer.PutU8(kBinaryVersion);
+    writer.PutU8(static_cast<std::uint8_t>(kTeamCount));
+    writer.PutU8(static_cast<std::uint8_t>(kStonesPerTeam));
+    writer.PutU8(0);
+    writer.PutF32(result.seconds_per_frame);
+    writer.PutU32(kPositionUnit);
+    writer.PutU32(kAngleUnit);
+    writer.PutF32(result.tolerance.position);
+    writer.PutF32(result.tolerance.angle);
+
+    // start, finish
+    QuantizedStones prev;
+    {
+        QuantizedStones finish;
+        PutStones(writer, result.start, prev);
+        PutStones(writer, result.finish, finish);
+    }
+
+    // frames
+    // フレームインデックスはフレームの後に分かるため，フレームを別のバッファに書き込んでから連結する
+    std::string frame_data;
+    BinaryWriter frame_writer(frame_data);
+    std::vector<size_t> frame_sizes;
+    frame_sizes.reserve(result.GetFrameCount());
+
+    for (size_t i_frame = 0; i_frame < result.GetFrameCount(); ++i_frame) {
+        auto const frame = result.GetFrame(i_frame);
+        size_t const frame_begin = frame_data.size();
+        frame_writer.PutVarint(frame.size());
+        for (auto const& diff : frame) {
+            assert(diff.index < kStonesPerTeam);
+            size_t const slot = static_cast<size_t>(diff.team) * kStonesPerTeam + diff.index;
+            auto & prev_stone = prev[slot];
+
+            if (!diff.value) {
+                frame_writer.PutU8(static_cast<std::uint8_t>(slot) | kFlagRemoved);
+                prev_stone = std::nullopt;
+                continue;
+            }
+
+            auto const current = Quantize(*diff.value, kPositionUnit, kAngleUnit);
+            if (!prev_stone) {
+                frame_writer.PutU8(static_cast<std::uint8_t>(slot) | kFlagAbsolute);
+                frame_writer.PutStone(current);
+            } else {
+                frame_writer.PutU8(static_cast<std::uint8_t>(slot));
+                frame_writer.PutSVarint(current.x - prev_stone->x);
+                frame_writer.PutSVarint(current.y - prev_stone->y);
+                frame_writer.PutSVarint(current.angle - prev_stone->angle);
+            }
+            prev_stone = current;
+        }
+        frame_sizes.emplace_back(frame_data.size() - frame_begin);
+    }
+
+    writer.PutVarint(frame_sizes.size());
+    for (auto const frame_size : frame_sizes) {
+        writer.PutVarint(frame_size);
+    }
+    data += frame_data;
+
+    return data;
+}
+
+void DecodeTrajectoryBinary(std::string_view data, TrajectoryCompressor::Result & result)
+{
+    BinaryReader reader(data);
+
+    // header
+    if (reader.GetBytes(sizeof(kMagic)) != std::string_view(kMagic, sizeof(kMagic))) {
+        throw std::runtime_error("trajectory binary: invalid magic");
+    }
+    std::uint8_t const version = reader.GetU8();
+    if (version != kBinaryVersion && version != kBinaryVersionWithoutTolerance) {
+        throw std::runtime_error("trajectory binary: unsupported version");
+    }
+    size_t const team_count = reader.GetU8();
+    size_t const stones_per_team = reader.GetU8();
+    if (team_count != kTeamCount || stones_per_team == 0 || stones_per_team > kStonesPerTeam) {
+        throw std::runtime_error("trajectory binary: invalid stone count");
+    }
+    reader.GetU8();  // reserved
+    result.Reset();
+    result.seconds_per_frame = reader.GetF32();
+    std::uint32_t const position_unit = reader.GetU32();
+    std::uint32_t const angle_unit = reader.GetU32();
+    if (position_unit == 0 || angle_unit == 0) {
+        throw std::runtime_error("trajectory binary: invalid unit");
+    }
+    if (version != kBinaryVersionWithoutTolerance) {
+        result.tolerance.position = reader.GetF32();
+        result.tolerance.angle = reader.GetF32();
+    }
+
+    // start, finish
+    QuantizedStones prev;
+    {
+        QuantizedStones finish;
+        GetStones(reader, stones_per_team, position_unit, angle_unit, result.start, prev);
+        GetStones(reader, stones_per_team, position_unit, angle_unit, result.finish, finish);
+    }
+
+    // frames
+    // 先頭から順に読むため，フレームインデックスは読み飛ばす
+    std::uint64_t const frame_count = reader.GetVarint();
+    std::uint64_t frame_data_size = 0;
+    for (std::uint64_t i = 0; i < frame_count; ++i) {
+        frame_data_size += reader.GetVarint();
+    }
+
+    BinaryReader frame_reader(reader.GetBytes(frame_data_size));
+    if (!reader.IsEnd()) {
+        throw std::runtime_error("trajectory binary: trailing data");
+    }
+
+    size_t const slot_count = kTeamCount * stones_per_team;
+    for (std::uint64_t i = 0; i < frame_count; ++i) {
+        std::uint64_t const diff_count = frame_reader.GetVarint();
+        for (std::uint64_t j = 0; j < diff_count; ++j) {
+            std::uint8_t const tag = frame_reader.GetU8();
+            size_t const slot = tag & kSlotMask;
+            if (slot >= slot_count) {
+                throw std::runtime_error("trajectory binary: invalid slot");
+            }
+            auto const team = static_cast<dc::Team>(slot / stones_per_team);
+            size_t const index = slot % stones_per_team;
+            auto & prev_stone = prev[slot];
+
+            if (tag & kFlagRemoved) {
+                prev_stone = std::nullopt;
+                result.differences.emplace_back(team, index, std::nullopt);
+                continue;
+            }
+
+            if (tag & kFlagAbsolute) {
+                prev_stone = frame_reader.GetStone();
+            } else {
+                if (!prev_stone) {
+                    throw std::runtime_error("trajectory binary: difference for a stone not in play");
+                }
+                prev_stone->x += frame_reader.GetSVarint();
+                prev_stone->y += frame_reader.GetSVarint();
+                prev_stone->angle += frame_reader.GetSVarint();
+            }
+            result.differences.emplace_back(team, index, Dequantize(*prev_stone, position_unit, angle_unit));
+        }
+        result.EndFrame();
+    }
+
+    if (!frame_reader.IsEnd()) {
+        throw std::runtime_error("trajectory binary: invalid frame index");
+    }
+}
+
+void TrajectoryToJson(nlohmann::json & j, TrajectoryCompressor::Result const& result, TrajectoryFormat format)
+{
+    switch (format) {
+        case TrajectoryFormat::kJSON:
+            j = result;
+            break;
+
+        case TrajectoryFormat::kBinary:
+            j = {
+                { "format", format },
+                { "data", EncodeBase64(EncodeTrajectoryBinary(result)) }
+            };
+            break;
+
+        default:
+            assert(false);
+    }
+}
+
+void WriteTrajectoryJson(std::string & out, TrajectoryCompressor::Result const& result, TrajectoryFormat format)
+{
+    // キーは nlohmann::json と同じく辞書順に並べる
+    switch (format) {
+        case TrajectoryFormat::kJSON: {
+            out += "{\"finish\":";
+            AppendStones(out, result.finish);
+
+            out += ",\"frames\":[";
+            for (size_t i_frame = 0; i_frame < result.GetFrameCount(); ++i_frame) {
+                if (i_frame > 0) out += ',';
+                out += '[';
+                bool first = true;
+                for (auto const& diff : result.GetFrame(i_frame)) {
+                    if (!first) out += ',';
+                    first = false;
+                    out += "{\"index\":";
+                    out += std::to_string(diff.index);
+                    out += ",\"team\":";
+                    out += GetTeamJson(diff.team);
+                    out += ",\"value\":";
+                    AppendStone(out, diff.value);
+                    out += '}';
+                }
+                out += ']';
+            }
+
+            out += "],\"seconds_per_frame\":";
+            AppendFloat(out, result.seconds_per_frame);
+
+            out += ",\"start\":";
+            AppendStones(out, result.start);
+
+            if (!result.tolerance.IsLossless()) {
+                out += ",\"tolerance\":{\"angle\":";
+                AppendFloat(out, result.tolerance.angle);
+                out += ",\"position\":";
+                AppendFloat(out, result.tolerance.position);
+                out += '}';
+            }
+            out += '}';
+            break;
+        }
+
+        case TrajectoryFormat::kBinary:
+            out += "{\"data\":\"";
+            out += EncodeBase64(EncodeTrajectoryBinary(result));  // Base64はエスケープ不要
+            out += "\",\"format\":";
+            out += nlohmann::json(format).dump();
+            out += '}';
+            break;
+
+        default:
+            assert(false);
+    }
+}
+
+void TrajectoryFromJson(nlohmann::json const& j, TrajectoryCompressor::Result & result)
+{
+    if (auto it = j.find("format"); it != j.end() && *it == kFormatBinary) {
+        DecodeTrajectoryBinary(DecodeBase64(j.at("data").get<std::string>()), result);
+    } else {
+        j.get_to(result);
+    }
+}
+
+} // namespace digitalcurling3_server
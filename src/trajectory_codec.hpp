@@ -0,0 +1,131 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_TRAJECTORY_CODEC_HPP
+#define DIGITALCURLING3_SERVER_TRAJECTORY_CODEC_HPP
+
+#include <string>
+#include <string_view>
+#include "nlohmann/json.hpp"
+#include "trajectory_compressor.hpp"
+
+namespace digitalcurling3_server {
+
+/// \brief 更新メッセージとショットログに載せる軌跡の形式
+enum class TrajectoryFormat {
+    kJSON,    ///< フレームごとの差分をJSONで表す(デフォルト．従来の形式)
+    kBinary,  ///< バイナリ形式をBase64で埋め込む
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(TrajectoryFormat, {
+    {TrajectoryFormat::kJSON, "json"},
+    {TrajectoryFormat::kBinary, "binary"},
+})
+
+
+/// \brief 軌跡をバイナリ形式にエンコードする
+///
+/// 座標と角度は固定小数点数に量子化し，ストーンごとに直前の値との差分を可変長整数で記録する．
+/// 量子化の単位(既定では 0.1mm と 0.0001rad)はヘッダに記録するため，デコード結果はこの精度で元の値に一致する．
+///
+/// JSONでは `{"format": "binary", "data": "<Base64>"}` の形で埋め込む．
+///
+/// 整数は全てリトルエンディアン． varint は LEB128 (下位7bitずつ，最上位bitが継続フラグ)，
+/// svarint は zigzag 符号化 ((n << 1) ^ (n >> 63)) した varint．
+///
+/// \code
+/// ヘッダ
+///   u8[4]   magic "DCTJ"
+///   u8      バージョン (2)
+///   u8      チーム数 T (2)
+///   u8      1チームのストーン数 S (8)
+///   u8      予約 (0)
+///   f32     seconds_per_frame
+///   u32     座標の単位の逆数 P (座標 = 値 / P [m])
+///   u32     角度の単位の逆数 A (角度 = 値 / A [rad])
+///   f32     位置の許容誤差 [m] (バージョン2以降．可逆圧縮の場合は0)
+///   f32     角度の許容誤差 [rad] (バージョン2以降．可逆圧縮の場合は0)
+/// ストーン配置 start
+/// ストーン配置 finish
+/// varint    フレーム数 F
+/// varint[F] フレームインデックス: 各フレームのバイト数
+///           (i番目のフレームの位置は先頭フレームの位置にそれ以前のバイト数を足したもの)
+/// フレーム × F
+///
+/// ストーン配置
+///   u8[ceil(T*S/8)] 存在ビットマップ (スロット i = team * S + index がビット i%8 of バイト i/8)
+///   存在するストーンについてスロット順に svarint x, svarint y, svarint angle (絶対値)
+///
+/// フレーム
+///   varint  差分の数 N
+///   差分 × N
+///     u8    bit0-5: スロット, bit6: 絶対値フラグ, bit7: 除外フラグ
+///     除外フラグが立っている場合: 値なし (ストーンがシート上から除外された)
+///     絶対値フラグが立っている場合: svarint x, svarint y, svarint angle (絶対値)
+///     それ以外: svarint dx, svarint dy, svarint dangle (そのストーンの直前の値との差分)
+/// \endcode
+///
+/// 直前の値とは start またはそれ以降のフレームでそのストーンに最後に記録された量子化後の値である．
+/// 差分はフレーム順に積算するため，フレームの途中から読む場合も先頭からの積算が必要になる．
+/// バージョン1のデータも読め，その場合は可逆圧縮の結果として扱う．
+///
+/// \param result 軌跡
+/// \return エンコードしたバイト列
+std::string EncodeTrajectoryBinary(TrajectoryCompressor::Result const& result);
+
+/// \brief バイナリ形式の軌跡をデコードする
+///
+/// 形式は EncodeTrajectoryBinary() を参照．不正なデータの場合は例外を送出する．
+///
+/// \param data エンコードされたバイト列
+/// \param result デコード結果の格納先
+void DecodeTrajectoryBinary(std::string_view data, TrajectoryCompressor::Result & result);
+
+/// \brief 軌跡を指定した形式のJSONに変換する
+///
+/// \param j 出力先
+/// \param result 軌跡
+/// \param format 形式
+void TrajectoryToJson(nlohmann::json & j, TrajectoryCompressor::Result const& result, TrajectoryFormat format);
+
+/// \brief 軌跡をJSONの文字列として書き込む
+///
+/// TrajectoryToJson() で作ったJSONを dump() したものと同じ書式の文字列を，JSONの木を作らずに書き込む．
+/// 浮動小数点数はごく一部の値で末尾の桁が dump() と異なることがあるが，読み込んだ値は同じになる．
+/// 更新メッセージのように，ショットごとに繰り返し作る場合に用いる．
+///
+/// \param out 出力先(末尾に追加する)
+/// \param result 軌跡
+/// \param format 形式
+void WriteTrajectoryJson(std::string & out, TrajectoryCompressor::Result const& result, TrajectoryFormat format);
+
+/// \brief JSONから軌跡を復元する
+///
+/// TrajectoryToJson() で出力したJSONであれば，形式によらず復元できる．
+///
+/// \param j 入力
+/// \param result 復元結果の格納先
+void TrajectoryFromJson(nlohmann::json const& j, TrajectoryCompressor::Result & result);
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_TRAJECTORY_CODEC_HPP
@@ -21,12 +21,43 @@
 // SOFTWARE.
 
 #include "trajectory_compressor.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include "util.hpp"
 
 namespace dc = digitalcurling3;
 
 namespace digitalcurling3_server {
 
+namespace {
+
+constexpr size_t kStonesPerTeam = std::tuple_size_v<dc::GameState::Stones::value_type>;
+
+/// 最下位の立っているビットの位置を得る
+inline unsigned int CountTrailingZeros(std::uint32_t x)
+{
+    assert(x != 0);
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return static_cast<unsigned int>(index);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(x));
+#endif
+}
+
+/// 許容誤差で正規化した誤差を得る(1を超えると許容誤差を超えている)
+float NormalizedError(float error, float tolerance)
+{
+    if (tolerance > 0.f) {
+        return error / tolerance;
+    }
+    return error > 0.f ? std::numeric_limits<float>::infinity() : 0.f;
+}
+
+} // unnamed namespace
+
 TrajectoryCompressor::Result::Result()
 {
     Reset();
@@ -35,6 +66,7 @@ TrajectoryCompressor::Result::Result()
 void TrajectoryCompressor::Result::Reset()
 {
     seconds_per_frame = 0.f;
+    tolerance = Tolerance{ 0.f, 0.f };
     for (auto & team_stones : start) {
         for (auto & stone : team_stones) {
             stone = std::nullopt;
@@ -45,7 +77,8 @@ void TrajectoryCompressor::Result::Reset()
             stone = std::nullopt;
         }
     }
-    frames.clear();
+    differences.clear();
+    frame_offsets.assign(1, 0);
 }
 
 TrajectoryCompressor::TrajectoryCompressor()
@@ -53,10 +86,18 @@ TrajectoryCompressor::TrajectoryCompressor()
     , frame_count_(0)
     , steps_per_frame_(0)
     , end_(0)
+    , tolerance_()
+    , all_stones_index_()
+    , prev_transforms_()
+    , prev_in_play_(0)
     , result_()
+    , tracks_()
+    , simplify_stack_()
+    , keyframes_()
+    , simplified_differences_()
 {}
 
-void TrajectoryCompressor::Begin(size_t steps_per_frame, std::uint8_t end)
+void TrajectoryCompressor::Begin(size_t steps_per_frame, std::uint8_t end, Tolerance const& tolerance)
 {
     assert(!active_);
 
@@ -64,8 +105,26 @@ void TrajectoryCompressor::Begin(size_t steps_per_frame, std::uint8_t end)
     frame_count_ = 0;
     steps_per_frame_ = steps_per_frame;
     end_ = end;
+    tolerance_ = tolerance;
+
+    // AllStoneData と GameState::Stones のインデックスの対応はエンドで決まるので，ショットの開始時に1度だけ求める．
+    // 各ストーンに識別用の値を入れて変換し，変換後の位置から対応を読み取る．
+    dc::ISimulator::AllStoneData probe;
+    for (size_t i = 0; i < probe.size(); ++i) {
+        auto & stone = probe[i].emplace();
+        stone.position.x = static_cast<float>(i);
+    }
+    auto const probe_stones = dc::GameState::StonesFromAllStones(probe, end_);
+    for (size_t i_team = 0; i_team < probe_stones.size(); ++i_team) {
+        for (size_t i_stone = 0; i_stone < kStonesPerTeam; ++i_stone) {
+            assert(probe_stones[i_team][i_stone]);
+            all_stones_index_[i_team * kStonesPerTeam + i_stone] =
+                static_cast<std::uint8_t>(probe_stones[i_team][i_stone]->position.x);
+        }
+    }
 
     result_.Reset();
+    result_.tolerance = tolerance;
 }
 
 void TrajectoryCompressor::OnStep(digitalcurling3::ISimulator const& simulator)
@@ -96,6 +155,10 @@ void TrajectoryCompressor::End(digitalcurling3::ISimulator const& simulator)
     auto const stones = dc::GameState::StonesFromAllStones(simulator.GetStones(), end_);
     result_.finish = stones;
 
+    if (!tolerance_.IsLossless()) {
+        Simplify();
+    }
+
     active_ = false;
 }
 
@@ -107,45 +170,193 @@ TrajectoryCompressor::Result const& TrajectoryCompressor::GetResult() const
 
 void TrajectoryCompressor::SetFirstFrame(digitalcurling3::ISimulator const& simulator)
 {
-    auto const current_stones = dc::GameState::StonesFromAllStones(simulator.GetStones(), end_);
-    prev_stones_ = current_stones;
-    result_.start = current_stones;
+    auto const& all_stones = simulator.GetStones();
+    result_.start = dc::GameState::StonesFromAllStones(all_stones, end_);
+
+    prev_in_play_ = 0;
+    for (size_t i = 0; i < kStoneMax; ++i) {
+        if (auto const& stone = all_stones[all_stones_index_[i]]; stone) {
+            prev_transforms_[i] = dc::Transform(stone->position, stone->angle);
+            prev_in_play_ |= 1u << i;
+        }
+    }
     result_.seconds_per_frame = simulator.GetSecondsPerFrame() * static_cast<float>(steps_per_frame_);
 }
 
 void TrajectoryCompressor::AddFrameDiff(digitalcurling3::ISimulator const& simulator)
 {
-    auto const current_stones = dc::GameState::StonesFromAllStones(simulator.GetStones(), end_);
+    // GameState::Stones への変換は行わず，シミュレータのストーンを直接比較する．
+    // 前回のフレームでシート上にあったストーンだけを走査するため，
+    // コストはシート上のストーンの数に比例する．
+    // (静止しているストーンもフレーム間に衝突で動き出すことがあるため，比較は省略できない)
+    auto const& all_stones = simulator.GetStones();
+
     // 差分の構築
-    std::vector<Difference> diffs;
-    for (size_t i_team = 0; i_team < current_stones.size(); ++i_team) {
-        auto const& prev_team_stones = prev_stones_[i_team];
-        auto const& current_team_stones = current_stones[i_team];
-
-        assert(prev_team_stones.size() == current_team_stones.size());
-
-        for (size_t i_stone = 0; i_stone < current_team_stones.size(); ++i_stone) {
-            auto const& prev_stone = prev_team_stones[i_stone];
-            auto const& current_stone = current_team_stones[i_stone];
-
-            if (prev_stone.has_value() != current_stone.has_value() ||
-                (prev_stone.has_value() && // current_stone.has_value()はtrueになるので判定しない
-                    (prev_stone->position.x != current_stone->position.x ||
-                        prev_stone->position.y != current_stone->position.y ||
-                        prev_stone->angle != current_stone->angle))) {
-                diffs.emplace_back(static_cast<dc::Team>(i_team), i_stone, current_stone);
+    // シミュレーションの途中でストーンが新たにシート上に現れることはない(投げたストーンは最初のフレームからある)ので，
+    // 前回シート上にあったストーンだけを見ればよい．
+    std::uint32_t in_play = prev_in_play_;
+    for (std::uint32_t engaged = prev_in_play_; engaged != 0; engaged &= engaged - 1) {
+        unsigned int const i = CountTrailingZeros(engaged);
+        auto const team = static_cast<dc::Team>(i / kStonesPerTeam);
+        size_t const index = i % kStonesPerTeam;
+        auto const& stone = all_stones[all_stones_index_[i]];
+        auto & prev_transform = prev_transforms_[i];
+
+        if (!stone) {
+            result_.differences.emplace_back(team, index, std::nullopt);
+            in_play &= ~(1u << i);
+        } else if (prev_transform.position.x != stone->position.x ||
+            prev_transform.position.y != stone->position.y ||
+            prev_transform.angle != stone->angle) {
+            prev_transform = dc::Transform(stone->position, stone->angle);  // 動いたストーンだけ更新する
+            result_.differences.emplace_back(team, index, prev_transform);
+        }
+    }
+
+    result_.EndFrame();
+
+    prev_in_play_ = in_play;
+}
+
+void TrajectoryCompressor::Simplify()
+{
+    // 可逆圧縮の結果からストーンごとの軌跡を作り，それぞれを Douglas-Peucker 法で単純化する．
+
+    // --- ストーンごとの軌跡を作る ---
+
+    for (auto & track : tracks_) {
+        track.clear();
+    }
+    for (size_t i = 0; i < kStoneMax; ++i) {
+        if (auto const& stone = result_.start[i / kStonesPerTeam][i % kStonesPerTeam]; stone) {
+            tracks_[i].push_back({ -1, *stone, false, true });
+        }
+    }
+
+    size_t const frame_count = result_.GetFrameCount();
+    for (size_t i_frame = 0; i_frame < frame_count; ++i_frame) {
+        auto const frame = static_cast<std::int32_t>(i_frame);
+        for (auto const& diff : result_.GetFrame(i_frame)) {
+            auto & track = tracks_[static_cast<size_t>(diff.team) * kStonesPerTeam + diff.index];
+            if (!diff.value) {
+                track.push_back({ frame, dc::Transform(), true, true });
+                continue;
             }
+            // 差分が無いフレームではストーンは静止している．
+            // 静止している区間が補間で崩れないよう，動き出す直前のフレームの値を補う．
+            if (!track.empty() && !track.back().removed && track.back().frame < frame - 1) {
+                track.push_back({ frame - 1, track.back().value, false, false });
+            }
+            track.push_back({ frame, *diff.value, false, false });
         }
     }
 
-    result_.frames.emplace_back(std::move(diffs));
+    // --- キーフレームを選ぶ ---
+
+    for (auto & track : tracks_) {
+        // 除外されたところで軌跡を区切り，区間ごとに単純化する
+        size_t first = 0;
+        for (size_t i = 0; i <= track.size(); ++i) {
+            if (i == track.size() || track[i].removed) {
+                if (first < i) {
+                    MarkKeyframes(track, first, i - 1);
+                }
+                first = i + 1;
+            }
+        }
+    }
 
-    prev_stones_ = current_stones;
+    // --- 結果を作り直す ---
+
+    keyframes_.clear();
+    for (size_t i = 0; i < kStoneMax; ++i) {
+        for (auto const& sample : tracks_[i]) {
+            if (!sample.keep || sample.frame < 0) continue;
+            std::optional<dc::Transform> value;
+            if (!sample.removed) {
+                value = sample.value;
+            }
+            keyframes_.push_back({ sample.frame, static_cast<std::uint8_t>(i), value });
+        }
+    }
+
+    // フレームごとに数えて並べる(ストーンの順に追加したので，フレーム内はストーンの順になる)
+    auto & offsets = result_.frame_offsets;
+    offsets.assign(frame_count + 1, 0);
+    for (auto const& keyframe : keyframes_) {
+        ++offsets[keyframe.frame + 1];
+    }
+    for (size_t i = 1; i <= frame_count; ++i) {
+        offsets[i] += offsets[i - 1];
+    }
+    simplified_differences_.resize(keyframes_.size());
+    for (auto const& keyframe : keyframes_) {
+        auto & diff = simplified_differences_[offsets[keyframe.frame]++];
+        diff.team = static_cast<dc::Team>(keyframe.stone / kStonesPerTeam);
+        diff.index = keyframe.stone % kStonesPerTeam;
+        diff.value = keyframe.value;
+    }
+    // この時点で offsets[i] はフレーム i の終了位置になっているので，1つずらす
+    for (size_t i = frame_count; i > 0; --i) {
+        offsets[i] = offsets[i - 1];
+    }
+    offsets[0] = 0;
+
+    result_.differences.swap(simplified_differences_);
+}
+
+void TrajectoryCompressor::MarkKeyframes(std::vector<Sample> & track, size_t first, size_t last)
+{
+    track[first].keep = true;
+    track[last].keep = true;
+
+    simplify_stack_.clear();
+    simplify_stack_.emplace_back(first, last);
+
+    while (!simplify_stack_.empty()) {
+        auto const [a, b] = simplify_stack_.back();
+        simplify_stack_.pop_back();
+        if (b - a < 2) continue;
+
+        auto const& sa = track[a];
+        auto const& sb = track[b];
+        auto const frames = static_cast<float>(sb.frame - sa.frame);
+
+        // 線形補間からの誤差が最も大きいサンプルを探す
+        float max_error = 0.f;
+        size_t max_index = a;
+        for (size_t i = a + 1; i < b; ++i) {
+            auto const& s = track[i];
+            float const t = static_cast<float>(s.frame - sa.frame) / frames;
+            float const dx = sa.value.position.x + (sb.value.position.x - sa.value.position.x) * t - s.value.position.x;
+            float const dy = sa.value.position.y + (sb.value.position.y - sa.value.position.y) * t - s.value.position.y;
+            float const da = sa.value.angle + (sb.value.angle - sa.value.angle) * t - s.value.angle;
+            float const error = std::max(
+                NormalizedError(std::sqrt(dx * dx + dy * dy), tolerance_.position),
+                NormalizedError(std::abs(da), tolerance_.angle));
+            if (error > max_error) {
+                max_error = error;
+                max_index = i;
+            }
+        }
+
+        if (max_error > 1.f) {
+            track[max_index].keep = true;
+            simplify_stack_.emplace_back(a, max_index);
+            simplify_stack_.emplace_back(max_index, b);
+        }
+    }
 }
 
 void to_json(nlohmann::json & j, TrajectoryCompressor::Result const& v)
 {
     j["seconds_per_frame"] = v.seconds_per_frame;
+    if (!v.tolerance.IsLossless()) {
+        j["tolerance"] = {
+            { "position", v.tolerance.position },
+            { "angle", v.tolerance.angle },
+        };
+    }
     auto & j_start = j["start"];
     for (size_t i = 0; i < v.start.size(); ++i) {
         j_start[dc::ToString(static_cast<dc::Team>(i))] = v.start[i];
@@ -154,12 +365,25 @@ void to_json(nlohmann::json & j, TrajectoryCompressor::Result const& v)
     for (size_t i = 0; i < v.finish.size(); ++i) {
         j_finish[dc::ToString(static_cast<dc::Team>(i))] = v.finish[i];
     }
-    j["frames"] = v.frames;
+    auto & j_frames = j["frames"];
+    j_frames = nlohmann::json::array();
+    for (size_t i = 0; i < v.GetFrameCount(); ++i) {
+        auto & j_frame = j_frames.emplace_back(nlohmann::json::array());
+        for (auto const& diff : v.GetFrame(i)) {
+            j_frame.push_back(diff);
+        }
+    }
 }
 
 void from_json(nlohmann::json const& j, TrajectoryCompressor::Result & v)
 {
     j.at("seconds_per_frame").get_to(v.seconds_per_frame);
+    if (auto it = j.find("tolerance"); it != j.end()) {
+        it->at("position").get_to(v.tolerance.position);
+        it->at("angle").get_to(v.tolerance.angle);
+    } else {
+        v.tolerance = TrajectoryCompressor::Tolerance{ 0.f, 0.f };
+    }
     auto const & j_start = j.at("start");
     for (size_t i = 0; i < v.start.size(); ++i) {
         j_start.at(dc::ToString(static_cast<dc::Team>(i))).get_to(v.start[i]);
@@ -168,7 +392,14 @@ void from_json(nlohmann::json const& j, TrajectoryCompressor::Result & v)
     for (size_t i = 0; i < v.finish.size(); ++i) {
         j_finish.at(dc::ToString(static_cast<dc::Team>(i))).get_to(v.finish[i]);
     }
-    j.at("frames").get_to(v.frames);
+    v.differences.clear();
+    v.frame_offsets.assign(1, 0);
+    for (auto const& j_frame : j.at("frames")) {
+        for (auto const& j_diff : j_frame) {
+            j_diff.get_to(v.differences.emplace_back());
+        }
+        v.EndFrame();
+    }
 }
 
 
@@ -23,7 +23,9 @@
 #ifndef DIGITALCURLING3_SERVER_TRAJECTORY_COMPRESSOR_HPP
 #define DIGITALCURLING3_SERVER_TRAJECTORY_COMPRESSOR_HPP
 
-#include <list>
+#include <array>
+#include <cstdint>
+#include <vector>
 #include "digitalcurling3/digitalcurling3.hpp"
 
 namespace digitalcurling3_server {
@@ -39,13 +41,81 @@ public:
             : team(team), index(index), value(value) {}
     };
 
+    /// \brief 1フレーム分の差分
+    ///
+    /// Result::differences の一部を指す．
+    class Frame {
+    public:
+        Frame(Difference const* first, Difference const* last) : first_(first), last_(last) {}
+        Difference const* begin() const { return first_; }
+        Difference const* end() const { return last_; }
+        size_t size() const { return static_cast<size_t>(last_ - first_); }
+        bool empty() const { return first_ == last_; }
+        Difference const& operator [] (size_t i) const { return first_[i]; }
+    private:
+        Difference const* first_;
+        Difference const* last_;
+    };
+
+    /// \brief 非可逆圧縮の許容誤差
+    ///
+    /// 両方とも0の場合は可逆圧縮になる．
+    struct Tolerance {
+        float position;  ///< 位置の許容誤差[m]
+        float angle;     ///< 角度の許容誤差[rad]
+
+        bool IsLossless() const { return position <= 0.f && angle <= 0.f; }
+    };
+
+    /// \brief 圧縮の結果
+    ///
+    /// start をフレーム -1 とし，i番目のフレームにはフレーム i-1 から変化したストーンの値が入る．
+    ///
+    /// 非可逆圧縮の場合，フレームにはキーフレームとなったストーンの値だけが入る．
+    /// キーフレームの間のフレームでのストーンの値は，前後のキーフレーム(最初は start の値)をフレーム番号で線形補間して得る．
+    /// 最後のキーフレーム以降は値は変化しない．
+    /// 空のフレームも省略しないため，フレーム番号と時刻の対応は可逆圧縮の場合と同じになる．
     struct Result {
         float seconds_per_frame;
+
+        /// \brief 圧縮時の許容誤差
+        ///
+        /// 非可逆圧縮の場合，JSONには "tolerance" として，バイナリ形式にはヘッダに記録する．
+        /// 可逆圧縮の場合(両方とも0)はJSONには出力しない．
+        Tolerance tolerance;
+
         digitalcurling3::GameState::Stones start;
         digitalcurling3::GameState::Stones finish;
-        std::list<std::vector<Difference>> frames;
+
+        /// \brief 全フレームの差分を連結したもの
+        std::vector<Difference> differences;
+
+        /// \brief 各フレームの開始位置(要素数はフレーム数 + 1)
+        ///
+        /// i番目のフレームの差分は differences[frame_offsets[i], frame_offsets[i + 1]) になる．
+        std::vector<size_t> frame_offsets;
+
         Result();
+
+        /// \brief 空にする
+        ///
+        /// ショットごとにメモリを確保し直さないよう，確保済みの領域は解放しない．
         void Reset();
+
+        /// \brief フレーム数を得る
+        size_t GetFrameCount() const { return frame_offsets.size() - 1; }
+
+        /// \brief フレームを得る
+        ///
+        /// \param i フレーム番号( < GetFrameCount())
+        /// \return i番目のフレーム
+        Frame GetFrame(size_t i) const
+        {
+            return Frame(differences.data() + frame_offsets[i], differences.data() + frame_offsets[i + 1]);
+        }
+
+        /// \brief 前回のフレーム以降に differences に追加した差分を1フレームとして確定する
+        void EndFrame() { frame_offsets.emplace_back(differences.size()); }
     };
 
     TrajectoryCompressor();
@@ -54,7 +124,8 @@ public:
     ///
     /// \param steps_per_frame 1フレームのステップ数(>= 1)
     /// \param end 試合の現在のエンド
-    void Begin(size_t steps_per_frame, std::uint8_t end);
+    /// \param tolerance 非可逆圧縮の許容誤差
+    void Begin(size_t steps_per_frame, std::uint8_t end, Tolerance const& tolerance);
 
     /// \brief ステップを記録する
     ///
@@ -74,15 +145,43 @@ public:
     Result const& GetResult() const;
 
 private:
+    static constexpr size_t kStoneMax = digitalcurling3::ISimulator::kStoneMax;
+    static_assert(kStoneMax <= 32);
+
     bool active_;
     size_t frame_count_;
     size_t steps_per_frame_;
     std::uint8_t end_;
-    digitalcurling3::GameState::Stones prev_stones_;
+    Tolerance tolerance_;
+
+    // 以下の配列とビットマスクは (チーム * 1チームのストーン数 + チーム内のインデックス) の順に並べる．
+    // この順に走査すると， GameState::Stones の順に差分を出力できる．
+    std::array<std::uint8_t, kStoneMax> all_stones_index_;  // ISimulator::AllStoneData でのインデックス
+    std::array<digitalcurling3::Transform, kStoneMax> prev_transforms_;  // 前回のフレームでの位置
+    std::uint32_t prev_in_play_;  // 前回のフレームでシート上にあったストーン
     Result result_;
 
+    // 非可逆圧縮用(ショットごとにメモリを確保し直さないよう，メンバとして持つ)
+    struct Sample {
+        std::int32_t frame;  // start は -1
+        digitalcurling3::Transform value;
+        bool removed;  // シート上から除外された
+        bool keep;  // キーフレームとして残す
+    };
+    struct Keyframe {
+        std::int32_t frame;
+        std::uint8_t stone;  // Difference::team * 1チームのストーン数 + Difference::index
+        std::optional<digitalcurling3::Transform> value;
+    };
+    std::array<std::vector<Sample>, kStoneMax> tracks_;  // ストーンごとの軌跡
+    std::vector<std::pair<size_t, size_t>> simplify_stack_;
+    std::vector<Keyframe> keyframes_;
+    std::vector<Difference> simplified_differences_;
+
     void SetFirstFrame(digitalcurling3::ISimulator const& simulator);
     void AddFrameDiff(digitalcurling3::ISimulator const& simulator);
+    void Simplify();
+    void MarkKeyframes(std::vector<Sample> & track, size_t first, size_t last);
 };
 
 
@@ -0,0 +1,162 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "trajectory_decoder.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace dc = digitalcurling3;
+
+namespace digitalcurling3_server {
+
+namespace {
+
+constexpr size_t kStonesPerTeam = std::tuple_size_v<dc::GameState::Stones::value_type>;
+
+} // unnamed namespace
+
+TrajectoryDecoder::TrajectoryDecoder(TrajectoryCompressor::Result const& result, size_t full_keyframe_interval)
+    : result_(result)
+    , interpolate_(!result.tolerance.IsLossless())
+    , full_keyframe_interval_(full_keyframe_interval)
+    , difference_frames_(result.differences.size())
+    , next_differences_(result.differences.size())
+    , full_keyframes_()
+    , cursors_()
+    , frame_(-1)
+    , stones_(result.start)
+{
+    size_t const frame_count = result_.GetFrameCount();
+
+    for (size_t i_frame = 0; i_frame < frame_count; ++i_frame) {
+        std::fill(difference_frames_.begin() + result_.frame_offsets[i_frame],
+            difference_frames_.begin() + result_.frame_offsets[i_frame + 1],
+            static_cast<std::int32_t>(i_frame));
+    }
+
+    // 後ろから走査して，ストーンごとに次の差分を繋ぐ
+    std::array<size_t, kStoneMax> next;
+    next.fill(kNone);
+    for (size_t i = result_.differences.size(); i > 0; --i) {
+        auto const& diff = result_.differences[i - 1];
+        auto & stone_next = next[static_cast<size_t>(diff.team) * kStonesPerTeam + diff.index];
+        next_differences_[i - 1] = stone_next;
+        stone_next = i - 1;
+    }
+
+    for (size_t i = 0; i < kStoneMax; ++i) {
+        cursors_[i] = Cursor{ -1, result_.start[i / kStonesPerTeam][i % kStonesPerTeam], next[i] };
+    }
+
+    // フルキーフレームを記録する(0番目は start )
+    full_keyframes_.push_back(cursors_);
+    if (full_keyframe_interval_ > 0) {
+        full_keyframes_.reserve(frame_count / full_keyframe_interval_ + 1);
+        for (size_t i_frame = 0; i_frame < frame_count; ++i_frame) {
+            ApplyFrame(i_frame);
+            if ((i_frame + 1) % full_keyframe_interval_ == 0) {
+                full_keyframes_.push_back(cursors_);
+            }
+        }
+        cursors_ = full_keyframes_.front();
+    }
+}
+
+dc::GameState::Stones const& TrajectoryDecoder::SeekFrame(std::ptrdiff_t frame)
+{
+    auto const frame_count = static_cast<std::ptrdiff_t>(GetFrameCount());
+    frame = std::clamp(frame, std::ptrdiff_t(-1), frame_count - 1);
+
+    // 直前のフルキーフレーム(フレーム base の状態)
+    size_t const i_full_keyframe = full_keyframe_interval_ > 0
+        ? static_cast<size_t>(frame + 1) / full_keyframe_interval_
+        : 0;
+    auto const base = static_cast<std::ptrdiff_t>(i_full_keyframe * full_keyframe_interval_) - 1;
+
+    // 現在のフレームから進む方が近ければ，フルキーフレームに戻らない
+    if (frame_ > frame || frame_ < base) {
+        cursors_ = full_keyframes_[i_full_keyframe];
+        frame_ = base;
+    }
+    for (; frame_ < frame; ++frame_) {
+        ApplyFrame(static_cast<size_t>(frame_ + 1));
+    }
+
+    UpdateStones();
+    return stones_;
+}
+
+dc::GameState::Stones const& TrajectoryDecoder::SeekTime(float seconds)
+{
+    if (!(result_.seconds_per_frame > 0.f)) {
+        return SeekFrame(-1);
+    }
+
+    // フレームの時刻ちょうどを指定した場合に丸め誤差で直前のフレームにならないよう，わずかに切り上げる
+    double const frames = std::floor(static_cast<double>(seconds) / static_cast<double>(result_.seconds_per_frame) + 1e-4);
+    double const max_frame = static_cast<double>(GetFrameCount());
+    return SeekFrame(static_cast<std::ptrdiff_t>(std::clamp(frames, 0.0, max_frame)) - 1);
+}
+
+void TrajectoryDecoder::ApplyFrame(size_t frame)
+{
+    for (size_t i = result_.frame_offsets[frame]; i < result_.frame_offsets[frame + 1]; ++i) {
+        auto const& diff = result_.differences[i];
+        cursors_[static_cast<size_t>(diff.team) * kStonesPerTeam + diff.index] =
+            Cursor{ static_cast<std::int32_t>(frame), diff.value, next_differences_[i] };
+    }
+}
+
+void TrajectoryDecoder::UpdateStones()
+{
+    for (size_t i = 0; i < kStoneMax; ++i) {
+        auto const& cursor = cursors_[i];
+        auto & stone = stones_[i / kStonesPerTeam][i % kStonesPerTeam];
+
+        if (!cursor.value) {
+            stone = std::nullopt;
+            continue;
+        }
+
+        // 非可逆圧縮では次のキーフレームまで線形補間する(除外される場合はそれまで静止している)
+        if (interpolate_ && cursor.next != kNone) {
+            auto const& next = result_.differences[cursor.next];
+            if (next.value) {
+                auto const& a = *cursor.value;
+                auto const& b = *next.value;
+                float const t = static_cast<float>(frame_ - cursor.frame)
+                    / static_cast<float>(difference_frames_[cursor.next] - cursor.frame);
+                stone = dc::Transform(
+                    dc::Vector2(
+                        a.position.x + (b.position.x - a.position.x) * t,
+                        a.position.y + (b.position.y - a.position.y) * t),
+                    a.angle + (b.angle - a.angle) * t);
+                continue;
+            }
+        }
+
+        stone = cursor.value;
+    }
+}
+
+} // namespace digitalcurling3_server
@@ -0,0 +1,114 @@
+﻿// MIT License
+// 
+// Copyright (c) 2022 UEC Takeshi Ito Laboratory
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIGITALCURLING3_SERVER_TRAJECTORY_DECODER_HPP
+#define DIGITALCURLING3_SERVER_TRAJECTORY_DECODER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+#include "digitalcurling3/digitalcurling3.hpp"
+#include "trajectory_compressor.hpp"
+
+namespace digitalcurling3_server {
+
+/// \brief TrajectoryCompressor::Result から任意のフレームのストーンの位置を復元する
+///
+/// フレーム番号は TrajectoryCompressor::Result と同じく start を -1 とする．
+/// フレーム i の位置は start にフレーム 0 から i までの差分を適用したものである．
+/// 非可逆圧縮の結果の場合は，キーフレームの間を TrajectoryCompressor::Result の説明の通りに線形補間する．
+///
+/// 構築時に全ての差分を1度だけ走査し，一定のフレーム数ごとに全ストーンの状態(フルキーフレーム)を記録する．
+/// シークでは直前のフルキーフレームから差分を適用するため，
+/// 1回のシークのコストは軌跡の長さによらずフルキーフレームの間隔で抑えられる．
+/// 直前にシークしたフレームから先に進む場合は，そのフレームから差分を適用する．
+class TrajectoryDecoder {
+public:
+    /// \brief フルキーフレームの間隔の既定値(フレーム数)
+    static constexpr size_t kDefaultFullKeyframeInterval = 32;
+
+    /// 非可逆圧縮かどうかは TrajectoryCompressor::Result::tolerance で判定する．
+    ///
+    /// \param result 軌跡．デコーダより長く生存し，その間に変更しないこと．
+    /// \param full_keyframe_interval フルキーフレームの間隔(フレーム数)．0の場合は記録せず，シークのたびに start から適用する．
+    explicit TrajectoryDecoder(TrajectoryCompressor::Result const& result,
+        size_t full_keyframe_interval = kDefaultFullKeyframeInterval);
+
+    /// \brief フレーム数を得る
+    size_t GetFrameCount() const { return result_.GetFrameCount(); }
+
+    /// \brief 軌跡の長さ[s]を得る(最後のフレームの時刻)
+    float GetDuration() const { return result_.seconds_per_frame * static_cast<float>(GetFrameCount()); }
+
+    /// \brief 指定したフレームにシークする
+    ///
+    /// \param frame フレーム番号． -1 以下の場合は start ， GetFrameCount() 以上の場合は最後のフレームとする．
+    /// \return そのフレームでのストーンの位置(次のシークまで有効)
+    digitalcurling3::GameState::Stones const& SeekFrame(std::ptrdiff_t frame);
+
+    /// \brief 指定した時刻にシークする
+    ///
+    /// start を0秒とし，フレーム i の時刻を (i + 1) * seconds_per_frame 秒とする．
+    /// フレームの間の時刻では直前のフレームになる．
+    ///
+    /// \param seconds 時刻[s]
+    /// \return その時刻でのストーンの位置(次のシークまで有効)
+    digitalcurling3::GameState::Stones const& SeekTime(float seconds);
+
+    /// \brief 現在のフレーム番号を得る
+    std::ptrdiff_t GetFrame() const { return frame_; }
+
+    /// \brief 現在のフレームでのストーンの位置を得る
+    digitalcurling3::GameState::Stones const& GetStones() const { return stones_; }
+
+private:
+    static constexpr size_t kStoneMax = digitalcurling3::ISimulator::kStoneMax;
+    static constexpr size_t kNone = std::numeric_limits<size_t>::max();
+
+    /// \brief ストーンごとの，直前に値が記録された差分
+    struct Cursor {
+        std::int32_t frame;  ///< 値が記録されたフレーム(start は -1)
+        std::optional<digitalcurling3::Transform> value;  ///< その値(シート上から除外された場合は std::nullopt )
+        size_t next;  ///< 同じストーンの次の差分の Result::differences での位置(無い場合は kNone )
+    };
+    using Cursors = std::array<Cursor, kStoneMax>;  // (チーム * 1チームのストーン数 + チーム内のインデックス) の順
+
+    TrajectoryCompressor::Result const& result_;
+    bool const interpolate_;
+    size_t const full_keyframe_interval_;
+    std::vector<std::int32_t> difference_frames_;  // 各差分のフレーム番号
+    std::vector<size_t> next_differences_;         // 各差分と同じストーンの次の差分の位置
+    std::vector<Cursors> full_keyframes_;          // i番目はフレーム i * full_keyframe_interval_ - 1 の状態
+    Cursors cursors_;
+    std::ptrdiff_t frame_;
+    digitalcurling3::GameState::Stones stones_;
+
+    void ApplyFrame(size_t frame);
+    void UpdateStones();
+};
+
+} // namespace digitalcurling3_server
+
+#endif // DIGITALCURLING3_SERVER_TRAJECTORY_DECODER_HPP
@@ -22,12 +22,29 @@
 
 #include "util.hpp"
 
+#include <stdexcept>
 #include <boost/date_time/c_local_time_adjustor.hpp>
 #include <boost/date_time/local_time/local_time.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 namespace digitalcurling3_server {
 
+namespace {
+
+constexpr char kBase64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int DecodeBase64Char(char c)
+{
+    if ('A' <= c && c <= 'Z') return c - 'A';
+    if ('a' <= c && c <= 'z') return c - 'a' + 26;
+    if ('0' <= c && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+} // unnamed namespace
+
 std::string GetTimeOfDay(boost::posix_time::ptime t)
 {
     return boost::posix_time::to_simple_string(t.time_of_day());
@@ -56,4 +73,64 @@ std::string GetISO8601String(boost::posix_time::ptime t)
     return boost::posix_time::to_iso_string(t);
 }
 
+std::string EncodeBase64(std::string_view data)
+{
+    std::string text;
+    text.reserve((data.size() + 2) / 3 * 4);
+
+    size_t i = 0;
+    for (; i + 3 <= data.size(); i += 3) {
+        std::uint32_t const v = (static_cast<std::uint32_t>(static_cast<unsigned char>(data[i])) << 16)
+            | (static_cast<std::uint32_t>(static_cast<unsigned char>(data[i + 1])) << 8)
+            | static_cast<std::uint32_t>(static_cast<unsigned char>(data[i + 2]));
+        text += kBase64Chars[(v >> 18) & 0x3f];
+        text += kBase64Chars[(v >> 12) & 0x3f];
+        text += kBase64Chars[(v >> 6) & 0x3f];
+        text += kBase64Chars[v & 0x3f];
+    }
+
+    if (size_t const rest = data.size() - i; rest > 0) {
+        std::uint32_t v = static_cast<std::uint32_t>(static_cast<unsigned char>(data[i])) << 16;
+        if (rest == 2) {
+            v |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[i + 1])) << 8;
+        }
+        text += kBase64Chars[(v >> 18) & 0x3f];
+        text += kBase64Chars[(v >> 12) & 0x3f];
+        text += rest == 2 ? kBase64Chars[(v >> 6) & 0x3f] : '=';
+        text += '=';
+    }
+
+    return text;
+}
+
+std::string DecodeBase64(std::string_view text)
+{
+    if (text.size() % 4 != 0) {
+        throw std::runtime_error("base64: invalid length");
+    }
+
+    std::string data;
+    data.reserve(text.size() / 4 * 3);
+
+    for (size_t i = 0; i < text.size(); i += 4) {
+        bool const last = i + 4 == text.size();
+        size_t const padding = last ? (text[i + 3] == '=' ? (text[i + 2] == '=' ? 2 : 1) : 0) : 0;
+
+        std::uint32_t v = 0;
+        for (size_t j = 0; j < 4 - padding; ++j) {
+            int const d = DecodeBase64Char(text[i + j]);
+            if (d < 0) {
+                throw std::runtime_error("base64: invalid character");
+            }
+            v |= static_cast<std::uint32_t>(d) << (18 - 6 * j);
+        }
+
+        data += static_cast<char>((v >> 16) & 0xff);
+        if (padding < 2) data += static_cast<char>((v >> 8) & 0xff);
+        if (padding < 1) data += static_cast<char>(v & 0xff);
+    }
+
+    return data;
+}
+
 } // namespace digitalcurling3_server
@@ -24,6 +24,7 @@
 #define DIGITALCURLING3_SERVER_UTIL_HPP
 
 #include <string>
+#include <string_view>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 
@@ -44,6 +45,19 @@ std::string GetISO8601ExtendedString(boost::posix_time::ptime t = boost::posix_t
 /// \return YYYYMMDDThhmmss 形式の時刻
 std::string GetISO8601String(boost::posix_time::ptime t = boost::posix_time::second_clock::local_time());
 
+/// \brief Base64(RFC 4648, パディングあり)でエンコードする
+/// \param data エンコードするバイト列
+/// \return エンコードした文字列
+std::string EncodeBase64(std::string_view data);
+
+/// \brief Base64(RFC 4648, パディングあり)をデコードする
+///
+/// 不正な文字列の場合は例外を送出する．
+///
+/// \param text デコードする文字列
+/// \return デコードしたバイト列
+std::string DecodeBase64(std::string_view text);
+
 } // namespace digitalcurling3_server
 
 #endif